@@ -1,10 +1,27 @@
 {
+  'variables': {
+    'build_bench%': 0,
+    'build_tests%': 0
+  },
   'targets': [
     {
       'target_name': 'overlay_window',
       'sources': [
         'src/lib/addon.c',
-        'src/lib/napi_helpers.c'
+        'src/lib/cpu_features.c',
+        'src/lib/event_queue.c',
+        'src/lib/frame_damage.c',
+        'src/lib/image_encode.c',
+        'src/lib/matcher.c',
+        'src/lib/metrics.c',
+        'src/lib/napi_helpers.c',
+        'src/lib/parallel.c',
+        'src/lib/pixel_ops.c',
+        'src/lib/probe_set.c',
+        'src/lib/region_stats.c',
+        'src/lib/target_state.c',
+        'src/lib/tile_hash.c',
+        'src/lib/triple_buffer.c'
       ],
       'include_dirs': [
         'src/lib'
@@ -24,6 +41,12 @@
           ]
       	}],
         ['OS=="linux"', {
+          'variables': {
+            'has_xcb_shm': '<!(pkg-config --exists xcb-shm && echo 1 || echo 0)',
+            'has_xcb_composite': '<!(pkg-config --exists xcb-composite && echo 1 || echo 0)',
+            'has_xcb_damage': '<!(pkg-config --exists xcb-damage && echo 1 || echo 0)',
+            'has_xcb_randr': '<!(pkg-config --exists xcb-randr && echo 1 || echo 0)'
+          },
           'defines': [
             '_GNU_SOURCE'
           ],
@@ -35,6 +58,50 @@
           'cflags': ['-std=c99', '-pedantic', '-Wall', '-pthread'],
       	  'sources': [
             'src/lib/x11.c',
+            'src/lib/x11/capture.c',
+            'src/lib/x11/client_list.c',
+            'src/lib/x11/damage_stream.c',
+            'src/lib/x11/refresh_rate.c',
+            'src/lib/x11/trace.c',
+            'src/lib/x11/window_cache.c',
+          ],
+          'conditions': [
+            ['has_xcb_shm==1', {
+              'defines': [
+                'OW_HAVE_XCB_SHM'
+              ],
+              'cflags': ['<!@(pkg-config --cflags xcb-shm)'],
+              'link_settings': {
+                'libraries': ['<!@(pkg-config --libs xcb-shm)']
+              }
+            }],
+            ['has_xcb_composite==1', {
+              'defines': [
+                'OW_HAVE_XCB_COMPOSITE'
+              ],
+              'cflags': ['<!@(pkg-config --cflags xcb-composite)'],
+              'link_settings': {
+                'libraries': ['<!@(pkg-config --libs xcb-composite)']
+              }
+            }],
+            ['has_xcb_damage==1', {
+              'defines': [
+                'OW_HAVE_XCB_DAMAGE'
+              ],
+              'cflags': ['<!@(pkg-config --cflags xcb-damage)'],
+              'link_settings': {
+                'libraries': ['<!@(pkg-config --libs xcb-damage)']
+              }
+            }],
+            ['has_xcb_randr==1', {
+              'defines': [
+                'OW_HAVE_XCB_RANDR'
+              ],
+              'cflags': ['<!@(pkg-config --cflags xcb-randr)'],
+              'link_settings': {
+                'libraries': ['<!@(pkg-config --libs xcb-randr)']
+              }
+            }]
           ]
         }],
         ['OS=="mac"', {
@@ -56,5 +123,114 @@
         }]
       ]
     }
+  ],
+  'conditions': [
+    # node-gyp configure -- -Dbuild_bench=1
+    ['OS=="linux" and build_bench==1', {
+      'targets': [
+        {
+          'target_name': 'x11_bench',
+          'type': 'executable',
+          'variables': {
+            'has_xcb_shm': '<!(pkg-config --exists xcb-shm && echo 1 || echo 0)',
+            'has_xcb_composite': '<!(pkg-config --exists xcb-composite && echo 1 || echo 0)',
+            'has_xcb_damage': '<!(pkg-config --exists xcb-damage && echo 1 || echo 0)',
+            'has_xcb_randr': '<!(pkg-config --exists xcb-randr && echo 1 || echo 0)'
+          },
+          'sources': [
+            'src/bench/x11_bench.c',
+            'src/lib/cpu_features.c',
+            'src/lib/frame_damage.c',
+            'src/lib/matcher.c',
+            'src/lib/metrics.c',
+            'src/lib/parallel.c',
+            'src/lib/pixel_ops.c',
+            'src/lib/tile_hash.c',
+            'src/lib/triple_buffer.c',
+            'src/lib/x11.c',
+            'src/lib/x11/capture.c',
+            'src/lib/x11/client_list.c',
+            'src/lib/x11/damage_stream.c',
+            'src/lib/x11/refresh_rate.c',
+            'src/lib/x11/trace.c',
+            'src/lib/x11/window_cache.c'
+          ],
+          'include_dirs': [
+            'src/lib'
+          ],
+          'defines': [
+            '_GNU_SOURCE'
+          ],
+          'cflags': ['-std=c99', '-pedantic', '-Wall', '-pthread'],
+          'link_settings': {
+            'libraries': [
+              '<!@(pkg-config --libs libuv 2>/dev/null || echo -luv)', '-lxcb', '-lpthread', '-ldl'
+            ]
+          },
+          'conditions': [
+            ['has_xcb_shm==1', {
+              'defines': [
+                'OW_HAVE_XCB_SHM'
+              ],
+              'cflags': ['<!@(pkg-config --cflags xcb-shm)'],
+              'link_settings': {
+                'libraries': ['<!@(pkg-config --libs xcb-shm)']
+              }
+            }],
+            ['has_xcb_composite==1', {
+              'defines': [
+                'OW_HAVE_XCB_COMPOSITE'
+              ],
+              'cflags': ['<!@(pkg-config --cflags xcb-composite)'],
+              'link_settings': {
+                'libraries': ['<!@(pkg-config --libs xcb-composite)']
+              }
+            }],
+            ['has_xcb_damage==1', {
+              'defines': [
+                'OW_HAVE_XCB_DAMAGE'
+              ],
+              'cflags': ['<!@(pkg-config --cflags xcb-damage)'],
+              'link_settings': {
+                'libraries': ['<!@(pkg-config --libs xcb-damage)']
+              }
+            }],
+            ['has_xcb_randr==1', {
+              'defines': [
+                'OW_HAVE_XCB_RANDR'
+              ],
+              'cflags': ['<!@(pkg-config --cflags xcb-randr)'],
+              'link_settings': {
+                'libraries': ['<!@(pkg-config --libs xcb-randr)']
+              }
+            }]
+          ]
+        }
+      ]
+    }],
+    # node-gyp configure -- -Dbuild_tests=1
+    ['build_tests==1', {
+      'targets': [
+        {
+          'target_name': 'event_queue_test',
+          'type': 'executable',
+          'sources': [
+            'src/test/event_queue_test.c',
+            'src/lib/event_queue.c'
+          ],
+          'include_dirs': [
+            'src/lib'
+          ],
+          'conditions': [
+            ['OS=="linux"', {
+              'defines': [
+                '_GNU_SOURCE'
+              ],
+              'cflags': ['-std=c99', '-pedantic', '-Wall']
+            }]
+          ]
+        }
+      ]
+    }]
   ]
 }
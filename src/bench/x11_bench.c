@@ -0,0 +1,387 @@
+// Drives the X11 backend against scripted client windows and reports
+// throughput, hook thread CPU time, reply waits and latency per scenario.
+//
+// Needs an X server without a window manager, this program maintains
+// `_NET_CLIENT_LIST` and `_NET_ACTIVE_WINDOW` itself:
+//
+//   node-gyp configure -- -Dbuild_bench=1 && node-gyp build
+//   xvfb-run -a build/Release/x11_bench [count] [--track-configure] [--record trace]
+//
+// A recorded trace is replayed through the same state machine without
+// an X server, with the targets and options it was recorded with, as fast
+// as possible unless `--real-time`. Exits with 1 if the replay diverged:
+//
+//   build/Release/x11_bench --replay trace [--real-time]
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <xcb/xcb.h>
+#include "overlay_window.h"
+#include "matcher.h"
+#include "metrics.h"
+
+#define TARGET_TITLE "ow-bench-target"
+#define DECOY_TITLE "ow-bench-decoy"
+#define DEFAULT_COUNT 2000
+#define WAIT_TIMEOUT_NS 10000000000ull
+
+static xcb_connection_t* conn;
+static xcb_window_t root;
+static xcb_window_t target;
+static xcb_window_t decoy;
+// also matches, activated to know that the hook handled all previous events
+static xcb_window_t sentinel;
+static xcb_atom_t ATOM_NET_ACTIVE_WINDOW;
+static xcb_atom_t ATOM_NET_CLIENT_LIST;
+static xcb_atom_t ATOM_NET_WM_NAME;
+static xcb_atom_t ATOM_UTF8_STRING;
+
+static uv_thread_t main_thread;
+
+// written by the hook thread in `ow_emit_event`, guarded by lock
+static uv_mutex_t lock;
+static uv_cond_t emitted;
+static struct ow_metrics metrics;
+static uint32_t event_counts[OW_LATENCY_EVENT_COUNT];
+static uint32_t event_total;
+static struct ow_window_bounds last_bounds;
+static uint64_t hook_cpu_ns;
+
+// x position of the target -> when it was requested, for move latency
+#define MOVE_POSITIONS 1024
+#define MOVE_ORIGIN 100
+static uint64_t move_sent_ns[MOVE_POSITIONS];
+static uint64_t* latencies_ns;
+static uint32_t latency_count;
+static uint32_t latency_capacity;
+
+static volatile uint32_t reply_waits;
+
+// Counts replies waited for by the hook, generated `*_reply`
+// functions of libxcb call this through the dynamic linker.
+void* xcb_wait_for_reply(xcb_connection_t* c, unsigned int request, xcb_generic_error_t** e) {
+  static void* (*next)(xcb_connection_t*, unsigned int, xcb_generic_error_t**) = NULL;
+  if (next == NULL) {
+    *(void**)(&next) = dlsym(RTLD_NEXT, "xcb_wait_for_reply");
+  }
+  uv_thread_t self = uv_thread_self();
+  if (!uv_thread_equal(&self, &main_thread)) {
+    __atomic_fetch_add(&reply_waits, 1, __ATOMIC_RELAXED);
+  }
+  return next(c, request, e);
+}
+
+static uint64_t thread_cpu_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void ow_emit_event(void* context, struct ow_event* event) {
+  uint64_t now = uv_hrtime();
+  uv_mutex_lock(&lock);
+  hook_cpu_ns = thread_cpu_ns();
+  event_counts[event->type] += 1;
+  event_total += 1;
+  if (event->type == OW_MOVERESIZE || event->type == OW_ATTACH) {
+    last_bounds = (event->type == OW_MOVERESIZE) ? event->data.moveresize.bounds : event->data.attach.bounds;
+  }
+  if (event->type == OW_MOVERESIZE) {
+    int32_t index = last_bounds.x - MOVE_ORIGIN;
+    if (index >= 0 && index < MOVE_POSITIONS && move_sent_ns[index] != 0 && latency_count < latency_capacity) {
+      latencies_ns[latency_count++] = now - move_sent_ns[index];
+      move_sent_ns[index] = 0;
+    }
+  }
+  uv_cond_signal(&emitted);
+  uv_mutex_unlock(&lock);
+}
+
+void ow_emit_burst_end(void* context) {
+}
+
+void ow_emit_frame(void* context, struct ow_frame_event* event) {
+}
+
+static xcb_atom_t intern_atom(const char* name) {
+  xcb_intern_atom_reply_t* reply = xcb_intern_atom_reply(conn, xcb_intern_atom(conn, 0, strlen(name), name), NULL);
+  xcb_atom_t atom = (reply != NULL) ? reply->atom : XCB_ATOM_NONE;
+  free(reply);
+  return atom;
+}
+
+static void set_title(xcb_window_t window, const char* title) {
+  xcb_change_property(conn, XCB_PROP_MODE_REPLACE, window, ATOM_NET_WM_NAME, ATOM_UTF8_STRING, 8, strlen(title), title);
+}
+
+static void set_active(xcb_window_t window) {
+  xcb_change_property(conn, XCB_PROP_MODE_REPLACE, root, ATOM_NET_ACTIVE_WINDOW, XCB_ATOM_WINDOW, 32, 1, &window);
+}
+
+static xcb_window_t create_window(const char* title, int16_t x, int16_t y) {
+  xcb_screen_t* screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+  xcb_window_t window = xcb_generate_id(conn);
+  xcb_create_window(conn, XCB_COPY_FROM_PARENT, window, root, x, y, 640, 480, 0,
+    XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual, 0, NULL);
+  set_title(window, title);
+  xcb_map_window(conn, window);
+  return window;
+}
+
+// Waits until `done` returns true for the state written by the hook.
+static bool wait_for(bool (*done)(uint32_t arg), uint32_t arg) {
+  uint64_t deadline = uv_hrtime() + WAIT_TIMEOUT_NS;
+  uv_mutex_lock(&lock);
+  while (!done(arg)) {
+    uint64_t now = uv_hrtime();
+    if (now >= deadline || uv_cond_timedwait(&emitted, &lock, deadline - now) == UV_ETIMEDOUT) {
+      bool result = done(arg);
+      uv_mutex_unlock(&lock);
+      return result;
+    }
+  }
+  uv_mutex_unlock(&lock);
+  return true;
+}
+
+static bool has_attach_count(uint32_t count) {
+  return event_counts[OW_ATTACH] >= count;
+}
+
+static bool has_blur_count(uint32_t count) {
+  return event_counts[OW_BLUR] >= count;
+}
+
+static bool is_moved_to(uint32_t x) {
+  return last_bounds.x == (int32_t)x;
+}
+
+struct scenario_start {
+  uint64_t time_ns;
+  uint64_t hook_cpu_ns;
+  uint32_t event_total;
+  uint32_t reply_waits;
+};
+
+static void begin_scenario(struct scenario_start* start) {
+  uv_mutex_lock(&lock);
+  start->hook_cpu_ns = hook_cpu_ns;
+  start->event_total = event_total;
+  latency_count = 0;
+  uv_mutex_unlock(&lock);
+  start->reply_waits = __atomic_load_n(&reply_waits, __ATOMIC_RELAXED);
+  start->time_ns = uv_hrtime();
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t lhs = *((const uint64_t*)a);
+  uint64_t rhs = *((const uint64_t*)b);
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static double percentile_ms(double quantile) {
+  if (latency_count == 0) return 0;
+  uint32_t index = (uint32_t)(quantile * (latency_count - 1) + 0.5);
+  return latencies_ns[index] / 1e6;
+}
+
+static void end_scenario(const char* name, struct scenario_start* start, uint32_t requests, bool is_complete) {
+  uint64_t elapsed_ns = uv_hrtime() - start->time_ns;
+  uv_mutex_lock(&lock);
+  uint32_t events = event_total - start->event_total;
+  uint64_t cpu_ns = hook_cpu_ns - start->hook_cpu_ns;
+  qsort(latencies_ns, latency_count, sizeof(uint64_t), compare_u64);
+  printf("%-12s %8u %8u %10.0f %10.0f %12.2f %9u",
+    name, requests, events,
+    requests / (elapsed_ns / 1e9), events / (elapsed_ns / 1e9),
+    events ? (cpu_ns / 1e3) / events : 0,
+    __atomic_load_n(&reply_waits, __ATOMIC_RELAXED) - start->reply_waits);
+  if (latency_count != 0) {
+    printf(" %7.2f %7.2f %7.2f %7.2f",
+      percentile_ms(0.5), percentile_ms(0.9), percentile_ms(0.99), latencies_ns[latency_count - 1] / 1e6);
+  }
+  printf("%s\n", is_complete ? "" : "  (timed out)");
+  uv_mutex_unlock(&lock);
+}
+
+// Moves the target as fast as the server accepts requests.
+static void bench_moveresize(uint32_t count) {
+  struct scenario_start start;
+  begin_scenario(&start);
+  uint32_t x = MOVE_ORIGIN;
+  for (uint32_t i = 0; i < count; ++i) {
+    x = MOVE_ORIGIN + 1 + (i % (MOVE_POSITIONS - 1));
+    uint32_t values[] = { x, 100 + (i & 1) };
+    uv_mutex_lock(&lock);
+    move_sent_ns[x - MOVE_ORIGIN] = uv_hrtime();
+    uv_mutex_unlock(&lock);
+    xcb_configure_window(conn, target, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
+    xcb_flush(conn);
+  }
+  bool is_complete = wait_for(is_moved_to, x);
+  end_scenario("moveresize", &start, count, is_complete);
+}
+
+// Switches the active window between the target and a decoy. The hook reads
+// the current active window on every notify, so some flaps are not emitted.
+static void bench_focus(uint32_t count) {
+  uv_mutex_lock(&lock);
+  uint32_t attach_count = event_counts[OW_ATTACH];
+  uv_mutex_unlock(&lock);
+
+  struct scenario_start start;
+  begin_scenario(&start);
+  for (uint32_t i = 0; i < count; ++i) {
+    set_active(decoy);
+    set_active(target);
+    xcb_flush(conn);
+  }
+  set_active(sentinel);
+  xcb_flush(conn);
+  bool is_complete = wait_for(has_attach_count, attach_count + 1);
+  end_scenario("focus", &start, count * 2, is_complete);
+}
+
+// Renames the active decoy, the hook must match every new title.
+// The last title matches, so the hook attaches to the decoy.
+static void bench_title(uint32_t count) {
+  uv_mutex_lock(&lock);
+  uint32_t attach_count = event_counts[OW_ATTACH];
+  uint32_t blur_count = event_counts[OW_BLUR];
+  uv_mutex_unlock(&lock);
+
+  set_active(decoy);
+  xcb_flush(conn);
+  wait_for(has_blur_count, blur_count + 1);
+
+  struct scenario_start start;
+  begin_scenario(&start);
+  char title[64];
+  for (uint32_t i = 0; i < count; ++i) {
+    snprintf(title, sizeof(title), DECOY_TITLE " %u", i);
+    set_title(decoy, title);
+    xcb_flush(conn);
+  }
+  set_title(decoy, TARGET_TITLE);
+  xcb_flush(conn);
+  bool is_complete = wait_for(has_attach_count, attach_count + 1);
+  end_scenario("title", &start, count + 1, is_complete);
+}
+
+static struct ow_matcher* create_matcher() {
+  struct ow_matcher* matcher = calloc(1, sizeof(struct ow_matcher));
+  matcher->title_mode = OW_TITLE_EXACT;
+  matcher->title = strdup(TARGET_TITLE);
+  ow_matcher_compile(matcher);
+  return matcher;
+}
+
+static void print_header() {
+  printf("%-12s %8s %8s %10s %10s %12s %9s %7s %7s %7s %7s\n",
+    "scenario", "requests", "events", "requests/s", "events/s", "cpu us/event", "replies",
+    "p50 ms", "p90 ms", "p99 ms", "max ms");
+}
+
+// Replays on the main thread, events are emitted from it.
+static int replay(const char* path, bool is_real_time) {
+  hook_cpu_ns = thread_cpu_ns();
+  struct scenario_start start;
+  begin_scenario(&start);
+  enum ow_replay_result result = ow_replay_trace(path, is_real_time, NULL);
+  if (result == OW_REPLAY_UNREADABLE) {
+    fprintf(stderr, "can't read trace %s\n", path);
+    return 1;
+  }
+  if (result == OW_REPLAY_DIVERGED) {
+    fprintf(stderr, "replay diverged from trace %s, events after that point were not replayed\n", path);
+    return 1;
+  }
+  print_header();
+  end_scenario("replay", &start, 0, true);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  uint32_t count = DEFAULT_COUNT;
+  const char* replay_path = NULL;
+  bool is_real_time = false;
+  struct ow_hook_options options = {
+    .track_configure_notify = false,
+    .capture_composite = false,
+    .moveresize_pacing = OW_PACING_IMMEDIATE,
+    .moveresize_fps = 0,
+    .follow_target = false,
+    .trace_path = NULL,
+    .loop = NULL,
+    .metrics = &metrics
+  };
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--track-configure") == 0) {
+      options.track_configure_notify = true;
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      options.trace_path = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replay_path = argv[++i];
+    } else if (strcmp(argv[i], "--real-time") == 0) {
+      is_real_time = true;
+    } else {
+      count = (uint32_t)strtoul(argv[i], NULL, 10);
+    }
+  }
+  if (count == 0) {
+    fprintf(stderr, "usage: %s [count] [--track-configure] [--record trace | --replay trace [--real-time]]\n", argv[0]);
+    return 2;
+  }
+
+  main_thread = uv_thread_self();
+  uv_mutex_init(&lock);
+  uv_cond_init(&emitted);
+  ow_metrics_init(&metrics);
+  latency_capacity = count;
+  latencies_ns = malloc(sizeof(uint64_t) * latency_capacity);
+  if (replay_path != NULL) {
+    return replay(replay_path, is_real_time);
+  }
+
+  conn = xcb_connect(NULL, NULL);
+  if (xcb_connection_has_error(conn)) {
+    fprintf(stderr, "can't connect to X server, run under xvfb-run\n");
+    return 1;
+  }
+
+  root = xcb_setup_roots_iterator(xcb_get_setup(conn)).data->root;
+  ATOM_NET_ACTIVE_WINDOW = intern_atom("_NET_ACTIVE_WINDOW");
+  ATOM_NET_CLIENT_LIST = intern_atom("_NET_CLIENT_LIST");
+  ATOM_NET_WM_NAME = intern_atom("_NET_WM_NAME");
+  ATOM_UTF8_STRING = intern_atom("UTF8_STRING");
+
+  target = create_window(TARGET_TITLE, MOVE_ORIGIN, 100);
+  decoy = create_window(DECOY_TITLE, 800, 100);
+  sentinel = create_window(TARGET_TITLE, 800, 600);
+  xcb_window_t clients[] = { target, decoy };
+  xcb_change_property(conn, XCB_PROP_MODE_REPLACE, root, ATOM_NET_CLIENT_LIST, XCB_ATOM_WINDOW, 32, 2, clients);
+  set_active(target);
+  xcb_flush(conn);
+
+  struct ow_hook* hook = ow_start_hook(create_matcher(), NULL, &options, NULL);
+  if (!wait_for(has_attach_count, 1)) {
+    fprintf(stderr, "hook didn't attach to the test window\n");
+    return 1;
+  }
+  struct ow_timing_stats startup;
+  ow_metrics_read_timing(&metrics, OW_TIMING_STARTUP, &startup);
+  printf("startup %.2f ms, %u iterations%s\n\n", startup.last_ns / 1e6, count,
+    options.track_configure_notify ? ", tracking ConfigureNotify" : "");
+
+  print_header();
+  bench_moveresize(count);
+  bench_focus(count);
+  bench_title(count);
+
+  ow_stop_hook(hook);
+  xcb_disconnect(conn);
+  return 0;
+}
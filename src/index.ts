@@ -1,5 +1,6 @@
 import { EventEmitter } from 'node:events'
 import { join } from 'node:path'
+import { performance } from 'node:perf_hooks'
 import { throttle } from 'throttle-debounce'
 import { screen } from 'electron'
 import { BrowserWindow, Rectangle, BrowserWindowConstructorOptions } from 'electron'
@@ -8,13 +9,52 @@ const lib: AddonExports = require('node-gyp-build')(join(__dirname, '..'))
 interface AddonExports {
   start(
     overlayWindowId: Buffer | undefined,
-    targetWindowTitle: string,
-    cb: (e: any) => void
+    target: string | WindowMatcher,
+    cb: (recordCount: number) => void,
+    options?: NativeHookOptions
   ): void
 
   activateOverlay(): void
   focusTarget(): void
-  screenshot(): Buffer
+  getTargetState(out: Int32Array): void
+  getMetrics(): Metrics
+  recordApplyLatency(eventType: number, durationMs: number): void
+  resetLatency(): void
+  listWindows(): WindowInfo[]
+  screenshot(options?: ImageOptions): Buffer
+  screenshotAsync(into?: Buffer, options?: ScreenshotOptions): Promise<Screenshot>
+  encodeImage(image: Buffer, width: number, height: number, options: { encoding: ImageEncoding }): Promise<Buffer>
+  startCaptureStream(options: NativeStreamOptions, cb?: (e: FrameEvent) => void): void
+  stopCaptureStream(): void
+  readFrame(into: Buffer, options?: ImageOptions): FrameInfo | null
+  createChangeDetector(tileSize?: number): unknown
+  detectChanges(detector: unknown, image: Buffer, width: number, height: number, bytesPerPixel?: number): ChangeResult
+  createProbeSet(regions: Int32Array): unknown
+  readProbes(probeSet: unknown, out: Uint32Array): void
+}
+
+enum TargetStateFlags {
+  ATTACHED = 1 << 0,
+  FOCUSED = 1 << 1,
+  FULLSCREEN = 1 << 2,
+}
+
+interface NativeHookOptions {
+  trackConfigureNotify?: boolean
+  captureComposite?: boolean
+  moveresizePacing?: 'immediate' | 'vsync' | 'fixed'
+  moveresizeFps?: number
+  followTarget?: boolean
+  recordTrace?: string
+  runOnLoop?: boolean
+  extraTargets?: Array<{ target: string | WindowMatcher, overlayWindowId?: Buffer }>
+  // events are written as `EVENT_RECORD_LENGTH` records, callback receives their count
+  eventBuffer?: Int32Array
+}
+
+interface NativeStreamOptions {
+  maxFps?: number
+  pollIntervalMs?: number
 }
 
 enum EventType {
@@ -26,7 +66,25 @@ enum EventType {
   EVENT_MOVERESIZE = 6,
 }
 
-export interface AttachEvent {
+// [type, x, y, width, height, flags, timestampMs, targetId]
+const EVENT_RECORD_LENGTH = 8
+
+enum EventRecordFlags {
+  HAS_ACCESS = 1 << 0,
+  HAS_ACCESS_KNOWN = 1 << 1,
+  FULLSCREEN = 1 << 2,
+  FULLSCREEN_KNOWN = 1 << 3,
+}
+
+export interface NativeEvent {
+  // Milliseconds since `attach`, when the event was observed by the native hook,
+  // not when it was dispatched (move/resize can be held back by pacing)
+  timestamp: number
+  // 0 for the target passed to `attach`, index + 1 in `extraTargetsOnLinux`
+  targetId: number
+}
+
+export interface AttachEvent extends NativeEvent {
   hasAccess: boolean | undefined
   isFullscreen: boolean | undefined
   x: number
@@ -35,20 +93,293 @@ export interface AttachEvent {
   height: number
 }
 
-export interface FullscreenEvent {
+export interface FullscreenEvent extends NativeEvent {
   isFullscreen: boolean
 }
 
-export interface MoveresizeEvent {
+export interface MoveresizeEvent extends NativeEvent {
   x: number
   y: number
   width: number
   height: number
 }
 
+export interface TargetState {
+  // Incremented on every change, can be used to skip unchanged frames
+  generation: number
+  isAttached: boolean
+  hasFocus: boolean
+  isFullscreen: boolean
+  // Platform-specific window ID, 0 if not attached
+  windowId: number
+  // NOTE: same coordinate space as `targetBounds`
+  bounds: Rectangle
+}
+
+export interface TimingStats {
+  count: number
+  lastMs: number
+  minMs: number
+  maxMs: number
+  meanMs: number
+}
+
+// Bucketed with ~12.5% precision, percentiles are bucket upper bounds
+export interface LatencyStats {
+  count: number
+  p50Ms: number
+  p90Ms: number
+  p99Ms: number
+  maxMs: number
+}
+
+export type EventLatency = Record<'attach' | 'focus' | 'blur' | 'detach' | 'fullscreen' | 'moveresize', LatencyStats>
+
+export interface Metrics {
+  // From the start of the native hook until the initial target check is done
+  startup: TimingStats
+  // From checking a newly active window until the attach event is emitted
+  attach: TimingStats
+  // Per stage and event type, since start or `resetLatency`
+  latency: {
+    // From the source event time until the hook received it.
+    // X11 (local server only) and Windows
+    source: EventLatency
+    // From receiving the source event until queued for JS
+    hook: EventLatency
+    // From queued until dispatched to JS
+    queue: EventLatency
+    // From dispatched to JS until the overlay bounds are applied
+    apply: EventLatency
+  }
+  // Attach, detach and fullscreen events lost since start because JS didn't
+  // keep up with the native hook, move/resize and focus changes are coalesced
+  droppedEvents: number
+}
+
+/**
+ * Criteria to find the target window, all specified criteria must match.
+ * Only one of the title criteria can be used at a time.
+ */
+export interface WindowMatcher {
+  title?: string
+  titlePrefix?: string
+  titleSuffix?: string
+  // POSIX extended regular expression, not supported on Windows
+  titleRegex?: string
+  // Linux only: instance or class name from `WM_CLASS`
+  wmClass?: string
+  // Linux only: `_NET_WM_PID`
+  pid?: number
+  // Linux only: executable name of the `_NET_WM_PID` process
+  exeName?: string
+}
+
+export interface ExtraTarget {
+  target: WindowMatcher
+  // Made override-redirect like the main overlay. It is only moved
+  // with `followTargetOnLinux`, otherwise use events of this target
+  overlayWindow?: BrowserWindow
+}
+
+export interface WindowInfo {
+  // X11 window ID
+  id: number
+  // Empty if the window has no `_NET_WM_NAME`
+  title: string
+  // Class part of `WM_CLASS`, empty if not set
+  wmClass: string
+  // `_NET_WM_PID`, 0 if unknown
+  pid: number
+}
+
+export interface ImageOptions {
+  // Region of the target to keep, clamped to the target's size
+  crop?: Rectangle
+  // Size of the result, by default the size of the cropped region.
+  // If only one is specified, the other one keeps the aspect ratio
+  width?: number
+  height?: number
+  // Used when the size changes, default 'box'
+  filter?: 'box' | 'bilinear'
+  // Pixel layout of the result, default 'bgra'. 'gray' is one byte per pixel
+  format?: 'bgra' | 'rgba' | 'rgb' | 'gray'
+}
+
+// Opaque RGB, captures don't have a meaningful alpha channel
+export type ImageEncoding = 'png' | 'qoi'
+
+export interface ScreenshotOptions extends ImageOptions {
+  // Encodes on the worker thread, requires 'bgra' format and no `into` buffer
+  encoding?: ImageEncoding
+}
+
+export interface Screenshot {
+  // `width * height * bytesPerPixel(format)` bytes are written, or the encoded image
+  buffer: Buffer
+  // Size of the result
+  width: number
+  height: number
+}
+
+export interface FrameInfo {
+  // Starts at 1, incremented for every captured frame
+  seq: number
+  width: number
+  height: number
+}
+
+export interface FrameEvent extends FrameInfo {
+  // Areas changed since the previous event, relative to the target
+  rects: Rectangle[]
+}
+
+export interface ChangeResult {
+  changedTiles: number
+  // Area of the changed tiles relative to the whole image, 0..1
+  changedFraction: number
+  // Changed tiles merged into rectangles
+  rects: Rectangle[]
+}
+
+export interface CaptureStreamOptions {
+  // Limits how often the target is captured, by default it's captured on every redraw
+  maxFps?: number
+  // Capture interval if the X server can't report redraws (no DAMAGE extension), default 100
+  pollIntervalMs?: number
+  // Called after frames are captured, frames captured while
+  // the previous call was pending are combined into one call
+  onFrame?: (e: FrameEvent) => void
+}
+
 export interface AttachOptions {
   // Whether the Window has a title bar. We adjust the overlay to not cover it
   hasTitleBarOnMac?: boolean
+  // X11: compute target bounds from ConfigureNotify events without querying
+  // the X server on every move. Requires an ICCCM compliant window manager
+  // that sends synthetic ConfigureNotify when moving windows
+  trackConfigureNotifyOnLinux?: boolean
+  // X11: `screenshot` reads only the target's own contents using the
+  // Composite extension, so the overlay doesn't need to be hidden before
+  // capturing. Falls back to capturing the screen if not supported
+  captureTargetOnlyOnLinux?: boolean
+  // Extrapolate the overlay position while the target is dragged,
+  // to hide the delay between the target moving and the overlay following it
+  predictMotion?: boolean | MotionPredictionOptions
+  // How often the overlay follows the target while it moves:
+  // - 'fixed' (default): at most `moveresizeFps` (30) times per second
+  // - 'vsync': once per refresh of the target's monitor. Only X11 reads the
+  //   target's monitor, elsewhere the rate of the primary display is used
+  // - 'immediate': on every update received from the OS
+  // On X11 updates are paced natively. The latest bounds are always applied
+  moveresizeDispatch?: 'immediate' | 'vsync' | 'fixed'
+  moveresizeFps?: number
+  // X11: the native hook moves the overlay and raises it above the target
+  // as soon as the X server reports changes, without waiting for JS.
+  // Events are still delivered, `predictMotion` has no effect
+  followTargetOnLinux?: boolean
+  // X11: path of a file to record every X event and reply read by the hook into.
+  // Replay it with `x11_bench --replay` to reproduce issues without the X server
+  recordTraceOnLinux?: string
+  // X11: watch the X connection from the event loop of the thread calling
+  // `attach` instead of a separate thread. Events are delivered without
+  // a cross-thread handoff, but attaching blocks until the target is checked
+  hookOnEventLoopOnLinux?: boolean
+  // X11: more targets watched over the same X connection and hook, at most 7.
+  // Their events have `targetId` set and only reach `events` listeners, the
+  // controller ignores them: its state, `getTargetState` and screenshots
+  // are always of the target passed to `attach`
+  extraTargetsOnLinux?: ExtraTarget[]
+}
+
+export interface MotionPredictionOptions {
+  // How far ahead of the latest move to extrapolate. Should be about
+  // the delay from the target moving until the overlay is presented
+  lookaheadMs?: number
+  // The overlay snaps to the true position once no move arrived for this long
+  settleMs?: number
+  // Gains of the alpha-beta filter, higher values follow measurements more closely
+  alpha?: number
+  beta?: number
+}
+
+/**
+ * Alpha-beta filter over the position of the target, extrapolates it during
+ * drags. Size is never extrapolated, resizing restarts the filter.
+ */
+export class MotionPredictor {
+  lookaheadMs: number
+  settleMs: number
+  alpha: number
+  beta: number
+
+  private x = 0
+  private y = 0
+  // px per ms
+  private vx = 0
+  private vy = 0
+  private width = 0
+  private height = 0
+  // native timestamp of the latest sample, -1 when not moving
+  private lastTimestamp = -1
+  // `performance.now()` when the latest sample was received
+  private lastSampleAt = 0
+
+  constructor (options: MotionPredictionOptions = {}) {
+    this.lookaheadMs = options.lookaheadMs ?? 40
+    this.settleMs = options.settleMs ?? 60
+    this.alpha = options.alpha ?? 0.85
+    this.beta = options.beta ?? 0.3
+  }
+
+  reset () {
+    this.lastTimestamp = -1
+  }
+
+  /** `timestamp` of the native event, `now` is `performance.now()` when it was received */
+  update (bounds: Rectangle, timestamp: number, now: number) {
+    const dt = timestamp - this.lastTimestamp
+    if (
+      this.lastTimestamp < 0 ||
+      dt > this.settleMs ||
+      bounds.width !== this.width ||
+      bounds.height !== this.height
+    ) {
+      this.x = bounds.x
+      this.y = bounds.y
+      this.vx = 0
+      this.vy = 0
+      this.width = bounds.width
+      this.height = bounds.height
+    } else {
+      // timestamps have 1ms resolution, samples can share one
+      const step = Math.max(dt, 1)
+      const rx = bounds.x - (this.x + this.vx * step)
+      const ry = bounds.y - (this.y + this.vy * step)
+      this.x += this.vx * step + this.alpha * rx
+      this.y += this.vy * step + this.alpha * ry
+      this.vx += this.beta * rx / step
+      this.vy += this.beta * ry / step
+    }
+    this.lastTimestamp = timestamp
+    this.lastSampleAt = now
+  }
+
+  isSettled (now: number) {
+    return this.lastTimestamp < 0 || now - this.lastSampleAt >= this.settleMs
+  }
+
+  /** Bounds extrapolated to `now + lookaheadMs`, or `bounds` once settled */
+  predict (bounds: Rectangle, now: number): Rectangle {
+    if (this.isSettled(now)) return bounds
+    const ahead = now - this.lastSampleAt + this.lookaheadMs
+    return {
+      x: Math.round(this.x + this.vx * ahead),
+      y: Math.round(this.y + this.vy * ahead),
+      width: bounds.width,
+      height: bounds.height
+    }
+  }
 }
 
 const isMac = process.platform === 'darwin'
@@ -79,41 +410,55 @@ class OverlayControllerGlobal {
   // The height of a title bar on a standard window. Only measured on Mac
   private macTitleBarHeight = 0
   private attachOptions: AttachOptions = {}
+  private stateBuffer = new Int32Array(8)
+  private eventRecords = new Int32Array(EVENT_RECORD_LENGTH * 64)
+  // reused for every move/resize handled by the controller, listeners get a copy
+  private moveresizeEvent: MoveresizeEvent = { x: 0, y: 0, width: 0, height: 0, timestamp: 0, targetId: 0 }
+  // earliest dispatched event with bounds not yet applied to the overlay
+  private boundsDispatchedAt = 0
+  private boundsEventType = EventType.EVENT_ATTACH
+  // Set with `predictMotion`, its options can be tuned at runtime
+  motionPredictor?: MotionPredictor
+  private settleTimer?: NodeJS.Timeout
+  // overlay bounds and stacking are managed by the native hook
+  private isFollowedNatively = false
+  private dispatchMoveresize = throttle(34 /* 30fps */, this.updateOverlayBounds.bind(this))
 
   readonly events = new EventEmitter()
 
   constructor () {
+    // events of `extraTargetsOnLinux` are left to the app
     this.events.on('attach', (e: AttachEvent) => {
+      if (e.targetId !== 0) return
       this.targetHasFocus = true
       if (this.electronWindow) {
         this.electronWindow.setIgnoreMouseEvents(true)
         this.electronWindow.showInactive()
-        this.electronWindow.setAlwaysOnTop(true, 'screen-saver')
+        if (!this.isFollowedNatively) {
+          this.electronWindow.setAlwaysOnTop(true, 'screen-saver')
+        }
       }
       if (e.isFullscreen !== undefined) {
         this.handleFullscreen(e.isFullscreen)
       }
       this.targetBounds = e
+      this.motionPredictor?.reset()
       this.updateOverlayBounds()
     })
 
     this.events.on('fullscreen', (e: FullscreenEvent) => {
+      if (e.targetId !== 0) return
       this.handleFullscreen(e.isFullscreen)
     })
 
-    this.events.on('detach', () => {
+    this.events.on('detach', (e: NativeEvent) => {
+      if (e.targetId !== 0) return
       this.targetHasFocus = false
       this.electronWindow?.hide()
     })
 
-    const dispatchMoveresize = throttle(34 /* 30fps */, this.updateOverlayBounds.bind(this))
-
-    this.events.on('moveresize', (e: MoveresizeEvent) => {
-      this.targetBounds = e
-      dispatchMoveresize()
-    })
-
-    this.events.on('blur', () => {
+    this.events.on('blur', (e: NativeEvent) => {
+      if (e.targetId !== 0) return
       this.targetHasFocus = false
 
       if (this.electronWindow && (isMac ||
@@ -123,7 +468,8 @@ class OverlayControllerGlobal {
       }
     })
 
-    this.events.on('focus', () => {
+    this.events.on('focus', (e: NativeEvent) => {
+      if (e.targetId !== 0) return
       this.focusNext = undefined
       this.targetHasFocus = true
 
@@ -131,12 +477,24 @@ class OverlayControllerGlobal {
         this.electronWindow.setIgnoreMouseEvents(true)
         if (!this.electronWindow.isVisible()) {
           this.electronWindow.showInactive()
-          this.electronWindow.setAlwaysOnTop(true, 'screen-saver')
+          if (!this.isFollowedNatively) {
+            this.electronWindow.setAlwaysOnTop(true, 'screen-saver')
+          }
         }
       }
     })
   }
 
+  // move/resize are coalesced natively
+  private handleMoveresize (e: MoveresizeEvent) {
+    this.targetBounds = { x: e.x, y: e.y, width: e.width, height: e.height }
+    if (this.motionPredictor) {
+      this.motionPredictor.update(e, e.timestamp, performance.now())
+      this.scheduleSettle()
+    }
+    this.dispatchMoveresize()
+  }
+
   private async handleFullscreen(isFullscreen: boolean) {
     if (!this.electronWindow) return
 
@@ -156,13 +514,36 @@ class OverlayControllerGlobal {
     }
   }
 
+  // Puts the overlay at the true position once the target stops moving
+  private scheduleSettle () {
+    if (this.settleTimer) {
+      this.settleTimer.refresh()
+      return
+    }
+    this.settleTimer = setTimeout(() => {
+      this.settleTimer = undefined
+      if (this.motionPredictor?.isSettled(performance.now()) === false) {
+        this.scheduleSettle()
+        return
+      }
+      this.motionPredictor?.reset()
+      this.updateOverlayBounds()
+    }, this.motionPredictor!.settleMs)
+  }
+
   private updateOverlayBounds () {
-    let lastBounds = this.adjustBoundsForMacTitleBar(this.targetBounds)
+    const dispatchedAt = this.boundsDispatchedAt
+    this.boundsDispatchedAt = 0
+    if (this.isFollowedNatively) return
+    const targetBounds = this.motionPredictor
+      ? this.motionPredictor.predict(this.targetBounds, performance.now())
+      : this.targetBounds
+    let lastBounds = this.adjustBoundsForMacTitleBar(targetBounds)
     if (lastBounds.width === 0 || lastBounds.height === 0) return
     if (!this.electronWindow) return
 
     if (process.platform === 'win32') {
-      lastBounds = screen.screenToDipRect(this.electronWindow, this.targetBounds)
+      lastBounds = screen.screenToDipRect(this.electronWindow, targetBounds)
     } else if (isLinux) {
       // The `xcb_get_geometry` can receive physical coords under KDE's XWayland.
       // see https://github.com/SnosMe/electron-overlay-window/pull/50
@@ -180,31 +561,80 @@ class OverlayControllerGlobal {
     // if moved to screen with different DPI, 2nd call to setBounds will correctly resize window
     // dipRect must be recalculated as well
     if (process.platform === 'win32') {
-      lastBounds = screen.screenToDipRect(this.electronWindow, this.targetBounds)
+      lastBounds = screen.screenToDipRect(this.electronWindow, targetBounds)
       this.electronWindow.setBounds(lastBounds)
     }
+    if (dispatchedAt !== 0) {
+      lib.recordApplyLatency(this.boundsEventType, performance.now() - dispatchedAt)
+    }
   }
 
-  private handler (e: unknown) {
-    switch ((e as { type: EventType }).type) {
-      case EventType.EVENT_ATTACH:
-        this.events.emit('attach', e)
-        break
-      case EventType.EVENT_FOCUS:
-        this.events.emit('focus', e)
-        break
-      case EventType.EVENT_BLUR:
-        this.events.emit('blur', e)
-        break
-      case EventType.EVENT_DETACH:
-        this.events.emit('detach', e)
-        break
-      case EventType.EVENT_FULLSCREEN:
-        this.events.emit('fullscreen', e)
-        break
-      case EventType.EVENT_MOVERESIZE:
-        this.events.emit('moveresize', e)
-        break
+  // Decodes records written by the native side, only move/resize
+  // events are frequent and the controller handles them without allocating
+  private handler (recordCount: number) {
+    const records = this.eventRecords
+    for (let i = 0; i < recordCount * EVENT_RECORD_LENGTH; i += EVENT_RECORD_LENGTH) {
+      const flags = records[i + 5]
+      const timestamp = records[i + 6] >>> 0
+      const targetId = records[i + 7]
+      const type = records[i] as EventType
+      if (
+        (type === EventType.EVENT_ATTACH || type === EventType.EVENT_MOVERESIZE) &&
+        targetId === 0 && this.boundsDispatchedAt === 0
+      ) {
+        this.boundsDispatchedAt = performance.now()
+        this.boundsEventType = type
+      }
+      switch (type) {
+        case EventType.EVENT_ATTACH:
+          this.events.emit('attach', {
+            hasAccess: (flags & EventRecordFlags.HAS_ACCESS_KNOWN)
+              ? (flags & EventRecordFlags.HAS_ACCESS) !== 0
+              : undefined,
+            isFullscreen: (flags & EventRecordFlags.FULLSCREEN_KNOWN)
+              ? (flags & EventRecordFlags.FULLSCREEN) !== 0
+              : undefined,
+            x: records[i + 1],
+            y: records[i + 2],
+            width: records[i + 3],
+            height: records[i + 4],
+            timestamp,
+            targetId
+          } as AttachEvent)
+          break
+        case EventType.EVENT_FOCUS:
+          this.events.emit('focus', { timestamp, targetId } as NativeEvent)
+          break
+        case EventType.EVENT_BLUR:
+          this.events.emit('blur', { timestamp, targetId } as NativeEvent)
+          break
+        case EventType.EVENT_DETACH:
+          this.events.emit('detach', { timestamp, targetId } as NativeEvent)
+          break
+        case EventType.EVENT_FULLSCREEN:
+          this.events.emit('fullscreen', {
+            isFullscreen: (flags & EventRecordFlags.FULLSCREEN) !== 0,
+            timestamp,
+            targetId
+          } as FullscreenEvent)
+          break
+        case EventType.EVENT_MOVERESIZE: {
+          const e = this.moveresizeEvent
+          e.x = records[i + 1]
+          e.y = records[i + 2]
+          e.width = records[i + 3]
+          e.height = records[i + 4]
+          e.timestamp = timestamp
+          e.targetId = targetId
+          if (targetId === 0) {
+            this.handleMoveresize(e)
+          }
+          if (this.events.listenerCount('moveresize') !== 0) {
+            this.events.emit('moveresize', { ...e })
+          }
+          break
+        }
+      }
     }
   }
 
@@ -262,12 +692,67 @@ class OverlayControllerGlobal {
   }
 
   attachByTitle (electronWindow: BrowserWindow | undefined, targetWindowTitle: string, options: AttachOptions = {}) {
+    this.attach(electronWindow, { title: targetWindowTitle }, options)
+  }
+
+  /**
+   * Same as `attachByTitle`, but the target window can be found by other
+   * criteria. On Mac only exact `title` is supported.
+   *
+   * On Linux every worker or context can attach its own hook, it is
+   * stopped when that environment is torn down. On Windows and Mac one hook
+   * runs per process, attaching from another environment throws while it
+   * is in use.
+   */
+  attach (electronWindow: BrowserWindow | undefined, target: WindowMatcher, options: AttachOptions = {}) {
     if (this.isInitialized) {
       throw new Error('Library can be initialized only once.')
-    } else {
-      this.isInitialized = true
     }
     this.electronWindow = electronWindow
+    this.attachOptions = options
+    const dispatch = options.moveresizeDispatch ?? 'fixed'
+    const fps = options.moveresizeFps ?? 30
+    if (isLinux || dispatch === 'immediate') {
+      this.dispatchMoveresize = this.updateOverlayBounds.bind(this)
+    } else {
+      const hz = (dispatch === 'vsync') ? (screen.getPrimaryDisplay().displayFrequency || 60) : fps
+      this.dispatchMoveresize = throttle(Math.floor(1000 / hz), this.updateOverlayBounds.bind(this))
+    }
+    this.isFollowedNatively = isLinux && options.followTargetOnLinux === true
+    if (options.predictMotion && !this.isFollowedNatively) {
+      this.motionPredictor = new MotionPredictor(
+        options.predictMotion === true ? {} : options.predictMotion)
+    }
+    if (isMac) {
+      this.calculateMacTitleBarHeight()
+    }
+
+    try {
+      lib.start(
+        this.electronWindow?.getNativeWindowHandle(),
+        target,
+        this.handler.bind(this),
+        {
+          trackConfigureNotify: options.trackConfigureNotifyOnLinux,
+          captureComposite: options.captureTargetOnlyOnLinux,
+          moveresizePacing: dispatch,
+          moveresizeFps: fps,
+          followTarget: this.isFollowedNatively,
+          recordTrace: options.recordTraceOnLinux,
+          runOnLoop: options.hookOnEventLoopOnLinux,
+          extraTargets: options.extraTargetsOnLinux?.map(({ target, overlayWindow }) => ({
+            target,
+            overlayWindowId: overlayWindow?.getNativeWindowHandle()
+          })),
+          eventBuffer: this.eventRecords
+        })
+    } catch (err) {
+      // `attach` can be retried once `start` throws
+      this.electronWindow = undefined
+      this.motionPredictor = undefined
+      throw err
+    }
+    this.isInitialized = true
 
     this.electronWindow?.on('blur', () => {
       if (!this.targetHasFocus && this.focusNext !== 'target') {
@@ -278,24 +763,177 @@ class OverlayControllerGlobal {
     this.electronWindow?.on('focus', () => {
       this.focusNext = undefined
     })
+  }
 
-    this.attachOptions = options
+  /**
+   * Reads the latest state of the target directly from the native side,
+   * without waiting for queued events to be delivered. Never blocks.
+   * Only the target passed to `attach` is tracked, not `extraTargetsOnLinux`
+   */
+  getTargetState (): TargetState {
+    const state = this.stateBuffer
+    lib.getTargetState(state)
+    return {
+      generation: state[0] >>> 0,
+      isAttached: (state[1] & TargetStateFlags.ATTACHED) !== 0,
+      hasFocus: (state[1] & TargetStateFlags.FOCUSED) !== 0,
+      isFullscreen: (state[1] & TargetStateFlags.FULLSCREEN) !== 0,
+      windowId: (state[7] >>> 0) * 0x100000000 + (state[6] >>> 0),
+      bounds: {
+        x: state[2],
+        y: state[3],
+        width: state[4],
+        height: state[5]
+      }
+    }
+  }
+
+  /**
+   * Timings measured by the native backend. Startup and attach timings
+   * are currently only measured on X11
+   */
+  getMetrics (): Metrics {
+    return lib.getMetrics()
+  }
+
+  /** Clears latency histograms, e.g. before measuring a scenario */
+  resetLatency () {
+    lib.resetLatency()
+  }
+
+  /**
+   * Top-level windows managed by the window manager, useful to find
+   * criteria for `attach`. Linux only
+   */
+  listWindows (): WindowInfo[] {
+    if (!isLinux) {
+      throw new Error('Not implemented on your platform.')
+    }
+    return lib.listWindows()
+  }
+
+  // buffer suitable for use in `nativeImage.createFromBitmap` if `format` is 'bgra'
+  screenshot (options?: ImageOptions): Buffer {
     if (isMac) {
-      this.calculateMacTitleBarHeight()
+      throw new Error('Not implemented on your platform.')
+    }
+    return lib.screenshot(options)
+  }
+
+  /**
+   * Captures on a background thread. Pass the buffer from a previous
+   * result to reuse it, rejects with `RangeError` if the target grew
+   * larger than the buffer
+   */
+  screenshotAsync (into?: Buffer, options?: ScreenshotOptions): Promise<Screenshot> {
+    if (isMac) {
+      return Promise.reject(new Error('Not implemented on your platform.'))
+    }
+    return lib.screenshotAsync(into, options)
+  }
+
+  /**
+   * Encodes a BGRA image (e.g. from `readFrame`) on a background thread.
+   * `image` must not be modified until the promise settles
+   */
+  encodeImage (image: Buffer, width: number, height: number, encoding: ImageEncoding): Promise<Buffer> {
+    return lib.encodeImage(image, width, height, { encoding })
+  }
+
+  /**
+   * Starts capturing the target on a background thread whenever it redraws.
+   * Use `readFrame` to get the latest frame. Linux only
+   */
+  startCaptureStream (options: CaptureStreamOptions = {}) {
+    if (!isLinux) {
+      throw new Error('Not implemented on your platform.')
+    }
+    lib.startCaptureStream(
+      { maxFps: options.maxFps, pollIntervalMs: options.pollIntervalMs },
+      options.onFrame)
+  }
+
+  stopCaptureStream () {
+    if (!isLinux) return
+    lib.stopCaptureStream()
+  }
+
+  /**
+   * Copies the latest frame of the capture stream into `into` (BGRA by default).
+   * Returns `null` if there is no frame newer than the one read last time
+   */
+  readFrame (into: Buffer, options?: ImageOptions): FrameInfo | null {
+    if (!isLinux) {
+      throw new Error('Not implemented on your platform.')
     }
+    return lib.readFrame(into, options)
+  }
+}
+
+/**
+ * Finds the parts of an image that changed since the previous call by
+ * comparing hashes of square tiles. Use one detector per image source
+ */
+export class ChangeDetector {
+  private readonly detector: unknown
 
-    lib.start(
-      this.electronWindow?.getNativeWindowHandle(),
-      targetWindowTitle,
-      this.handler.bind(this))
+  constructor (tileSize = 32) {
+    this.detector = lib.createChangeDetector(tileSize)
   }
 
-  // buffer suitable for use in `nativeImage.createFromBitmap`
-  screenshot (): Buffer {
-    if (process.platform !== 'win32') {
+  // Everything is reported as changed on the first call or when the size changes
+  update (image: Buffer, width: number, height: number, bytesPerPixel = 4): ChangeResult {
+    return lib.detectChanges(this.detector, image, width, height, bytesPerPixel)
+  }
+}
+
+// Layout of one region in `ProbeSet.read` results, all values are 0..255
+// except `COUNT` and histogram bins. Histograms have 16 bins of `value >> 4`
+export enum ProbeStat {
+  // Pixels inside the target, 0 if the region is outside of it
+  COUNT = 0,
+  MEAN_R = 1,
+  MEAN_G = 2,
+  MEAN_B = 3,
+  MIN_R = 4,
+  MIN_G = 5,
+  MIN_B = 6,
+  MAX_R = 7,
+  MAX_G = 8,
+  MAX_B = 9,
+  HISTOGRAM_R = 10,
+  HISTOGRAM_G = 26,
+  HISTOGRAM_B = 42,
+  LENGTH = 58,
+}
+
+/**
+ * Color statistics of points and small rectangles relative to the target's
+ * content area. Only the areas around the regions are captured
+ */
+export class ProbeSet {
+  private readonly probeSet: unknown
+  readonly count: number
+
+  constructor (regions: Array<Rectangle | { x: number, y: number }>) {
+    const values = new Int32Array(regions.length * 4)
+    regions.forEach((region, i) => {
+      values[i * 4] = region.x
+      values[i * 4 + 1] = region.y
+      values[i * 4 + 2] = ('width' in region) ? region.width : 1
+      values[i * 4 + 3] = ('height' in region) ? region.height : 1
+    })
+    this.probeSet = lib.createProbeSet(values)
+    this.count = regions.length
+  }
+
+  // Result of region `i` starts at `i * ProbeStat.LENGTH`
+  read (out = new Uint32Array(this.count * ProbeStat.LENGTH)): Uint32Array {
+    if (isMac) {
       throw new Error('Not implemented on your platform.')
     }
-    return lib.screenshot()
+    lib.readProbes(this.probeSet, out)
+    return out
   }
 }
 
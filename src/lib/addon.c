@@ -4,22 +4,82 @@
 #include <node_api.h>
 #include "napi_helpers.h"
 #include "overlay_window.h"
+#include "event_queue.h"
+#include "frame_damage.h"
+#include "image_encode.h"
+#include "matcher.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "pixel_ops.h"
+#include "probe_set.h"
+#include "target_state.h"
+#include "tile_hash.h"
 
-static napi_threadsafe_function threadsafe_fn = NULL;
-static struct ow_window_bounds last_reported_bounds = {0, 0, 0, 0};
+// [generation, flags, x, y, width, height, window_id_lo, window_id_hi]
+#define OW_TARGET_STATE_LENGTH 8
 
-void ow_emit_event(struct ow_event* event) {
-  if (threadsafe_fn == NULL) return;
+// [type, x, y, width, height, flags, timestamp_ms, target_id]
+#define OW_EVENT_RECORD_LENGTH 8
 
-  struct ow_event* copied_event = malloc(sizeof(struct ow_event));
-  memcpy(copied_event, event, sizeof(struct ow_event));
+enum ow_event_record_flags {
+  OW_RECORD_HAS_ACCESS = 1 << 0,
+  OW_RECORD_HAS_ACCESS_KNOWN = 1 << 1,
+  OW_RECORD_FULLSCREEN = 1 << 2,
+  OW_RECORD_FULLSCREEN_KNOWN = 1 << 3,
+};
 
-  napi_status status = napi_call_threadsafe_function(threadsafe_fn, copied_event, napi_tsfn_nonblocking);
-  if (status == napi_closing) {
-    threadsafe_fn = NULL;
-    free(copied_event);
+// State of one Node.js environment using the addon (main thread, worker
+// or another context), stored with `napi_set_instance_data`.
+struct ow_addon_instance {
+  napi_env env;
+  // hook started by this environment, NULL when not started
+  struct ow_hook* hook;
+  struct ow_event_queue event_queue;
+  struct ow_target_state_block target_state;
+  // `uv_hrtime()` when the hook was started, event timestamps are relative to it
+  uint64_t events_start_ns;
+  napi_threadsafe_function threadsafe_fn;
+  // Set when the hook runs on this environment's loop (X11 only), events are
+  // delivered in `ow_emit_burst_end` instead of through `threadsafe_fn`.
+  napi_env hook_env;
+  napi_ref hook_callback_ref;
+  napi_ref hook_resource_ref;
+  napi_async_context hook_async_context;
+  // Int32Array the events are written to, NULL if delivered as objects
+  napi_ref event_records_ref;
+  napi_threadsafe_function frame_tsfn;
+  // Frames captured before JS handled the previous callback are
+  // delivered as one callback with the combined damage.
+  uv_mutex_t frame_lock;
+  bool is_stream_started;
+  struct ow_frame_event pending_frame;
+  bool has_pending_frame;
+  // timings and latencies of hooks started by this environment
+  struct ow_metrics metrics;
+};
+
+// Called on the hook thread, `context` is the instance that started the hook.
+void ow_emit_event(void* context, struct ow_event* event) {
+  struct ow_addon_instance* instance = context;
+
+  event->enqueue_ns = uv_hrtime();
+  if (event->receive_ns != 0) {
+    ow_metrics_record_latency(&instance->metrics, OW_LATENCY_HOOK, event->type, event->enqueue_ns - event->receive_ns);
+  }
+  if (event->target_id == 0) {
+    ow_target_state_apply(&instance->target_state, event);
+  }
+
+  if (
+    !ow_event_queue_push(&instance->event_queue, event) ||
+    instance->threadsafe_fn == NULL
+  ) {
+    // the consumer is already scheduled or runs on this thread
     return;
   }
+
+  napi_status status = napi_call_threadsafe_function(instance->threadsafe_fn, NULL, napi_tsfn_nonblocking);
+  if (status == napi_closing) return;
   NAPI_FATAL_IF_FAILED(status, "ow_emit_event", "napi_call_threadsafe_function");
 }
 
@@ -30,6 +90,12 @@ napi_value ow_event_to_js_object(napi_env env, struct ow_event* event) {
   status = napi_create_object(env, &event_obj);
   NAPI_FATAL_IF_FAILED(status, "ow_event_to_js_object", "napi_create_object");
 
+  napi_value e_target_id;
+  status = napi_create_uint32(env, event->target_id, &e_target_id);
+  NAPI_FATAL_IF_FAILED(status, "ow_event_to_js_object", "napi_create_uint32");
+  status = napi_set_named_property(env, event_obj, "targetId", e_target_id);
+  NAPI_FATAL_IF_FAILED(status, "ow_event_to_js_object", "napi_set_named_property");
+
   napi_value e_type;
   status = napi_create_uint32(env, event->type, &e_type);
   NAPI_FATAL_IF_FAILED(status, "ow_event_to_js_object", "napi_create_uint32");
@@ -135,36 +201,610 @@ napi_value ow_event_to_js_object(napi_env env, struct ow_event* event) {
   }
 }
 
-void tsfn_to_js_proxy(napi_env env, napi_value js_callback, void* context, void* _event) {
-  struct ow_event* event = (struct ow_event*)_event;
-  if (event->type == OW_MOVERESIZE) {
-    last_reported_bounds = event->data.moveresize.bounds;
-  } else if (event->type == OW_ATTACH) {
-    last_reported_bounds = event->data.attach.bounds;
+static void ow_event_to_record(struct ow_event* event, uint64_t events_start_ns, int32_t* record) {
+  memset(record, 0, sizeof(int32_t) * OW_EVENT_RECORD_LENGTH);
+  record[0] = event->type;
+  // when the hook observed the event, move/resize can be queued later by pacing
+  uint64_t event_ns = (event->receive_ns != 0) ? event->receive_ns : event->enqueue_ns;
+  record[6] = (event_ns > events_start_ns) ? (int32_t)(uint32_t)((event_ns - events_start_ns) / 1000000) : 0;
+  record[7] = (int32_t)event->target_id;
+
+  const struct ow_window_bounds* bounds = NULL;
+  if (event->type == OW_ATTACH) {
+    bounds = &event->data.attach.bounds;
+    if (event->data.attach.has_access != -1) {
+      record[5] |= OW_RECORD_HAS_ACCESS_KNOWN;
+      if (event->data.attach.has_access == 1) record[5] |= OW_RECORD_HAS_ACCESS;
+    }
+    if (event->data.attach.is_fullscreen != -1) {
+      record[5] |= OW_RECORD_FULLSCREEN_KNOWN;
+      if (event->data.attach.is_fullscreen == 1) record[5] |= OW_RECORD_FULLSCREEN;
+    }
+  } else if (event->type == OW_FULLSCREEN) {
+    record[5] = OW_RECORD_FULLSCREEN_KNOWN;
+    if (event->data.fullscreen.is_fullscreen) record[5] |= OW_RECORD_FULLSCREEN;
+  } else if (event->type == OW_MOVERESIZE) {
+    bounds = &event->data.moveresize.bounds;
   }
+  if (bounds != NULL) {
+    record[1] = bounds->x;
+    record[2] = bounds->y;
+    record[3] = (int32_t)bounds->width;
+    record[4] = (int32_t)bounds->height;
+  }
+}
+
+static void call_with_record_count(napi_env env, napi_value global, napi_value js_callback, uint32_t count) {
+  napi_status status;
 
+  napi_value js_count;
+  status = napi_create_uint32(env, count, &js_count);
+  NAPI_FATAL_IF_FAILED(status, "call_with_record_count", "napi_create_uint32");
+
+  status = napi_call_function(env, global, js_callback, 1, &js_count, NULL);
+  NAPI_FATAL_IF_FAILED(status, "call_with_record_count", "napi_call_function");
+}
+
+// Writes queued events into the records array and calls JS once per drain,
+// or again each time the array is full.
+static void drain_to_records(napi_env env, struct ow_addon_instance* instance, napi_value global, napi_value js_callback) {
   napi_status status;
 
-  napi_value event_obj = ow_event_to_js_object(env, event);
+  napi_value records;
+  status = napi_get_reference_value(env, instance->event_records_ref, &records);
+  NAPI_FATAL_IF_FAILED(status, "drain_to_records", "napi_get_reference_value");
+
+  size_t length;
+  void* data;
+  status = napi_get_typedarray_info(env, records, NULL, &length, &data, NULL, NULL);
+  NAPI_FATAL_IF_FAILED(status, "drain_to_records", "napi_get_typedarray_info");
+  uint32_t capacity = (uint32_t)(length / OW_EVENT_RECORD_LENGTH);
+
+  uint64_t dispatch_ns = uv_hrtime();
+  uint32_t count = 0;
+  struct ow_event event;
+  while (ow_event_queue_pop(&instance->event_queue, &event)) {
+    ow_metrics_record_latency(&instance->metrics, OW_LATENCY_QUEUE, event.type, dispatch_ns - event.enqueue_ns);
+    if (count == capacity) {
+      call_with_record_count(env, global, js_callback, count);
+      count = 0;
+    }
+    ow_event_to_record(&event, instance->events_start_ns, (int32_t*)data + (size_t)count * OW_EVENT_RECORD_LENGTH);
+    count += 1;
+  }
+  if (count != 0) {
+    call_with_record_count(env, global, js_callback, count);
+  }
+}
+
+void tsfn_to_js_proxy(napi_env env, napi_value js_callback, void* context, void* _data) {
+  if (env == NULL) return;
+
+  struct ow_addon_instance* instance = context;
+  napi_status status;
 
   napi_value global;
   status = napi_get_global(env, &global);
   NAPI_FATAL_IF_FAILED(status, "tsfn_to_js_proxy", "napi_get_global");
 
-  status = napi_call_function(env, global, js_callback, 1, &event_obj, NULL);
-  NAPI_FATAL_IF_FAILED(status, "tsfn_to_js_proxy", "napi_call_function");
+  ow_event_queue_begin_drain(&instance->event_queue);
+
+  if (instance->event_records_ref != NULL) {
+    drain_to_records(env, instance, global, js_callback);
+    return;
+  }
+
+  uint64_t dispatch_ns = uv_hrtime();
+  struct ow_event event;
+  while (ow_event_queue_pop(&instance->event_queue, &event)) {
+    ow_metrics_record_latency(&instance->metrics, OW_LATENCY_QUEUE, event.type, dispatch_ns - event.enqueue_ns);
+    napi_value event_obj = ow_event_to_js_object(env, &event);
+
+    status = napi_call_function(env, global, js_callback, 1, &event_obj, NULL);
+    NAPI_FATAL_IF_FAILED(status, "tsfn_to_js_proxy", "napi_call_function");
+  }
+}
+
+// Hook runs on this thread, queued events are delivered directly.
+void ow_emit_burst_end(void* context) {
+  struct ow_addon_instance* instance = context;
+  if (instance->hook_env == NULL || !instance->event_queue.wakeup_pending) return;
+
+  napi_env env = instance->hook_env;
+  napi_status status;
+
+  napi_handle_scope handle_scope;
+  status = napi_open_handle_scope(env, &handle_scope);
+  NAPI_FATAL_IF_FAILED(status, "ow_emit_burst_end", "napi_open_handle_scope");
+
+  napi_value resource;
+  status = napi_get_reference_value(env, instance->hook_resource_ref, &resource);
+  NAPI_FATAL_IF_FAILED(status, "ow_emit_burst_end", "napi_get_reference_value");
+  napi_value js_callback;
+  status = napi_get_reference_value(env, instance->hook_callback_ref, &js_callback);
+  NAPI_FATAL_IF_FAILED(status, "ow_emit_burst_end", "napi_get_reference_value");
+
+  // runs microtasks queued by the callback when closed, as with `threadsafe_fn`
+  napi_callback_scope callback_scope;
+  status = napi_open_callback_scope(env, resource, instance->hook_async_context, &callback_scope);
+  NAPI_FATAL_IF_FAILED(status, "ow_emit_burst_end", "napi_open_callback_scope");
+
+  tsfn_to_js_proxy(env, js_callback, instance, NULL);
+
+  status = napi_close_callback_scope(env, callback_scope);
+  NAPI_FATAL_IF_FAILED(status, "ow_emit_burst_end", "napi_close_callback_scope");
+  status = napi_close_handle_scope(env, handle_scope);
+  NAPI_FATAL_IF_FAILED(status, "ow_emit_burst_end", "napi_close_handle_scope");
+}
+
+// Sets `value` to NULL if the option is not specified.
+static napi_status get_option(napi_env env, napi_value options, const char* name, napi_value* value) {
+  napi_status status;
+  *value = NULL;
+
+  napi_valuetype options_type;
+  status = napi_typeof(env, options, &options_type);
+  if (status != napi_ok || options_type != napi_object) return status;
+
+  bool has_option;
+  status = napi_has_named_property(env, options, name, &has_option);
+  if (status != napi_ok || !has_option) return status;
+
+  napi_value option;
+  status = napi_get_named_property(env, options, name, &option);
+  if (status != napi_ok) return status;
+
+  napi_valuetype option_type;
+  status = napi_typeof(env, option, &option_type);
+  if (status != napi_ok) return status;
+
+  if (option_type != napi_undefined && option_type != napi_null) {
+    *value = option;
+  }
+  return napi_ok;
+}
+
+static napi_status get_bool_option(napi_env env, napi_value options, const char* name, bool* result) {
+  napi_value value;
+  napi_status status = get_option(env, options, name, &value);
+  if (status != napi_ok || value == NULL) return status;
+  return napi_get_value_bool(env, value, result);
+}
+
+static napi_status get_uint32_option(napi_env env, napi_value options, const char* name, uint32_t* result) {
+  napi_value value;
+  napi_status status = get_option(env, options, name, &value);
+  if (status != napi_ok || value == NULL) return status;
+  return napi_get_value_uint32(env, value, result);
+}
+
+static napi_status get_int32_option(napi_env env, napi_value options, const char* name, int32_t* result) {
+  napi_value value;
+  napi_status status = get_option(env, options, name, &value);
+  if (status != napi_ok || value == NULL) return status;
+  return napi_get_value_int32(env, value, result);
+}
+
+// Result must be freed by caller.
+static napi_status get_string_value(napi_env env, napi_value value, char** result) {
+  napi_status status;
+
+  size_t length;
+  status = napi_get_value_string_utf8(env, value, NULL, 0, &length);
+  if (status != napi_ok) return status;
+  *result = malloc(sizeof(char) * length + 1);
+  status = napi_get_value_string_utf8(env, value, *result, length + 1, NULL);
+  if (status != napi_ok) {
+    free(*result);
+    *result = NULL;
+  }
+  return status;
+}
+
+// Result must be freed by caller, NULL if the option is not specified.
+static napi_status get_string_option(napi_env env, napi_value options, const char* name, char** result) {
+  napi_value value;
+  napi_status status = get_option(env, options, name, &value);
+  *result = NULL;
+  if (status != napi_ok || value == NULL) return status;
+  return get_string_value(env, value, result);
+}
+
+// Accepts exact title as a string or an object with criteria.
+static napi_value matcher_from_js_value(napi_env env, napi_value value, struct ow_matcher* matcher) {
+  napi_status status;
+  memset(matcher, 0, sizeof(struct ow_matcher));
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, value, &value_type);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (value_type == napi_string) {
+    matcher->title_mode = OW_TITLE_EXACT;
+    status = get_string_value(env, value, &matcher->title);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  } else {
+    struct {
+      const char* name;
+      enum ow_title_match_mode mode;
+    } title_options[] = {
+      { "title", OW_TITLE_EXACT },
+      { "titlePrefix", OW_TITLE_PREFIX },
+      { "titleSuffix", OW_TITLE_SUFFIX },
+      { "titleRegex", OW_TITLE_REGEX },
+    };
+    for (size_t i = 0; i < sizeof(title_options) / sizeof(title_options[0]); ++i) {
+      char* title;
+      status = get_string_option(env, value, title_options[i].name, &title);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+      if (title == NULL) continue;
+      if (matcher->title != NULL) {
+        free(title);
+        NAPI_THROW(env, NULL, "Only one of title, titlePrefix, titleSuffix, titleRegex can be specified", NULL);
+      }
+      matcher->title = title;
+      matcher->title_mode = title_options[i].mode;
+    }
+
+    status = get_string_option(env, value, "wmClass", &matcher->wm_class);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    status = get_uint32_option(env, value, "pid", &matcher->pid);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    status = get_string_option(env, value, "exeName", &matcher->exe_name);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+
+  const char* error = ow_matcher_compile(matcher);
+  if (error != NULL) {
+    NAPI_THROW(env, NULL, error, NULL);
+  }
+  return NULL;
+}
+
+// Accepts `{ crop, width, height, filter, format }`, everything is optional.
+static napi_value image_options_from_js_value(napi_env env, napi_value value, struct ow_pixel_transform* transform) {
+  napi_status status;
+  memset(transform, 0, sizeof(struct ow_pixel_transform));
+  if (value == NULL) return NULL;
+
+  napi_value crop;
+  status = get_option(env, value, "crop", &crop);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (crop != NULL) {
+    status = get_int32_option(env, crop, "x", &transform->crop.x);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    status = get_int32_option(env, crop, "y", &transform->crop.y);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    status = get_uint32_option(env, crop, "width", &transform->crop.width);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    status = get_uint32_option(env, crop, "height", &transform->crop.height);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    if (transform->crop.width == 0 || transform->crop.height == 0) {
+      NAPI_THROW(env, NULL, "Crop region must not be empty", NULL);
+    }
+  }
+
+  status = get_uint32_option(env, value, "width", &transform->width);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  status = get_uint32_option(env, value, "height", &transform->height);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  char* filter;
+  status = get_string_option(env, value, "filter", &filter);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (filter != NULL) {
+    bool is_valid = true;
+    if (strcmp(filter, "box") == 0) {
+      transform->filter = OW_SCALE_BOX;
+    } else if (strcmp(filter, "bilinear") == 0) {
+      transform->filter = OW_SCALE_BILINEAR;
+    } else {
+      is_valid = false;
+    }
+    free(filter);
+    if (!is_valid) {
+      NAPI_THROW(env, NULL, "Unknown filter, expected box or bilinear", NULL);
+    }
+  }
+
+  char* format;
+  status = get_string_option(env, value, "format", &format);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (format != NULL) {
+    static const char* format_names[OW_PIXEL_FORMAT_COUNT] = { "bgra", "rgba", "rgb", "gray" };
+    int found = -1;
+    for (int i = 0; i < OW_PIXEL_FORMAT_COUNT; ++i) {
+      if (strcmp(format, format_names[i]) == 0) found = i;
+    }
+    free(format);
+    if (found < 0) {
+      NAPI_THROW(env, NULL, "Unknown format, expected bgra, rgba, rgb or gray", NULL);
+    }
+    transform->format = (enum ow_pixel_format)found;
+  }
+  return NULL;
+}
+
+// Sets `has_encoding` to false if the option is not specified.
+static napi_value encoding_option(napi_env env, napi_value options, enum ow_image_encoding* encoding, bool* has_encoding) {
+  napi_status status;
+  *has_encoding = false;
+  if (options == NULL) return NULL;
+
+  char* name;
+  status = get_string_option(env, options, "encoding", &name);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (name == NULL) return NULL;
+
+  bool is_valid = true;
+  if (strcmp(name, "png") == 0) {
+    *encoding = OW_ENCODING_PNG;
+  } else if (strcmp(name, "qoi") == 0) {
+    *encoding = OW_ENCODING_QOI;
+  } else {
+    is_valid = false;
+  }
+  free(name);
+  if (!is_valid) {
+    NAPI_THROW(env, NULL, "Unknown encoding, expected png or qoi", NULL);
+  }
+  *has_encoding = true;
+  return NULL;
+}
+
+// Same as `ow_pixel_transform_resolve`, but there is nothing
+// to crop when the target is not attached.
+static bool resolve_capture_transform(const struct ow_pixel_transform* transform, uint32_t width, uint32_t height, struct ow_pixel_transform* resolved) {
+  if (width == 0 || height == 0) {
+    memset(resolved, 0, sizeof(struct ow_pixel_transform));
+    resolved->format = transform->format;
+    return true;
+  }
+  return ow_pixel_transform_resolve(transform, width, height, resolved);
+}
+
+#if defined(_WIN32) || defined(__linux__)
+// `out` must fit the resolved size.
+static void screenshot_transformed(struct ow_hook* hook, const struct ow_pixel_transform* resolved, uint32_t width, uint32_t height, uint8_t* out) {
+  if (ow_pixel_transform_is_identity(resolved, width, height)) {
+    ow_screenshot(hook, out, width, height);
+    return;
+  }
+  uint8_t* captured = malloc((size_t)width * height * 4);
+  if (captured == NULL) return;
+  ow_screenshot(hook, captured, width, height);
+  ow_pixel_transform_apply(resolved, captured, (size_t)width * 4, out);
+  free(captured);
+}
+#endif
+
+#ifdef __linux__
+// `value` is an array of `{ target, overlayWindowId }`. Window IDs point
+// into JS buffers, they are read by `ow_start_hook` before it returns.
+// Matchers are counted in `extra_target_count` as soon as they are
+// allocated, so they are freed with the options if this throws.
+static napi_value extra_targets_from_js_value(napi_env env, napi_value value, struct ow_hook_options* options) {
+  napi_status status;
 
-  free(event);
+  bool is_array;
+  status = napi_is_array(env, value, &is_array);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (!is_array) {
+    NAPI_THROW(env, NULL, "extraTargets must be an array", NULL);
+  }
+  uint32_t length;
+  status = napi_get_array_length(env, value, &length);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (length > OW_MAX_TARGETS - 1) {
+    NAPI_THROW(env, NULL, "Too many extraTargets", NULL);
+  }
+
+  options->extra_targets = calloc(length ? length : 1, sizeof(struct ow_hook_target));
+  for (uint32_t i = 0; i < length; ++i) {
+    napi_value item;
+    status = napi_get_element(env, value, i, &item);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    struct ow_hook_target* target = &options->extra_targets[i];
+
+    napi_value criteria;
+    status = get_option(env, item, "target", &criteria);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    if (criteria == NULL) {
+      NAPI_THROW(env, NULL, "Every one of extraTargets must have a target", NULL);
+    }
+    target->matcher = malloc(sizeof(struct ow_matcher));
+    options->extra_target_count += 1;
+    matcher_from_js_value(env, criteria, target->matcher);
+    bool is_exception_pending;
+    status = napi_is_exception_pending(env, &is_exception_pending);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    if (is_exception_pending) {
+      return NULL;
+    }
+
+    napi_value window_id;
+    status = get_option(env, item, "overlayWindowId", &window_id);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    bool has_window_id = false;
+    if (window_id != NULL) {
+      status = napi_is_buffer(env, window_id, &has_window_id);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+    }
+    if (has_window_id) {
+      status = napi_get_buffer_info(env, window_id, &target->overlay_window_id, NULL);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+    }
+  }
+  return NULL;
+}
+#endif
+
+// Reads everything but the target from the options of `start`,
+// `options` must be freed with `free_hook_args` even if this throws.
+static napi_value hook_options_from_js_value(napi_env env, napi_value value, struct ow_addon_instance* instance, struct ow_hook_options* options) {
+  napi_status status;
+
+  status = get_bool_option(env, value, "trackConfigureNotify", &options->track_configure_notify);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  status = get_bool_option(env, value, "captureComposite", &options->capture_composite);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  char* pacing = NULL;
+  status = get_string_option(env, value, "moveresizePacing", &pacing);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (pacing != NULL) {
+    bool is_valid = true;
+    if (strcmp(pacing, "immediate") == 0) {
+      options->moveresize_pacing = OW_PACING_IMMEDIATE;
+    } else if (strcmp(pacing, "vsync") == 0) {
+      options->moveresize_pacing = OW_PACING_VSYNC;
+    } else if (strcmp(pacing, "fixed") == 0) {
+      options->moveresize_pacing = OW_PACING_FIXED;
+    } else {
+      is_valid = false;
+    }
+    free(pacing);
+    if (!is_valid) {
+      NAPI_THROW(env, NULL, "Unknown moveresizePacing, expected immediate, vsync or fixed", NULL);
+    }
+  }
+  status = get_uint32_option(env, value, "moveresizeFps", &options->moveresize_fps);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  status = get_bool_option(env, value, "followTarget", &options->follow_target);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  status = get_string_option(env, value, "recordTrace", &options->trace_path);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+#ifdef __linux__
+  bool run_on_loop = false;
+  status = get_bool_option(env, value, "runOnLoop", &run_on_loop);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (run_on_loop) {
+    status = napi_get_uv_event_loop(env, &options->loop);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+
+  napi_value extra_targets;
+  status = get_option(env, value, "extraTargets", &extra_targets);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (extra_targets != NULL) {
+    extra_targets_from_js_value(env, extra_targets, options);
+    bool is_exception_pending;
+    status = napi_is_exception_pending(env, &is_exception_pending);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    if (is_exception_pending) {
+      return NULL;
+    }
+  }
+#endif
+
+  // when specified, the callback receives the number of records written into it
+  napi_value event_buffer;
+  status = get_option(env, value, "eventBuffer", &event_buffer);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (event_buffer != NULL) {
+    bool is_typedarray;
+    status = napi_is_typedarray(env, event_buffer, &is_typedarray);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    napi_typedarray_type array_type = napi_uint8_array;
+    size_t length = 0;
+    if (is_typedarray) {
+      status = napi_get_typedarray_info(env, event_buffer, &array_type, &length, NULL, NULL, NULL);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+    }
+    if (array_type != napi_int32_array || length < OW_EVENT_RECORD_LENGTH) {
+      NAPI_THROW(env, NULL, "eventBuffer must be an Int32Array that fits at least one event", NULL);
+    }
+    if (instance->event_records_ref != NULL) {
+      status = napi_delete_reference(env, instance->event_records_ref);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+      instance->event_records_ref = NULL;
+    }
+    status = napi_create_reference(env, event_buffer, 1, &instance->event_records_ref);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+  return NULL;
+}
+
+// Frees what was read for a hook that is not started,
+// `ow_start_hook` takes the matchers, but not the rest.
+static void free_hook_args(struct ow_matcher* matcher, struct ow_hook_options* options, bool has_matchers) {
+  if (has_matchers) {
+    if (matcher != NULL) {
+      ow_matcher_free(matcher);
+      free(matcher);
+    }
+    for (uint32_t i = 0; i < options->extra_target_count; ++i) {
+      ow_matcher_free(options->extra_targets[i].matcher);
+      free(options->extra_targets[i].matcher);
+    }
+  }
+  free(options->extra_targets);
+  free(options->trace_path);
+}
+
+// Releases the event callback, the hook must be stopped.
+static void release_hook_callback(napi_env env, struct ow_addon_instance* instance) {
+  napi_status status;
+
+  if (instance->threadsafe_fn != NULL) {
+    status = napi_release_threadsafe_function(instance->threadsafe_fn, napi_tsfn_abort);
+    NAPI_FATAL_IF_FAILED(status, "release_hook_callback", "napi_release_threadsafe_function");
+    instance->threadsafe_fn = NULL;
+  }
+  if (instance->hook_async_context != NULL) {
+    status = napi_async_destroy(env, instance->hook_async_context);
+    NAPI_FATAL_IF_FAILED(status, "release_hook_callback", "napi_async_destroy");
+    instance->hook_async_context = NULL;
+  }
+  if (instance->hook_callback_ref != NULL) {
+    status = napi_delete_reference(env, instance->hook_callback_ref);
+    NAPI_FATAL_IF_FAILED(status, "release_hook_callback", "napi_delete_reference");
+    instance->hook_callback_ref = NULL;
+  }
+  if (instance->hook_resource_ref != NULL) {
+    status = napi_delete_reference(env, instance->hook_resource_ref);
+    NAPI_FATAL_IF_FAILED(status, "release_hook_callback", "napi_delete_reference");
+    instance->hook_resource_ref = NULL;
+  }
+  instance->hook_env = NULL;
+}
+
+static struct ow_addon_instance* get_instance(napi_env env) {
+  struct ow_addon_instance* instance;
+  napi_status status = napi_get_instance_data(env, (void**)&instance);
+  NAPI_FATAL_IF_FAILED(status, "get_instance", "napi_get_instance_data");
+  return instance;
+}
+
+// Registered after the callback is created, so it runs before the
+// threadsafe function is finalized and the hook is stopped while
+// everything it calls is still there. Also stops the hook on loop
+// of this environment before the loop is closed.
+static void release_hook(void* arg) {
+  struct ow_addon_instance* instance = arg;
+
+  ow_stop_hook(instance->hook);
+  instance->hook = NULL;
+  // target is no longer tracked
+  struct ow_event detach = { .type = OW_DETACH };
+  ow_target_state_apply(&instance->target_state, &detach);
+
+  release_hook_callback(instance->env, instance);
 }
 
 napi_value AddonStart(napi_env env, napi_callback_info info) {
   napi_status status;
+  struct ow_addon_instance* instance = get_instance(env);
 
-  size_t info_argc = 3;
-  napi_value info_argv[3];
+  size_t info_argc = 4;
+  napi_value info_argv[4];
   status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
   NAPI_THROW_IF_FAILED(env, status, NULL);
 
+  if (instance->hook != NULL) {
+    NAPI_THROW(env, NULL, "Overlay hook is already started", NULL);
+  }
+
   // [0] Overlay Window ID
   void* overlay_window_id = NULL;
   bool has_window_id;
@@ -175,84 +815,1363 @@ napi_value AddonStart(napi_env env, napi_callback_info info) {
     NAPI_THROW_IF_FAILED(env, status, NULL);
   }
 
-  // [1] Target Window title
-  size_t target_window_title_length;
-  status = napi_get_value_string_utf8(env, info_argv[1], NULL, 0, &target_window_title_length);
-  NAPI_THROW_IF_FAILED(env, status, NULL);
-  char* target_window_title = malloc(sizeof(char) * target_window_title_length + 1);
-  status = napi_get_value_string_utf8(env, info_argv[1], target_window_title, target_window_title_length + 1, NULL);
-  NAPI_THROW_IF_FAILED(env, status, NULL);
+  // [1] Target Window title or criteria
+  struct ow_matcher* matcher = malloc(sizeof(struct ow_matcher));
+  struct ow_hook_options options = {
+    .track_configure_notify = false,
+    .capture_composite = false,
+    .moveresize_pacing = OW_PACING_IMMEDIATE,
+    .moveresize_fps = 0,
+    .follow_target = false,
+    .trace_path = NULL,
+    .loop = NULL,
+    .extra_targets = NULL,
+    .extra_target_count = 0,
+    .metrics = &instance->metrics
+  };
+  matcher_from_js_value(env, info_argv[1], matcher);
+  bool is_exception_pending;
+  status = napi_is_exception_pending(env, &is_exception_pending);
+
+  // [3] Options
+  if (status == napi_ok && !is_exception_pending && info_argc > 3) {
+    hook_options_from_js_value(env, info_argv[3], instance, &options);
+    status = napi_is_exception_pending(env, &is_exception_pending);
+  }
+  if (status != napi_ok || is_exception_pending) {
+    free_hook_args(matcher, &options, true);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    return NULL;
+  }
 
   // [2] Event callback
+  bool is_on_loop = options.loop != NULL;
   napi_value async_resource_name;
   status = napi_create_string_utf8(env, "OVERLAY_WINDOW", NAPI_AUTO_LENGTH, &async_resource_name);
-  NAPI_THROW_IF_FAILED(env, status, NULL);
-  status = napi_create_threadsafe_function(env, info_argv[2], NULL, async_resource_name, 0, 1, NULL, NULL, NULL, tsfn_to_js_proxy, &threadsafe_fn);
-  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (status == napi_ok && is_on_loop) {
+    napi_value resource;
+    status = napi_create_object(env, &resource);
+    if (status == napi_ok) {
+      status = napi_create_reference(env, resource, 1, &instance->hook_resource_ref);
+    }
+    if (status == napi_ok) {
+      status = napi_async_init(env, resource, async_resource_name, &instance->hook_async_context);
+    }
+    if (status == napi_ok) {
+      status = napi_create_reference(env, info_argv[2], 1, &instance->hook_callback_ref);
+    }
+  } else if (status == napi_ok) {
+    status = napi_create_threadsafe_function(env, info_argv[2], NULL, async_resource_name, 0, 1, NULL, NULL, instance, tsfn_to_js_proxy, &instance->threadsafe_fn);
+  }
+  if (status != napi_ok) {
+    release_hook_callback(env, instance);
+    free_hook_args(matcher, &options, true);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
 
-  // printf("start(window=%x, title=\"%s\")\n", *((int*)overlay_window_id), target_window_title);
-  ow_start_hook(target_window_title, overlay_window_id);
+  ow_event_queue_init(&instance->event_queue);
+  instance->events_start_ns = uv_hrtime();
+  instance->hook_env = is_on_loop ? env : NULL;
+  instance->hook = ow_start_hook(matcher, overlay_window_id, &options, instance);
+  free_hook_args(matcher, &options, instance->hook == NULL);
+  if (instance->hook == NULL) {
+    release_hook_callback(env, instance);
+    NAPI_THROW(env, NULL, "Overlay hook is already started in another environment", NULL);
+  }
 
+  status = napi_add_env_cleanup_hook(env, release_hook, instance);
+  NAPI_FATAL_IF_FAILED(status, "AddonStart", "napi_add_env_cleanup_hook");
   return NULL;
 }
 
-napi_value AddonActivateOverlay(napi_env _env, napi_callback_info _info) {
-  ow_activate_overlay();
+napi_value AddonActivateOverlay(napi_env env, napi_callback_info info) {
+  struct ow_addon_instance* instance = get_instance(env);
+  if (instance->hook != NULL) {
+    ow_activate_overlay(instance->hook);
+  }
   return NULL;
 }
 
 napi_value AddonFocusTarget(napi_env env, napi_callback_info info) {
-  ow_focus_target();
+  struct ow_addon_instance* instance = get_instance(env);
+  if (instance->hook != NULL) {
+    ow_focus_target(instance->hook);
+  }
   return NULL;
 }
 
-napi_value AddonScreenshot(napi_env env, napi_callback_info info) {
+napi_value AddonGetTargetState(napi_env env, napi_callback_info info) {
   napi_status status;
+  struct ow_addon_instance* instance = get_instance(env);
 
-  napi_value img_buffer;
-  uint8_t* img_data;
-  size_t size = last_reported_bounds.width * last_reported_bounds.height * 4;
-  status = napi_create_buffer(env, size, (void **)&img_data, &img_buffer);
-  NAPI_FATAL_IF_FAILED(status, "AddonScreenshot", "napi_create_buffer");
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
 
-#ifdef _WIN32
-  ow_screenshot(img_data, last_reported_bounds.width, last_reported_bounds.height);
-#endif
+  // [0] Int32Array to write the state into
+  napi_typedarray_type array_type;
+  size_t array_length;
+  void* array_data;
+  status = napi_get_typedarray_info(env, info_argv[0], &array_type, &array_length, &array_data, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (array_type != napi_int32_array || array_length < OW_TARGET_STATE_LENGTH) {
+    NAPI_THROW(env, NULL, "Expected Int32Array of sufficient length", NULL);
+  }
 
-  return img_buffer;
-}
+  struct ow_target_state state;
+  ow_target_state_read(&instance->target_state, &state);
 
-void AddonCleanUp(void* arg) {
-  // @TODO
-  // UnhookWinEvent(win_event_hhook);
+  int32_t* out = (int32_t*)array_data;
+  out[0] = (int32_t)state.generation;
+  out[1] = (int32_t)state.flags;
+  out[2] = state.bounds.x;
+  out[3] = state.bounds.y;
+  out[4] = (int32_t)state.bounds.width;
+  out[5] = (int32_t)state.bounds.height;
+  out[6] = (int32_t)(uint32_t)(state.window_id & 0xFFFFFFFF);
+  out[7] = (int32_t)(uint32_t)(state.window_id >> 32);
+
+  return NULL;
 }
 
-NAPI_MODULE_INIT() {
+static napi_value timing_stats_to_js_object(napi_env env, struct ow_metrics* metrics, enum ow_timing_metric metric) {
   napi_status status;
-  napi_value export_fn;
 
-  status = napi_create_function(env, NULL, 0, AddonStart, NULL, &export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
-  status = napi_set_named_property(env, exports, "start", export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+  struct ow_timing_stats stats;
+  ow_metrics_read_timing(metrics, metric, &stats);
 
-  status = napi_create_function(env, NULL, 0, AddonActivateOverlay, NULL, &export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
-  status = napi_set_named_property(env, exports, "activateOverlay", export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+  napi_value stats_obj;
+  status = napi_create_object(env, &stats_obj);
+  NAPI_FATAL_IF_FAILED(status, "timing_stats_to_js_object", "napi_create_object");
 
-  status = napi_create_function(env, NULL, 0, AddonFocusTarget, NULL, &export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
-  status = napi_set_named_property(env, exports, "focusTarget", export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+  napi_value s_count;
+  status = napi_create_uint32(env, stats.count, &s_count);
+  NAPI_FATAL_IF_FAILED(status, "timing_stats_to_js_object", "napi_create_uint32");
 
-  status = napi_create_function(env, NULL, 0, AddonScreenshot, NULL, &export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
-  status = napi_set_named_property(env, exports, "screenshot", export_fn);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+  napi_value s_last;
+  status = napi_create_double(env, stats.last_ns / 1e6, &s_last);
+  NAPI_FATAL_IF_FAILED(status, "timing_stats_to_js_object", "napi_create_double");
 
-  status = napi_add_env_cleanup_hook(env, AddonCleanUp, NULL);
-  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_add_env_cleanup_hook");
+  napi_value s_min;
+  status = napi_create_double(env, stats.min_ns / 1e6, &s_min);
+  NAPI_FATAL_IF_FAILED(status, "timing_stats_to_js_object", "napi_create_double");
+
+  napi_value s_max;
+  status = napi_create_double(env, stats.max_ns / 1e6, &s_max);
+  NAPI_FATAL_IF_FAILED(status, "timing_stats_to_js_object", "napi_create_double");
+
+  napi_value s_mean;
+  status = napi_create_double(env, stats.count ? (stats.total_ns / 1e6) / stats.count : 0, &s_mean);
+  NAPI_FATAL_IF_FAILED(status, "timing_stats_to_js_object", "napi_create_double");
+
+  napi_property_descriptor descriptors[] = {
+    { "count",  NULL, NULL, NULL, NULL, s_count, napi_enumerable, NULL },
+    { "lastMs", NULL, NULL, NULL, NULL, s_last,  napi_enumerable, NULL },
+    { "minMs",  NULL, NULL, NULL, NULL, s_min,   napi_enumerable, NULL },
+    { "maxMs",  NULL, NULL, NULL, NULL, s_max,   napi_enumerable, NULL },
+    { "meanMs", NULL, NULL, NULL, NULL, s_mean,  napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, stats_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_FATAL_IF_FAILED(status, "timing_stats_to_js_object", "napi_define_properties");
+  return stats_obj;
+}
+
+static napi_value latency_stats_to_js_object(napi_env env, struct ow_metrics* metrics, enum ow_latency_stage stage, enum ow_event_type type) {
+  napi_status status;
+
+  struct ow_latency_histogram histogram;
+  ow_metrics_read_latency(metrics, stage, type, &histogram);
+
+  napi_value stats_obj;
+  status = napi_create_object(env, &stats_obj);
+  NAPI_FATAL_IF_FAILED(status, "latency_stats_to_js_object", "napi_create_object");
+
+  napi_value s_count;
+  status = napi_create_uint32(env, histogram.count, &s_count);
+  NAPI_FATAL_IF_FAILED(status, "latency_stats_to_js_object", "napi_create_uint32");
+
+  napi_value s_p50;
+  status = napi_create_double(env, ow_latency_histogram_quantile(&histogram, 0.5) / 1e3, &s_p50);
+  NAPI_FATAL_IF_FAILED(status, "latency_stats_to_js_object", "napi_create_double");
+
+  napi_value s_p90;
+  status = napi_create_double(env, ow_latency_histogram_quantile(&histogram, 0.9) / 1e3, &s_p90);
+  NAPI_FATAL_IF_FAILED(status, "latency_stats_to_js_object", "napi_create_double");
+
+  napi_value s_p99;
+  status = napi_create_double(env, ow_latency_histogram_quantile(&histogram, 0.99) / 1e3, &s_p99);
+  NAPI_FATAL_IF_FAILED(status, "latency_stats_to_js_object", "napi_create_double");
+
+  napi_value s_max;
+  status = napi_create_double(env, histogram.max_us / 1e3, &s_max);
+  NAPI_FATAL_IF_FAILED(status, "latency_stats_to_js_object", "napi_create_double");
+
+  napi_property_descriptor descriptors[] = {
+    { "count", NULL, NULL, NULL, NULL, s_count, napi_enumerable, NULL },
+    { "p50Ms", NULL, NULL, NULL, NULL, s_p50,   napi_enumerable, NULL },
+    { "p90Ms", NULL, NULL, NULL, NULL, s_p90,   napi_enumerable, NULL },
+    { "p99Ms", NULL, NULL, NULL, NULL, s_p99,   napi_enumerable, NULL },
+    { "maxMs", NULL, NULL, NULL, NULL, s_max,   napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, stats_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_FATAL_IF_FAILED(status, "latency_stats_to_js_object", "napi_define_properties");
+  return stats_obj;
+}
+
+// { [event name]: latency stats } for a single stage
+static napi_value latency_stage_to_js_object(napi_env env, struct ow_metrics* metrics, enum ow_latency_stage stage) {
+  napi_status status;
+
+  napi_value stage_obj;
+  status = napi_create_object(env, &stage_obj);
+  NAPI_FATAL_IF_FAILED(status, "latency_stage_to_js_object", "napi_create_object");
+
+  napi_property_descriptor descriptors[] = {
+    { "attach",     NULL, NULL, NULL, NULL, latency_stats_to_js_object(env, metrics, stage, OW_ATTACH),     napi_enumerable, NULL },
+    { "focus",      NULL, NULL, NULL, NULL, latency_stats_to_js_object(env, metrics, stage, OW_FOCUS),      napi_enumerable, NULL },
+    { "blur",       NULL, NULL, NULL, NULL, latency_stats_to_js_object(env, metrics, stage, OW_BLUR),       napi_enumerable, NULL },
+    { "detach",     NULL, NULL, NULL, NULL, latency_stats_to_js_object(env, metrics, stage, OW_DETACH),     napi_enumerable, NULL },
+    { "fullscreen", NULL, NULL, NULL, NULL, latency_stats_to_js_object(env, metrics, stage, OW_FULLSCREEN), napi_enumerable, NULL },
+    { "moveresize", NULL, NULL, NULL, NULL, latency_stats_to_js_object(env, metrics, stage, OW_MOVERESIZE), napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, stage_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_FATAL_IF_FAILED(status, "latency_stage_to_js_object", "napi_define_properties");
+  return stage_obj;
+}
+
+napi_value AddonGetMetrics(napi_env env, napi_callback_info info) {
+  napi_status status;
+  struct ow_addon_instance* instance = get_instance(env);
+
+  napi_value metrics_obj;
+  status = napi_create_object(env, &metrics_obj);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value latency_obj;
+  status = napi_create_object(env, &latency_obj);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_property_descriptor latency_descriptors[] = {
+    { "source", NULL, NULL, NULL, NULL, latency_stage_to_js_object(env, &instance->metrics, OW_LATENCY_SOURCE), napi_enumerable, NULL },
+    { "hook",   NULL, NULL, NULL, NULL, latency_stage_to_js_object(env, &instance->metrics, OW_LATENCY_HOOK),   napi_enumerable, NULL },
+    { "queue",  NULL, NULL, NULL, NULL, latency_stage_to_js_object(env, &instance->metrics, OW_LATENCY_QUEUE),  napi_enumerable, NULL },
+    { "apply",  NULL, NULL, NULL, NULL, latency_stage_to_js_object(env, &instance->metrics, OW_LATENCY_APPLY),  napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, latency_obj, sizeof(latency_descriptors) / sizeof(latency_descriptors[0]), latency_descriptors);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_value dropped_events;
+  status = napi_create_uint32(env, ow_event_queue_dropped(&instance->event_queue), &dropped_events);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  napi_property_descriptor descriptors[] = {
+    { "startup",       NULL, NULL, NULL, NULL, timing_stats_to_js_object(env, &instance->metrics, OW_TIMING_STARTUP), napi_enumerable, NULL },
+    { "attach",        NULL, NULL, NULL, NULL, timing_stats_to_js_object(env, &instance->metrics, OW_TIMING_ATTACH),  napi_enumerable, NULL },
+    { "latency",       NULL, NULL, NULL, NULL, latency_obj,                                       napi_enumerable, NULL },
+    { "droppedEvents", NULL, NULL, NULL, NULL, dropped_events,                                    napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, metrics_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  return metrics_obj;
+}
+
+napi_value AddonRecordApplyLatency(napi_env env, napi_callback_info info) {
+  napi_status status;
+  struct ow_addon_instance* instance = get_instance(env);
+
+  size_t info_argc = 2;
+  napi_value info_argv[2];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  uint32_t event_type;
+  status = napi_get_value_uint32(env, info_argv[0], &event_type);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  double duration_ms;
+  status = napi_get_value_double(env, info_argv[1], &duration_ms);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (duration_ms >= 0) {
+    ow_metrics_record_latency(&instance->metrics, OW_LATENCY_APPLY, event_type, (uint64_t)(duration_ms * 1e6));
+  }
+  return NULL;
+}
+
+napi_value AddonResetLatency(napi_env env, napi_callback_info info) {
+  struct ow_addon_instance* instance = get_instance(env);
+  ow_metrics_reset_latency(&instance->metrics);
+  return NULL;
+}
+
+#ifdef __linux__
+static napi_value string_or_empty(napi_env env, const char* str) {
+  napi_value value;
+  napi_status status = napi_create_string_utf8(env, str ? str : "", NAPI_AUTO_LENGTH, &value);
+  NAPI_FATAL_IF_FAILED(status, "string_or_empty", "napi_create_string_utf8");
+  return value;
+}
+#endif
+
+napi_value AddonListWindows(napi_env env, napi_callback_info info) {
+#ifdef __linux__
+  napi_status status;
+
+  struct ow_addon_instance* instance = get_instance(env);
+
+  struct ow_window_info* windows;
+  uint32_t count = ow_list_windows(instance->hook, &windows);
+
+  napi_value list;
+  status = napi_create_array_with_length(env, count, &list);
+  NAPI_FATAL_IF_FAILED(status, "AddonListWindows", "napi_create_array_with_length");
+
+  for (uint32_t i = 0; i < count; ++i) {
+    napi_value w_id;
+    status = napi_create_double(env, (double)windows[i].window_id, &w_id);
+    NAPI_FATAL_IF_FAILED(status, "AddonListWindows", "napi_create_double");
+
+    napi_value w_pid;
+    status = napi_create_uint32(env, windows[i].pid, &w_pid);
+    NAPI_FATAL_IF_FAILED(status, "AddonListWindows", "napi_create_uint32");
+
+    napi_value window_obj;
+    status = napi_create_object(env, &window_obj);
+    NAPI_FATAL_IF_FAILED(status, "AddonListWindows", "napi_create_object");
+
+    napi_property_descriptor descriptors[] = {
+      { "id",      NULL, NULL, NULL, NULL, w_id,                                   napi_enumerable, NULL },
+      { "title",   NULL, NULL, NULL, NULL, string_or_empty(env, windows[i].title),    napi_enumerable, NULL },
+      { "wmClass", NULL, NULL, NULL, NULL, string_or_empty(env, windows[i].wm_class), napi_enumerable, NULL },
+      { "pid",     NULL, NULL, NULL, NULL, w_pid,                                  napi_enumerable, NULL },
+    };
+    status = napi_define_properties(env, window_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+    NAPI_FATAL_IF_FAILED(status, "AddonListWindows", "napi_define_properties");
+
+    status = napi_set_element(env, list, i, window_obj);
+    NAPI_FATAL_IF_FAILED(status, "AddonListWindows", "napi_set_element");
+  }
+
+  ow_free_window_list(windows, count);
+  return list;
+#else
+  NAPI_THROW(env, NULL, "Not implemented on your platform.", NULL);
+#endif
+}
+
+napi_value AddonScreenshot(napi_env env, napi_callback_info info) {
+  napi_status status;
+  struct ow_addon_instance* instance = get_instance(env);
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Optional image options
+  struct ow_pixel_transform transform;
+  image_options_from_js_value(env, info_argc > 0 ? info_argv[0] : NULL, &transform);
+  bool is_exception_pending;
+  status = napi_is_exception_pending(env, &is_exception_pending);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (is_exception_pending) {
+    return NULL;
+  }
+
+  struct ow_target_state state;
+  ow_target_state_read(&instance->target_state, &state);
+
+  struct ow_pixel_transform resolved;
+  if (!resolve_capture_transform(&transform, state.bounds.width, state.bounds.height, &resolved)) {
+    status = napi_throw_range_error(env, NULL, "Crop region is outside of the target");
+    NAPI_FATAL_IF_FAILED(status, "AddonScreenshot", "napi_throw_range_error");
+    return NULL;
+  }
+
+  napi_value img_buffer;
+  uint8_t* img_data;
+  size_t size = (size_t)resolved.width * resolved.height * ow_pixel_format_size(resolved.format);
+  status = napi_create_buffer(env, size, (void **)&img_data, &img_buffer);
+  NAPI_FATAL_IF_FAILED(status, "AddonScreenshot", "napi_create_buffer");
+
+#if defined(_WIN32) || defined(__linux__)
+  screenshot_transformed(instance->hook, &resolved, state.bounds.width, state.bounds.height, img_data);
+#endif
+
+  return img_buffer;
+}
+
+struct screenshot_work {
+  napi_async_work work;
+  napi_deferred deferred;
+  // Both stay valid until the work completes, the hook is stopped
+  // only after in-flight work of its environment is finished.
+  struct ow_addon_instance* instance;
+  struct ow_hook* hook;
+  // caller-supplied buffer, NULL if a new one must be created
+  napi_ref into_ref;
+  uint8_t* data;
+  size_t capacity;
+  struct ow_pixel_transform transform;
+  // size of the result, known when the capture starts
+  uint32_t width;
+  uint32_t height;
+  size_t size;
+  bool has_encoding;
+  enum ow_image_encoding encoding;
+  bool is_too_small;
+  bool is_out_of_bounds;
+  bool is_encode_failed;
+};
+
+static void screenshot_work_execute(napi_env env, void* data) {
+  struct screenshot_work* sw = (struct screenshot_work*)data;
+
+  struct ow_target_state state;
+  ow_target_state_read(&sw->instance->target_state, &state);
+
+  struct ow_pixel_transform resolved;
+  if (!resolve_capture_transform(&sw->transform, state.bounds.width, state.bounds.height, &resolved)) {
+    sw->is_out_of_bounds = true;
+    return;
+  }
+  sw->width = resolved.width;
+  sw->height = resolved.height;
+  sw->size = (size_t)sw->width * sw->height * ow_pixel_format_size(resolved.format);
+
+  if (sw->into_ref != NULL) {
+    if (sw->size > sw->capacity) {
+      sw->is_too_small = true;
+      return;
+    }
+  } else {
+    sw->data = malloc(sw->size ? sw->size : 1);
+  }
+
+#if defined(_WIN32) || defined(__linux__)
+  screenshot_transformed(sw->hook, &resolved, state.bounds.width, state.bounds.height, sw->data);
+#endif
+
+  if (sw->has_encoding) {
+    uint8_t* encoded = ow_image_encode(sw->encoding, sw->data, (size_t)sw->width * 4, sw->width, sw->height, &sw->size);
+    free(sw->data);
+    sw->data = encoded;
+    sw->is_encode_failed = (encoded == NULL);
+  }
+}
+
+static void screenshot_work_complete(napi_env env, napi_status work_status, void* data) {
+  struct screenshot_work* sw = (struct screenshot_work*)data;
+  napi_status status;
+
+  napi_value result = NULL;
+  napi_value error = NULL;
+  if (work_status != napi_ok) {
+    error = error_create(env);
+  } else if (sw->is_encode_failed) {
+    napi_value error_message;
+    status = napi_create_string_utf8(env, "Failed to encode image", NAPI_AUTO_LENGTH, &error_message);
+    NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_create_string_utf8");
+    status = napi_create_error(env, NULL, error_message, &error);
+    NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_create_error");
+  } else if (sw->is_too_small || sw->is_out_of_bounds) {
+    char message[96];
+    if (sw->is_out_of_bounds) {
+      snprintf(message, sizeof(message), "Crop region is outside of the target");
+    } else {
+      snprintf(message, sizeof(message), "Buffer is too small, %zu bytes required", sw->size);
+    }
+    napi_value error_message;
+    status = napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &error_message);
+    NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_create_string_utf8");
+    status = napi_create_range_error(env, NULL, error_message, &error);
+    NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_create_range_error");
+  } else {
+    napi_value img_buffer;
+    if (sw->into_ref != NULL) {
+      status = napi_get_reference_value(env, sw->into_ref, &img_buffer);
+      NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_get_reference_value");
+    } else {
+      // external buffers are not allowed in Electron, have to copy
+      status = napi_create_buffer_copy(env, sw->size, sw->data, NULL, &img_buffer);
+      NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_create_buffer_copy");
+    }
+
+    napi_value r_width;
+    status = napi_create_uint32(env, sw->width, &r_width);
+    NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_create_uint32");
+
+    napi_value r_height;
+    status = napi_create_uint32(env, sw->height, &r_height);
+    NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_create_uint32");
+
+    status = napi_create_object(env, &result);
+    NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_create_object");
+
+    napi_property_descriptor descriptors[] = {
+      { "buffer", NULL, NULL, NULL, NULL, img_buffer, napi_enumerable, NULL },
+      { "width",  NULL, NULL, NULL, NULL, r_width,    napi_enumerable, NULL },
+      { "height", NULL, NULL, NULL, NULL, r_height,   napi_enumerable, NULL },
+    };
+    status = napi_define_properties(env, result, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+    NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_define_properties");
+  }
+
+  if (error != NULL) {
+    status = napi_reject_deferred(env, sw->deferred, error);
+    NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_reject_deferred");
+  } else {
+    status = napi_resolve_deferred(env, sw->deferred, result);
+    NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_resolve_deferred");
+  }
+
+  if (sw->into_ref != NULL) {
+    status = napi_delete_reference(env, sw->into_ref);
+    NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_delete_reference");
+  } else {
+    free(sw->data);
+  }
+  status = napi_delete_async_work(env, sw->work);
+  NAPI_FATAL_IF_FAILED(status, "screenshot_work_complete", "napi_delete_async_work");
+  free(sw);
+}
+
+napi_value AddonScreenshotAsync(napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 2;
+  napi_value info_argv[2];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Optional Buffer to capture into
+  void* into_data = NULL;
+  size_t into_length = 0;
+  bool has_into = false;
+  if (info_argc > 0) {
+    napi_valuetype into_type;
+    status = napi_typeof(env, info_argv[0], &into_type);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    if (into_type != napi_undefined && into_type != napi_null) {
+      bool is_buffer;
+      status = napi_is_buffer(env, info_argv[0], &is_buffer);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+      if (!is_buffer) {
+        NAPI_THROW(env, NULL, "Expected Buffer", NULL);
+      }
+      status = napi_get_buffer_info(env, info_argv[0], &into_data, &into_length);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+      has_into = true;
+    }
+  }
+
+  // [1] Optional image options and encoding
+  struct ow_pixel_transform transform;
+  enum ow_image_encoding encoding = OW_ENCODING_PNG;
+  bool has_encoding = false;
+  image_options_from_js_value(env, info_argc > 1 ? info_argv[1] : NULL, &transform);
+  bool is_exception_pending;
+  status = napi_is_exception_pending(env, &is_exception_pending);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (!is_exception_pending) {
+    encoding_option(env, info_argc > 1 ? info_argv[1] : NULL, &encoding, &has_encoding);
+    status = napi_is_exception_pending(env, &is_exception_pending);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+  if (is_exception_pending) {
+    return NULL;
+  }
+  if (has_encoding && has_into) {
+    NAPI_THROW(env, NULL, "Encoded screenshot can't be captured into a Buffer", NULL);
+  }
+  if (has_encoding && transform.format != OW_PIXEL_BGRA) {
+    NAPI_THROW(env, NULL, "Encoding requires bgra format", NULL);
+  }
+
+  struct screenshot_work* sw = calloc(1, sizeof(struct screenshot_work));
+  sw->instance = get_instance(env);
+  sw->hook = sw->instance->hook;
+  sw->transform = transform;
+  sw->has_encoding = has_encoding;
+  sw->encoding = encoding;
+  if (has_into) {
+    // keeps the buffer alive while capturing into it
+    status = napi_create_reference(env, info_argv[0], 1, &sw->into_ref);
+    NAPI_FATAL_IF_FAILED(status, "AddonScreenshotAsync", "napi_create_reference");
+    sw->data = (uint8_t*)into_data;
+    sw->capacity = into_length;
+  }
+
+  napi_value promise;
+  status = napi_create_promise(env, &sw->deferred, &promise);
+  NAPI_FATAL_IF_FAILED(status, "AddonScreenshotAsync", "napi_create_promise");
+
+  napi_value async_resource_name;
+  status = napi_create_string_utf8(env, "OVERLAY_WINDOW_SCREENSHOT", NAPI_AUTO_LENGTH, &async_resource_name);
+  NAPI_FATAL_IF_FAILED(status, "AddonScreenshotAsync", "napi_create_string_utf8");
+  status = napi_create_async_work(env, NULL, async_resource_name, screenshot_work_execute, screenshot_work_complete, sw, &sw->work);
+  NAPI_FATAL_IF_FAILED(status, "AddonScreenshotAsync", "napi_create_async_work");
+  status = napi_queue_async_work(env, sw->work);
+  NAPI_FATAL_IF_FAILED(status, "AddonScreenshotAsync", "napi_queue_async_work");
+
+  return promise;
+}
+
+struct encode_work {
+  napi_async_work work;
+  napi_deferred deferred;
+  // keeps the image alive while encoding
+  napi_ref image_ref;
+  const uint8_t* image;
+  uint32_t width;
+  uint32_t height;
+  enum ow_image_encoding encoding;
+  uint8_t* result;
+  size_t size;
+};
+
+static void encode_work_execute(napi_env env, void* data) {
+  struct encode_work* ew = (struct encode_work*)data;
+  ew->result = ow_image_encode(ew->encoding, ew->image, (size_t)ew->width * 4, ew->width, ew->height, &ew->size);
+}
+
+static void encode_work_complete(napi_env env, napi_status work_status, void* data) {
+  struct encode_work* ew = (struct encode_work*)data;
+  napi_status status;
+
+  if (work_status != napi_ok || ew->result == NULL) {
+    napi_value error;
+    if (work_status != napi_ok) {
+      error = error_create(env);
+    } else {
+      napi_value error_message;
+      status = napi_create_string_utf8(env, "Failed to encode image", NAPI_AUTO_LENGTH, &error_message);
+      NAPI_FATAL_IF_FAILED(status, "encode_work_complete", "napi_create_string_utf8");
+      status = napi_create_error(env, NULL, error_message, &error);
+      NAPI_FATAL_IF_FAILED(status, "encode_work_complete", "napi_create_error");
+    }
+    status = napi_reject_deferred(env, ew->deferred, error);
+    NAPI_FATAL_IF_FAILED(status, "encode_work_complete", "napi_reject_deferred");
+  } else {
+    napi_value encoded;
+    // external buffers are not allowed in Electron, have to copy
+    status = napi_create_buffer_copy(env, ew->size, ew->result, NULL, &encoded);
+    NAPI_FATAL_IF_FAILED(status, "encode_work_complete", "napi_create_buffer_copy");
+    status = napi_resolve_deferred(env, ew->deferred, encoded);
+    NAPI_FATAL_IF_FAILED(status, "encode_work_complete", "napi_resolve_deferred");
+  }
+
+  free(ew->result);
+  status = napi_delete_reference(env, ew->image_ref);
+  NAPI_FATAL_IF_FAILED(status, "encode_work_complete", "napi_delete_reference");
+  status = napi_delete_async_work(env, ew->work);
+  NAPI_FATAL_IF_FAILED(status, "encode_work_complete", "napi_delete_async_work");
+  free(ew);
+}
+
+napi_value AddonEncodeImage(napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 4;
+  napi_value info_argv[4];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (info_argc < 4) {
+    NAPI_THROW(env, NULL, "Expected image, width, height and options", NULL);
+  }
+
+  // [0] BGRA image, [1] width, [2] height
+  bool is_buffer;
+  status = napi_is_buffer(env, info_argv[0], &is_buffer);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (!is_buffer) {
+    NAPI_THROW(env, NULL, "Expected Buffer", NULL);
+  }
+  void* image_data;
+  size_t image_length;
+  status = napi_get_buffer_info(env, info_argv[0], &image_data, &image_length);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  uint32_t width;
+  status = napi_get_value_uint32(env, info_argv[1], &width);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  uint32_t height;
+  status = napi_get_value_uint32(env, info_argv[2], &height);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if ((uint64_t)width * height * 4 > image_length) {
+    status = napi_throw_range_error(env, NULL, "Buffer is smaller than the image");
+    NAPI_FATAL_IF_FAILED(status, "AddonEncodeImage", "napi_throw_range_error");
+    return NULL;
+  }
+
+  // [3] Options with encoding
+  enum ow_image_encoding encoding;
+  bool has_encoding;
+  encoding_option(env, info_argv[3], &encoding, &has_encoding);
+  bool is_exception_pending;
+  status = napi_is_exception_pending(env, &is_exception_pending);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (is_exception_pending) {
+    return NULL;
+  }
+  if (!has_encoding) {
+    NAPI_THROW(env, NULL, "Expected encoding", NULL);
+  }
+
+  struct encode_work* ew = calloc(1, sizeof(struct encode_work));
+  status = napi_create_reference(env, info_argv[0], 1, &ew->image_ref);
+  NAPI_FATAL_IF_FAILED(status, "AddonEncodeImage", "napi_create_reference");
+  ew->image = (const uint8_t*)image_data;
+  ew->width = width;
+  ew->height = height;
+  ew->encoding = encoding;
+
+  napi_value promise;
+  status = napi_create_promise(env, &ew->deferred, &promise);
+  NAPI_FATAL_IF_FAILED(status, "AddonEncodeImage", "napi_create_promise");
+
+  napi_value async_resource_name;
+  status = napi_create_string_utf8(env, "OVERLAY_WINDOW_ENCODE", NAPI_AUTO_LENGTH, &async_resource_name);
+  NAPI_FATAL_IF_FAILED(status, "AddonEncodeImage", "napi_create_string_utf8");
+  status = napi_create_async_work(env, NULL, async_resource_name, encode_work_execute, encode_work_complete, ew, &ew->work);
+  NAPI_FATAL_IF_FAILED(status, "AddonEncodeImage", "napi_create_async_work");
+  status = napi_queue_async_work(env, ew->work);
+  NAPI_FATAL_IF_FAILED(status, "AddonEncodeImage", "napi_queue_async_work");
+
+  return promise;
+}
+
+// `context` is the instance that started the hook.
+void ow_emit_frame(void* context, struct ow_frame_event* event) {
+  struct ow_addon_instance* instance = context;
+
+  uv_mutex_lock(&instance->frame_lock);
+  if (!instance->is_stream_started || instance->frame_tsfn == NULL) {
+    uv_mutex_unlock(&instance->frame_lock);
+    return;
+  }
+  bool is_wakeup_needed = !instance->has_pending_frame;
+  if (instance->has_pending_frame) {
+    ow_frame_damage_merge(&instance->pending_frame.damage, &event->damage);
+    instance->pending_frame.frame = event->frame;
+  } else {
+    instance->pending_frame = *event;
+    instance->has_pending_frame = true;
+  }
+  napi_status status = napi_ok;
+  if (is_wakeup_needed) {
+    status = napi_call_threadsafe_function(instance->frame_tsfn, NULL, napi_tsfn_nonblocking);
+  }
+  uv_mutex_unlock(&instance->frame_lock);
+  if (status == napi_closing) return;
+  NAPI_FATAL_IF_FAILED(status, "ow_emit_frame", "napi_call_threadsafe_function");
+}
+
+static napi_value frame_info_to_js_object(napi_env env, struct ow_frame_info* info) {
+  napi_status status;
+
+  napi_value f_seq;
+  status = napi_create_uint32(env, info->seq, &f_seq);
+  NAPI_FATAL_IF_FAILED(status, "frame_info_to_js_object", "napi_create_uint32");
+
+  napi_value f_width;
+  status = napi_create_uint32(env, info->width, &f_width);
+  NAPI_FATAL_IF_FAILED(status, "frame_info_to_js_object", "napi_create_uint32");
+
+  napi_value f_height;
+  status = napi_create_uint32(env, info->height, &f_height);
+  NAPI_FATAL_IF_FAILED(status, "frame_info_to_js_object", "napi_create_uint32");
+
+  napi_value info_obj;
+  status = napi_create_object(env, &info_obj);
+  NAPI_FATAL_IF_FAILED(status, "frame_info_to_js_object", "napi_create_object");
+
+  napi_property_descriptor descriptors[] = {
+    { "seq",    NULL, NULL, NULL, NULL, f_seq,    napi_enumerable, NULL },
+    { "width",  NULL, NULL, NULL, NULL, f_width,  napi_enumerable, NULL },
+    { "height", NULL, NULL, NULL, NULL, f_height, napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, info_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_FATAL_IF_FAILED(status, "frame_info_to_js_object", "napi_define_properties");
+  return info_obj;
+}
+
+static napi_value bounds_to_js_object(napi_env env, struct ow_window_bounds* bounds) {
+  napi_status status;
+
+  napi_value b_x;
+  status = napi_create_int32(env, bounds->x, &b_x);
+  NAPI_FATAL_IF_FAILED(status, "bounds_to_js_object", "napi_create_int32");
+
+  napi_value b_y;
+  status = napi_create_int32(env, bounds->y, &b_y);
+  NAPI_FATAL_IF_FAILED(status, "bounds_to_js_object", "napi_create_int32");
+
+  napi_value b_width;
+  status = napi_create_uint32(env, bounds->width, &b_width);
+  NAPI_FATAL_IF_FAILED(status, "bounds_to_js_object", "napi_create_uint32");
+
+  napi_value b_height;
+  status = napi_create_uint32(env, bounds->height, &b_height);
+  NAPI_FATAL_IF_FAILED(status, "bounds_to_js_object", "napi_create_uint32");
+
+  napi_value bounds_obj;
+  status = napi_create_object(env, &bounds_obj);
+  NAPI_FATAL_IF_FAILED(status, "bounds_to_js_object", "napi_create_object");
+
+  napi_property_descriptor descriptors[] = {
+    { "x",      NULL, NULL, NULL, NULL, b_x,      napi_enumerable, NULL },
+    { "y",      NULL, NULL, NULL, NULL, b_y,      napi_enumerable, NULL },
+    { "width",  NULL, NULL, NULL, NULL, b_width,  napi_enumerable, NULL },
+    { "height", NULL, NULL, NULL, NULL, b_height, napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, bounds_obj, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_FATAL_IF_FAILED(status, "bounds_to_js_object", "napi_define_properties");
+  return bounds_obj;
+}
+
+static void frame_tsfn_to_js_proxy(napi_env env, napi_value js_callback, void* context, void* _data) {
+  if (env == NULL) return;
+
+  struct ow_addon_instance* instance = context;
+  napi_status status;
+
+  uv_mutex_lock(&instance->frame_lock);
+  struct ow_frame_event event = instance->pending_frame;
+  bool has_event = instance->has_pending_frame;
+  instance->has_pending_frame = false;
+  uv_mutex_unlock(&instance->frame_lock);
+  if (!has_event) return;
+
+  napi_value event_obj = frame_info_to_js_object(env, &event.frame);
+
+  napi_value rects;
+  status = napi_create_array_with_length(env, event.damage.count, &rects);
+  NAPI_FATAL_IF_FAILED(status, "frame_tsfn_to_js_proxy", "napi_create_array_with_length");
+  for (uint32_t i = 0; i < event.damage.count; ++i) {
+    status = napi_set_element(env, rects, i, bounds_to_js_object(env, &event.damage.rects[i]));
+    NAPI_FATAL_IF_FAILED(status, "frame_tsfn_to_js_proxy", "napi_set_element");
+  }
+  status = napi_set_named_property(env, event_obj, "rects", rects);
+  NAPI_FATAL_IF_FAILED(status, "frame_tsfn_to_js_proxy", "napi_set_named_property");
+
+  napi_value global;
+  status = napi_get_global(env, &global);
+  NAPI_FATAL_IF_FAILED(status, "frame_tsfn_to_js_proxy", "napi_get_global");
+
+  status = napi_call_function(env, global, js_callback, 1, &event_obj, NULL);
+  NAPI_FATAL_IF_FAILED(status, "frame_tsfn_to_js_proxy", "napi_call_function");
+}
+
+#ifdef __linux__
+static void stop_stream(struct ow_addon_instance* instance) {
+  ow_stream_stop(instance->hook);
+
+  uv_mutex_lock(&instance->frame_lock);
+  instance->is_stream_started = false;
+  instance->has_pending_frame = false;
+  uv_mutex_unlock(&instance->frame_lock);
+
+  if (instance->frame_tsfn != NULL) {
+    napi_status status = napi_release_threadsafe_function(instance->frame_tsfn, napi_tsfn_release);
+    NAPI_FATAL_IF_FAILED(status, "stop_stream", "napi_release_threadsafe_function");
+    instance->frame_tsfn = NULL;
+  }
+}
+
+// Registered after `release_hook`, so it runs first and the
+// stream is stopped before the hook is.
+static void release_stream(void* arg) {
+  stop_stream(arg);
+}
+#endif
+
+napi_value AddonStartCaptureStream(napi_env env, napi_callback_info info) {
+#ifdef __linux__
+  napi_status status;
+  struct ow_addon_instance* instance = get_instance(env);
+
+  size_t info_argc = 2;
+  napi_value info_argv[2];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  if (instance->is_stream_started) {
+    NAPI_THROW(env, NULL, "Capture stream is already started", NULL);
+  }
+  if (instance->hook == NULL) {
+    NAPI_THROW(env, NULL, "Capture stream requires the hook to be started", NULL);
+  }
+
+  // [0] Options
+  struct ow_stream_options options = {
+    .max_fps = 0,
+    .poll_interval_ms = 0
+  };
+  if (info_argc > 0) {
+    status = get_uint32_option(env, info_argv[0], "maxFps", &options.max_fps);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    status = get_uint32_option(env, info_argv[0], "pollIntervalMs", &options.poll_interval_ms);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+
+  // [1] Optional frame callback
+  if (info_argc > 1) {
+    napi_valuetype cb_type;
+    status = napi_typeof(env, info_argv[1], &cb_type);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    if (cb_type == napi_function) {
+      napi_value async_resource_name;
+      status = napi_create_string_utf8(env, "OVERLAY_WINDOW_FRAME", NAPI_AUTO_LENGTH, &async_resource_name);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+      status = napi_create_threadsafe_function(env, info_argv[1], NULL, async_resource_name, 0, 1, NULL, NULL, instance, frame_tsfn_to_js_proxy, &instance->frame_tsfn);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+    }
+  }
+
+  uv_mutex_lock(&instance->frame_lock);
+  instance->is_stream_started = true;
+  uv_mutex_unlock(&instance->frame_lock);
+  if (!ow_stream_start(instance->hook, &options)) {
+    uv_mutex_lock(&instance->frame_lock);
+    instance->is_stream_started = false;
+    uv_mutex_unlock(&instance->frame_lock);
+    if (instance->frame_tsfn != NULL) {
+      status = napi_release_threadsafe_function(instance->frame_tsfn, napi_tsfn_release);
+      NAPI_FATAL_IF_FAILED(status, "AddonStartCaptureStream", "napi_release_threadsafe_function");
+      instance->frame_tsfn = NULL;
+    }
+    NAPI_THROW(env, NULL, "Capture stream requires the hook to be started", NULL);
+  }
+  status = napi_add_env_cleanup_hook(env, release_stream, instance);
+  NAPI_FATAL_IF_FAILED(status, "AddonStartCaptureStream", "napi_add_env_cleanup_hook");
+  return NULL;
+#else
+  NAPI_THROW(env, NULL, "Not implemented on your platform.", NULL);
+#endif
+}
+
+// Does nothing if this environment has not started the stream.
+napi_value AddonStopCaptureStream(napi_env env, napi_callback_info info) {
+#ifdef __linux__
+  struct ow_addon_instance* instance = get_instance(env);
+  if (!instance->is_stream_started) {
+    return NULL;
+  }
+  stop_stream(instance);
+
+  napi_status status = napi_remove_env_cleanup_hook(env, release_stream, instance);
+  NAPI_FATAL_IF_FAILED(status, "AddonStopCaptureStream", "napi_remove_env_cleanup_hook");
+#endif
+  return NULL;
+}
+
+napi_value AddonReadFrame(napi_env env, napi_callback_info info) {
+#ifdef __linux__
+  napi_status status;
+
+  size_t info_argc = 2;
+  napi_value info_argv[2];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Buffer to copy the frame into
+  bool is_buffer = false;
+  if (info_argc > 0) {
+    status = napi_is_buffer(env, info_argv[0], &is_buffer);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+  if (!is_buffer) {
+    NAPI_THROW(env, NULL, "Expected Buffer", NULL);
+  }
+  void* into_data;
+  size_t into_length;
+  status = napi_get_buffer_info(env, info_argv[0], &into_data, &into_length);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] Optional image options
+  struct ow_pixel_transform transform;
+  image_options_from_js_value(env, info_argc > 1 ? info_argv[1] : NULL, &transform);
+  bool is_exception_pending;
+  status = napi_is_exception_pending(env, &is_exception_pending);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (is_exception_pending) {
+    return NULL;
+  }
+
+  struct ow_frame_info frame_info;
+  struct ow_addon_instance* instance = get_instance(env);
+  enum ow_stream_read_result result = OW_STREAM_NO_FRAME;
+  if (instance->hook != NULL) {
+    result = ow_stream_read(instance->hook, (uint8_t*)into_data, into_length, &transform, &frame_info);
+  }
+  if (result == OW_STREAM_TOO_SMALL) {
+    char message[96];
+    size_t size = (size_t)frame_info.width * frame_info.height * ow_pixel_format_size(transform.format);
+    snprintf(message, sizeof(message), "Buffer is too small, %zu bytes required", size);
+    status = napi_throw_range_error(env, NULL, message);
+    NAPI_FATAL_IF_FAILED(status, "AddonReadFrame", "napi_throw_range_error");
+    return NULL;
+  }
+  if (result == OW_STREAM_OUT_OF_BOUNDS) {
+    status = napi_throw_range_error(env, NULL, "Crop region is outside of the frame");
+    NAPI_FATAL_IF_FAILED(status, "AddonReadFrame", "napi_throw_range_error");
+    return NULL;
+  }
+
+  napi_value result_value;
+  if (result == OW_STREAM_READ) {
+    result_value = frame_info_to_js_object(env, &frame_info);
+  } else {
+    status = napi_get_null(env, &result_value);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+  }
+  return result_value;
+#else
+  NAPI_THROW(env, NULL, "Not implemented on your platform.", NULL);
+#endif
+}
+
+static void change_detector_finalize(napi_env env, void* data, void* hint) {
+  struct ow_tile_hash* th = (struct ow_tile_hash*)data;
+  ow_tile_hash_free(th);
+  free(th);
+}
+
+napi_value AddonCreateChangeDetector(napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Optional tile size
+  uint32_t tile_size = 0;
+  if (info_argc > 0) {
+    napi_valuetype tile_size_type;
+    status = napi_typeof(env, info_argv[0], &tile_size_type);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    if (tile_size_type != napi_undefined) {
+      status = napi_get_value_uint32(env, info_argv[0], &tile_size);
+      NAPI_THROW_IF_FAILED(env, status, NULL);
+    }
+  }
+
+  struct ow_tile_hash* th = malloc(sizeof(struct ow_tile_hash));
+  ow_tile_hash_init(th, tile_size);
+
+  napi_value detector;
+  status = napi_create_external(env, th, change_detector_finalize, NULL, &detector);
+  NAPI_FATAL_IF_FAILED(status, "AddonCreateChangeDetector", "napi_create_external");
+  return detector;
+}
+
+napi_value AddonDetectChanges(napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 5;
+  napi_value info_argv[5];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (info_argc < 4) {
+    NAPI_THROW(env, NULL, "Expected detector, image, width and height", NULL);
+  }
+
+  // [0] Detector from `createChangeDetector`
+  napi_valuetype detector_type;
+  status = napi_typeof(env, info_argv[0], &detector_type);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (detector_type != napi_external) {
+    NAPI_THROW(env, NULL, "Expected change detector", NULL);
+  }
+  struct ow_tile_hash* th;
+  status = napi_get_value_external(env, info_argv[0], (void**)&th);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] Image, [2] width, [3] height, [4] optional bytes per pixel
+  bool is_buffer;
+  status = napi_is_buffer(env, info_argv[1], &is_buffer);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (!is_buffer) {
+    NAPI_THROW(env, NULL, "Expected Buffer", NULL);
+  }
+  void* image_data;
+  size_t image_length;
+  status = napi_get_buffer_info(env, info_argv[1], &image_data, &image_length);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  uint32_t width;
+  status = napi_get_value_uint32(env, info_argv[2], &width);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  uint32_t height;
+  status = napi_get_value_uint32(env, info_argv[3], &height);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  uint32_t bytes_per_pixel = 4;
+  if (info_argc > 4) {
+    status = napi_get_value_uint32(env, info_argv[4], &bytes_per_pixel);
+    NAPI_THROW_IF_FAILED(env, status, NULL);
+    if (bytes_per_pixel == 0 || bytes_per_pixel > 4) {
+      NAPI_THROW(env, NULL, "Bytes per pixel must be between 1 and 4", NULL);
+    }
+  }
+  if ((uint64_t)width * height * bytes_per_pixel > image_length) {
+    status = napi_throw_range_error(env, NULL, "Buffer is smaller than the image");
+    NAPI_FATAL_IF_FAILED(status, "AddonDetectChanges", "napi_throw_range_error");
+    return NULL;
+  }
+
+  uint32_t changed_tiles = ow_tile_hash_update(th, (const uint8_t*)image_data, (size_t)width * bytes_per_pixel, width, height, bytes_per_pixel);
+
+  struct ow_window_bounds* rects;
+  uint32_t rect_count = ow_tile_hash_rects(th, &rects);
+  napi_value rects_value;
+  status = napi_create_array_with_length(env, rect_count, &rects_value);
+  NAPI_FATAL_IF_FAILED(status, "AddonDetectChanges", "napi_create_array_with_length");
+  for (uint32_t i = 0; i < rect_count; ++i) {
+    status = napi_set_element(env, rects_value, i, bounds_to_js_object(env, &rects[i]));
+    NAPI_FATAL_IF_FAILED(status, "AddonDetectChanges", "napi_set_element");
+  }
+  free(rects);
+
+  uint64_t total_pixels = (uint64_t)width * height;
+  napi_value r_fraction;
+  status = napi_create_double(env, total_pixels ? (double)th->changed_pixels / (double)total_pixels : 0, &r_fraction);
+  NAPI_FATAL_IF_FAILED(status, "AddonDetectChanges", "napi_create_double");
+
+  napi_value r_tiles;
+  status = napi_create_uint32(env, changed_tiles, &r_tiles);
+  NAPI_FATAL_IF_FAILED(status, "AddonDetectChanges", "napi_create_uint32");
+
+  napi_value result;
+  status = napi_create_object(env, &result);
+  NAPI_FATAL_IF_FAILED(status, "AddonDetectChanges", "napi_create_object");
+
+  napi_property_descriptor descriptors[] = {
+    { "changedTiles",    NULL, NULL, NULL, NULL, r_tiles,     napi_enumerable, NULL },
+    { "changedFraction", NULL, NULL, NULL, NULL, r_fraction,  napi_enumerable, NULL },
+    { "rects",           NULL, NULL, NULL, NULL, rects_value, napi_enumerable, NULL },
+  };
+  status = napi_define_properties(env, result, sizeof(descriptors) / sizeof(descriptors[0]), descriptors);
+  NAPI_FATAL_IF_FAILED(status, "AddonDetectChanges", "napi_define_properties");
+  return result;
+}
+
+static void probe_set_finalize(napi_env env, void* data, void* hint) {
+  struct ow_probe_set* set = (struct ow_probe_set*)data;
+  ow_probe_set_free(set);
+  free(set);
+}
+
+napi_value AddonCreateProbeSet(napi_env env, napi_callback_info info) {
+  napi_status status;
+
+  size_t info_argc = 1;
+  napi_value info_argv[1];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [0] Int32Array of [x, y, width, height] for every region
+  napi_typedarray_type array_type;
+  size_t array_length;
+  void* array_data;
+  status = napi_get_typedarray_info(env, info_argv[0], &array_type, &array_length, &array_data, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (array_type != napi_int32_array || array_length % 4 != 0) {
+    NAPI_THROW(env, NULL, "Expected Int32Array of [x, y, width, height] values", NULL);
+  }
+
+  uint32_t count = (uint32_t)(array_length / 4);
+  int32_t* values = (int32_t*)array_data;
+  struct ow_window_bounds* regions = malloc((count ? count : 1) * sizeof(struct ow_window_bounds));
+  bool is_valid = true;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (values[i * 4 + 2] <= 0 || values[i * 4 + 3] <= 0) {
+      is_valid = false;
+      break;
+    }
+    regions[i].x = values[i * 4];
+    regions[i].y = values[i * 4 + 1];
+    regions[i].width = (uint32_t)values[i * 4 + 2];
+    regions[i].height = (uint32_t)values[i * 4 + 3];
+  }
+
+  struct ow_probe_set* set = malloc(sizeof(struct ow_probe_set));
+  is_valid = is_valid && ow_probe_set_init(set, regions, count);
+  free(regions);
+  if (!is_valid) {
+    free(set);
+    NAPI_THROW(env, NULL, "Region must not be empty", NULL);
+  }
+
+  napi_value probe_set;
+  status = napi_create_external(env, set, probe_set_finalize, NULL, &probe_set);
+  NAPI_FATAL_IF_FAILED(status, "AddonCreateProbeSet", "napi_create_external");
+  return probe_set;
+}
+
+napi_value AddonReadProbes(napi_env env, napi_callback_info info) {
+#if defined(_WIN32) || defined(__linux__)
+  napi_status status;
+
+  size_t info_argc = 2;
+  napi_value info_argv[2];
+  status = napi_get_cb_info(env, info, &info_argc, info_argv, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (info_argc < 2) {
+    NAPI_THROW(env, NULL, "Expected probe set and Uint32Array", NULL);
+  }
+
+  // [0] Probe set from `createProbeSet`
+  napi_valuetype set_type;
+  status = napi_typeof(env, info_argv[0], &set_type);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (set_type != napi_external) {
+    NAPI_THROW(env, NULL, "Expected probe set", NULL);
+  }
+  struct ow_probe_set* set;
+  status = napi_get_value_external(env, info_argv[0], (void**)&set);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+
+  // [1] Uint32Array to write the results into
+  napi_typedarray_type array_type;
+  size_t array_length;
+  void* array_data;
+  status = napi_get_typedarray_info(env, info_argv[1], &array_type, &array_length, &array_data, NULL, NULL);
+  NAPI_THROW_IF_FAILED(env, status, NULL);
+  if (array_type != napi_uint32_array || array_length < (size_t)set->count * OW_PROBE_STATS_LENGTH) {
+    NAPI_THROW(env, NULL, "Expected Uint32Array of sufficient length", NULL);
+  }
+
+  struct ow_addon_instance* instance = get_instance(env);
+  struct ow_target_state state;
+  ow_target_state_read(&instance->target_state, &state);
+  ow_probe_set_read(set, ow_screenshot_area, instance->hook, state.bounds.width, state.bounds.height, (uint32_t*)array_data);
+  return NULL;
+#else
+  NAPI_THROW(env, NULL, "Not implemented on your platform.", NULL);
+#endif
+}
+
+// Workers are joined once no environment can use them.
+static void release_parallel(void* arg) {
+  ow_parallel_release();
+}
+
+static void delete_instance(napi_env env, void* data, void* hint) {
+  struct ow_addon_instance* instance = data;
+  uv_mutex_destroy(&instance->frame_lock);
+  ow_metrics_destroy(&instance->metrics);
+  free(instance);
+}
+
+// Called once for every environment loading the addon.
+NAPI_MODULE_INIT() {
+  napi_status status;
+  napi_value export_fn;
+
+  struct ow_addon_instance* instance = calloc(1, sizeof(struct ow_addon_instance));
+  instance->env = env;
+  ow_target_state_init(&instance->target_state);
+  uv_mutex_init(&instance->frame_lock);
+  ow_metrics_init(&instance->metrics);
+  status = napi_set_instance_data(env, instance, delete_instance, NULL);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_instance_data");
+
+  ow_parallel_retain();
+  status = napi_add_env_cleanup_hook(env, release_parallel, NULL);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_add_env_cleanup_hook");
+
+  status = napi_create_function(env, NULL, 0, AddonStart, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "start", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonActivateOverlay, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "activateOverlay", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonFocusTarget, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "focusTarget", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonGetTargetState, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "getTargetState", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonGetMetrics, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "getMetrics", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonRecordApplyLatency, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "recordApplyLatency", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonResetLatency, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "resetLatency", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonListWindows, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "listWindows", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonScreenshot, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "screenshot", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonScreenshotAsync, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "screenshotAsync", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonEncodeImage, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "encodeImage", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonStartCaptureStream, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "startCaptureStream", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonStopCaptureStream, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "stopCaptureStream", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonReadFrame, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "readFrame", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonCreateChangeDetector, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "createChangeDetector", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonDetectChanges, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "detectChanges", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonCreateProbeSet, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "createProbeSet", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
+
+  status = napi_create_function(env, NULL, 0, AddonReadProbes, NULL, &export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_create_function");
+  status = napi_set_named_property(env, exports, "readProbes", export_fn);
+  NAPI_FATAL_IF_FAILED(status, "NAPI_MODULE_INIT", "napi_set_named_property");
 
   return exports;
 }
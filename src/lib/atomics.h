@@ -0,0 +1,46 @@
+#ifndef ADDON_SRC_ATOMICS_H_
+#define ADDON_SRC_ATOMICS_H_
+
+#include <stdint.h>
+
+// Minimal set of atomic operations on 32-bit integers shared between
+// the hook thread and the JS thread. C11 <stdatomic.h> is not available
+// on MSVC, so this maps to compiler intrinsics instead.
+
+#ifdef _MSC_VER
+
+#include <intrin.h>
+
+static __inline uint32_t ow_atomic_load(volatile uint32_t* ptr) {
+  return (uint32_t)_InterlockedOr((volatile long*)ptr, 0);
+}
+
+static __inline void ow_atomic_store(volatile uint32_t* ptr, uint32_t value) {
+  _InterlockedExchange((volatile long*)ptr, (long)value);
+}
+
+static __inline uint32_t ow_atomic_exchange(volatile uint32_t* ptr, uint32_t value) {
+  return (uint32_t)_InterlockedExchange((volatile long*)ptr, (long)value);
+}
+
+static __inline uint32_t ow_atomic_fetch_add(volatile uint32_t* ptr, uint32_t value) {
+  return (uint32_t)_InterlockedExchangeAdd((volatile long*)ptr, (long)value);
+}
+
+// interlocked operations are full barriers
+static __inline void ow_atomic_fence(void) {
+  volatile long barrier = 0;
+  _InterlockedOr(&barrier, 0);
+}
+
+#else
+
+#define ow_atomic_load(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define ow_atomic_store(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define ow_atomic_exchange(ptr, value) __atomic_exchange_n((ptr), (value), __ATOMIC_ACQ_REL)
+#define ow_atomic_fetch_add(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_ACQ_REL)
+#define ow_atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#endif
+
+#endif // !ADDON_SRC_ATOMICS_H_
@@ -0,0 +1,45 @@
+#include "cpu_features.h"
+
+#ifdef OW_CPU_X64
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+bool ow_cpu_has_sse42() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+bool ow_cpu_has_avx2() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return false;
+  __cpuid(info, 1);
+  // AVX and OSXSAVE
+  if ((info[2] & (1 << 28)) == 0 || (info[2] & (1 << 27)) == 0) return false;
+  // OS saves YMM registers
+  if ((_xgetbv(0) & 6) != 6) return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#else
+bool ow_cpu_has_sse42() {
+  return false;
+}
+
+bool ow_cpu_has_avx2() {
+  return false;
+}
+#endif
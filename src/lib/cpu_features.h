@@ -0,0 +1,23 @@
+#ifndef ADDON_SRC_CPU_FEATURES_H_
+#define ADDON_SRC_CPU_FEATURES_H_
+
+#include <stdbool.h>
+
+// x86-64 only, SIMD code is compiled with function-level target attributes
+// and selected at runtime. Always `false` on other architectures.
+#if defined(__x86_64__) || defined(_M_X64)
+#define OW_CPU_X64
+#ifdef _MSC_VER
+#define OW_TARGET_SSE42
+#define OW_TARGET_AVX2
+#else
+#define OW_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define OW_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+bool ow_cpu_has_sse42();
+
+bool ow_cpu_has_avx2();
+
+#endif // !ADDON_SRC_CPU_FEATURES_H_
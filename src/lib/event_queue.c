@@ -0,0 +1,189 @@
+#include <string.h>
+#include "atomics.h"
+#include "event_queue.h"
+
+#define OW_EVENT_QUEUE_MASK (OW_EVENT_QUEUE_CAPACITY - 1)
+
+void ow_event_queue_init(struct ow_event_queue* queue) {
+  memset(queue, 0, sizeof(struct ow_event_queue));
+}
+
+// Fails if `limit` entries are already in the ring.
+static bool ring_push(struct ow_event_queue* queue, struct ow_queued_event* entry, uint32_t limit) {
+  uint32_t head = queue->head;
+  if (head - ow_atomic_load(&queue->tail) >= limit) {
+    return false;
+  }
+  queue->slots[head & OW_EVENT_QUEUE_MASK] = *entry;
+  ow_atomic_store(&queue->head, head + 1);
+  return true;
+}
+
+// NULL if events of this type are not coalesced.
+static struct ow_coalesced_slot* coalesced_slot(struct ow_event_queue* queue, enum ow_event_type type, uint32_t target_id) {
+  if (type == OW_MOVERESIZE) {
+    return &queue->moveresize[target_id];
+  }
+  if (type == OW_FOCUS || type == OW_BLUR) {
+    return &queue->focus[target_id];
+  }
+  return NULL;
+}
+
+// Called by producer, the only writer of `state`.
+static void write_slot(struct ow_coalesced_slot* slot, struct ow_slot_state* state) {
+  uint32_t seq = slot->seq;
+  ow_atomic_store(&slot->seq, seq + 1);
+  ow_atomic_fence();
+  slot->state = *state;
+  ow_atomic_store(&slot->seq, seq + 2);
+}
+
+static void read_slot(struct ow_coalesced_slot* slot, struct ow_slot_state* state) {
+  uint32_t seq_begin;
+  uint32_t seq_end = 0;
+  do {
+    seq_begin = ow_atomic_load(&slot->seq);
+    if (seq_begin & 1) continue;
+    *state = slot->state;
+    ow_atomic_fence();
+    seq_end = ow_atomic_load(&slot->seq);
+  } while ((seq_begin & 1) || seq_begin != seq_end);
+}
+
+// Pushes state changed since the last seal as a copy and retires the
+// marker of it, so state written later gets a marker after this point.
+// If the copy doesn't fit, the marker stays and delivers the latest state.
+static void seal_slot(struct ow_event_queue* queue, struct ow_coalesced_slot* slot) {
+  if (slot->state.version == slot->sealed_version) {
+    return;
+  }
+  struct ow_queued_event copy = {
+    .event = slot->state.event,
+    .is_sealed = true,
+    .version = slot->state.version
+  };
+  if (!ring_push(queue, &copy, OW_EVENT_QUEUE_CAPACITY)) {
+    return;
+  }
+  slot->sealed_version = slot->state.version;
+  struct ow_slot_state state = slot->state;
+  state.epoch += 1;
+  write_slot(slot, &state);
+  ow_atomic_store(&slot->is_queued, 0);
+}
+
+bool ow_event_queue_push(struct ow_event_queue* queue, struct ow_event* event) {
+  struct ow_coalesced_slot* slot = coalesced_slot(queue, event->type, event->target_id);
+  if (slot != NULL) {
+    struct ow_slot_state state = {
+      .event = *event,
+      .version = slot->state.version + 1,
+      .epoch = slot->state.epoch
+    };
+    write_slot(slot, &state);
+    if (ow_atomic_exchange(&slot->is_queued, 1) == 1) {
+      // marker is already in the ring, consumer will see the latest state
+      return false;
+    }
+    struct ow_queued_event marker = {
+      .event = { .type = event->type, .target_id = event->target_id },
+      .epoch = state.epoch
+    };
+    if (!ring_push(queue, &marker, OW_EVENT_QUEUE_CAPACITY - OW_EVENT_QUEUE_RESERVED)) {
+      // delivered once the ring is drained
+      ow_atomic_store(&slot->is_queued, 0);
+    }
+  } else {
+    seal_slot(queue, &queue->moveresize[event->target_id]);
+    seal_slot(queue, &queue->focus[event->target_id]);
+    struct ow_queued_event entry = { .event = *event };
+    if (!ring_push(queue, &entry, OW_EVENT_QUEUE_CAPACITY)) {
+      ow_atomic_fetch_add(&queue->dropped, 1);
+      return false;
+    }
+  }
+
+  return ow_atomic_exchange(&queue->wakeup_pending, 1) == 0;
+}
+
+void ow_event_queue_begin_drain(struct ow_event_queue* queue) {
+  ow_atomic_store(&queue->wakeup_pending, 0);
+}
+
+// Returns `false` if the latest state of the slot was already delivered.
+static bool take_slot(struct ow_coalesced_slot* slot, struct ow_slot_state* state) {
+  read_slot(slot, state);
+  if (state->version == slot->consumed_version) {
+    return false;
+  }
+  slot->consumed_version = state->version;
+  return true;
+}
+
+// Delivers state changed without a marker in the ring,
+// its marker didn't fit or was consumed before the change.
+static bool pop_unqueued(struct ow_event_queue* queue, struct ow_event* event) {
+  for (uint32_t i = 0; i < OW_MAX_TARGETS; ++i) {
+    struct ow_coalesced_slot* slots[] = { &queue->moveresize[i], &queue->focus[i] };
+    for (uint32_t j = 0; j < sizeof(slots) / sizeof(slots[0]); ++j) {
+      struct ow_slot_state state;
+      if (!ow_atomic_load(&slots[j]->is_queued) && take_slot(slots[j], &state)) {
+        *event = state.event;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool ow_event_queue_pop(struct ow_event_queue* queue, struct ow_event* event) {
+  for (;;) {
+    uint32_t tail = queue->tail;
+    if (tail == ow_atomic_load(&queue->head)) {
+      return pop_unqueued(queue, event);
+    }
+    struct ow_queued_event* entry = &queue->slots[tail & OW_EVENT_QUEUE_MASK];
+    *event = entry->event;
+    bool is_sealed = entry->is_sealed;
+    uint32_t version = entry->version;
+    uint32_t epoch = entry->epoch;
+    ow_atomic_store(&queue->tail, tail + 1);
+
+    struct ow_coalesced_slot* slot = coalesced_slot(queue, event->type, event->target_id);
+    if (slot == NULL) {
+      return true;
+    }
+
+    if (is_sealed) {
+      // skipped if a marker already delivered this state
+      if (version == slot->consumed_version) {
+        continue;
+      }
+      slot->consumed_version = version;
+      return true;
+    }
+
+    // clear marker before reading, so state written after this point
+    // will be delivered by the next marker
+    ow_atomic_store(&slot->is_queued, 0);
+    ow_atomic_fence();
+    struct ow_slot_state state;
+    read_slot(slot, &state);
+    if (state.epoch != epoch) {
+      // state of this marker's epoch follows as a sealed copy
+      continue;
+    }
+    if (state.version == slot->consumed_version) {
+      // this state was already delivered by the previous marker
+      continue;
+    }
+    slot->consumed_version = state.version;
+    *event = state.event;
+    return true;
+  }
+}
+
+uint32_t ow_event_queue_dropped(struct ow_event_queue* queue) {
+  return ow_atomic_load(&queue->dropped);
+}
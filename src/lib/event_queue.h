@@ -0,0 +1,95 @@
+#ifndef ADDON_SRC_EVENT_QUEUE_H_
+#define ADDON_SRC_EVENT_QUEUE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "overlay_window.h"
+
+// must be a power of two
+#define OW_EVENT_QUEUE_CAPACITY 64
+// ring entries markers can't take, kept for events that are not coalesced
+#define OW_EVENT_QUEUE_RESERVED (2 * OW_MAX_TARGETS)
+
+// Preallocated single-producer/single-consumer queue between
+// the hook thread (producer) and the JS thread (consumer).
+//
+// `OW_MOVERESIZE` and focus changes (`OW_FOCUS`, `OW_BLUR`) are not stored
+// in the ring, only the latest bounds and focus state are kept in a separate
+// slot per target and the ring holds a marker at the position of the first
+// not yet consumed change. This way any number of them costs at most two ring
+// entries per target, and `OW_ATTACH`, `OW_DETACH` and `OW_FULLSCREEN` are
+// never queued behind stale state.
+//
+// Coalescing never crosses those events: before one of them is queued, state
+// of its target changed since the last such event is pushed as a sealed copy
+// and the pending marker is retired, so state written after it is delivered
+// after it and the relative order is preserved.
+//
+// Markers can't take the last `OW_EVENT_QUEUE_RESERVED` entries. A marker
+// that didn't fit is not needed, slots changed without a marker in the ring
+// are delivered once the ring is drained. Only events that are not coalesced
+// are lost, and counted in `dropped`, when the whole ring is full of them.
+struct ow_slot_state {
+  struct ow_event event;
+  // number of writes, identifies the state
+  uint32_t version;
+  // number of times the slot was sealed, markers of older epochs are retired
+  uint32_t epoch;
+};
+
+struct ow_coalesced_slot {
+  // guards `state`
+  volatile uint32_t seq;
+  struct ow_slot_state state;
+  // marker for the latest state is in the ring
+  volatile uint32_t is_queued;
+  // version of the last state handed out to consumer
+  uint32_t consumed_version;
+  // owned by producer, version of the last sealed copy
+  uint32_t sealed_version;
+};
+
+struct ow_queued_event {
+  struct ow_event event;
+  // coalesced types only, the entry holds a copy of the state
+  // instead of being a marker for the latest one
+  bool is_sealed;
+  // version of the copy, or epoch of the slot when the marker was pushed
+  uint32_t version;
+  uint32_t epoch;
+};
+
+struct ow_event_queue {
+  struct ow_queued_event slots[OW_EVENT_QUEUE_CAPACITY];
+  // next slot to write, owned by producer
+  volatile uint32_t head;
+  // next slot to read, owned by consumer
+  volatile uint32_t tail;
+
+  // latest-wins `OW_MOVERESIZE` of each target, indexed by `target_id`
+  struct ow_coalesced_slot moveresize[OW_MAX_TARGETS];
+  // latest-wins `OW_FOCUS` or `OW_BLUR` of each target
+  struct ow_coalesced_slot focus[OW_MAX_TARGETS];
+
+  // consumer is already scheduled to drain the queue
+  volatile uint32_t wakeup_pending;
+  // events lost because the ring was full
+  volatile uint32_t dropped;
+};
+
+void ow_event_queue_init(struct ow_event_queue* queue);
+
+// Called by producer. Returns `true` if the consumer must be woken up.
+bool ow_event_queue_push(struct ow_event_queue* queue, struct ow_event* event);
+
+// Called by consumer once before draining, any event pushed after this
+// will request another wakeup.
+void ow_event_queue_begin_drain(struct ow_event_queue* queue);
+
+// Called by consumer. Returns `false` when the queue is empty.
+bool ow_event_queue_pop(struct ow_event_queue* queue, struct ow_event* event);
+
+// Number of events lost since `ow_event_queue_init`, can be read from any thread.
+uint32_t ow_event_queue_dropped(struct ow_event_queue* queue);
+
+#endif // !ADDON_SRC_EVENT_QUEUE_H_
@@ -0,0 +1,33 @@
+#include "frame_damage.h"
+
+static void bounding_box(struct ow_window_bounds* box, const struct ow_window_bounds* rect) {
+  int32_t right = box->x + (int32_t)box->width;
+  int32_t bottom = box->y + (int32_t)box->height;
+  int32_t rect_right = rect->x + (int32_t)rect->width;
+  int32_t rect_bottom = rect->y + (int32_t)rect->height;
+  if (rect->x < box->x) box->x = rect->x;
+  if (rect->y < box->y) box->y = rect->y;
+  if (rect_right > right) right = rect_right;
+  if (rect_bottom > bottom) bottom = rect_bottom;
+  box->width = (uint32_t)(right - box->x);
+  box->height = (uint32_t)(bottom - box->y);
+}
+
+void ow_frame_damage_add(struct ow_frame_damage* damage, const struct ow_window_bounds* rect) {
+  if (damage->count < OW_FRAME_MAX_RECTS) {
+    damage->rects[damage->count] = *rect;
+    damage->count += 1;
+    return;
+  }
+  for (uint32_t i = 1; i < damage->count; ++i) {
+    bounding_box(&damage->rects[0], &damage->rects[i]);
+  }
+  bounding_box(&damage->rects[0], rect);
+  damage->count = 1;
+}
+
+void ow_frame_damage_merge(struct ow_frame_damage* damage, const struct ow_frame_damage* other) {
+  for (uint32_t i = 0; i < other->count; ++i) {
+    ow_frame_damage_add(damage, &other->rects[i]);
+  }
+}
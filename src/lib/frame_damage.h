@@ -0,0 +1,10 @@
+#ifndef ADDON_SRC_FRAME_DAMAGE_H_
+#define ADDON_SRC_FRAME_DAMAGE_H_
+
+#include "overlay_window.h"
+
+void ow_frame_damage_add(struct ow_frame_damage* damage, const struct ow_window_bounds* rect);
+
+void ow_frame_damage_merge(struct ow_frame_damage* damage, const struct ow_frame_damage* other);
+
+#endif // !ADDON_SRC_FRAME_DAMAGE_H_
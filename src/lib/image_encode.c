@@ -0,0 +1,575 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+#include "image_encode.h"
+#include "parallel.h"
+
+// Stripes are independent, pixels per stripe are fixed so
+// the output doesn't depend on the number of threads.
+#define OW_ENCODE_STRIPE_PIXELS 262144
+
+static uv_once_t tables_once = UV_ONCE_INIT;
+
+static void put_u32_be(uint8_t* out, uint32_t value) {
+  out[0] = (uint8_t)(value >> 24);
+  out[1] = (uint8_t)(value >> 16);
+  out[2] = (uint8_t)(value >> 8);
+  out[3] = (uint8_t)value;
+}
+
+static uint32_t stripe_rows(uint32_t width) {
+  uint32_t rows = OW_ENCODE_STRIPE_PIXELS / (width ? width : 1);
+  return rows ? rows : 1;
+}
+
+// PNG: every stripe is a separate IDAT chunk with its own deflate blocks.
+// Stripes end with a sync flush, so they can be concatenated into one
+// zlib stream. Deflate uses fixed Huffman codes and greedy LZ77 with a
+// single-entry hash table, roughly what zlib does at level 1.
+
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_MIN_MATCH 4
+#define DEFLATE_MAX_MATCH 258
+#define ADLER_BASE 65521
+
+static uint32_t crc_table[256];
+// fixed Huffman codes, bit-reversed for LSB-first output
+static uint16_t lit_code[288];
+static uint8_t lit_bits[288];
+// code of the length symbol and its extra bits combined
+static uint32_t len_code[DEFLATE_MAX_MATCH + 1];
+static uint8_t len_bits[DEFLATE_MAX_MATCH + 1];
+static uint8_t dist_symbol[DEFLATE_WINDOW + 1];
+
+static const uint16_t len_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t len_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static uint32_t reverse_bits(uint32_t code, uint32_t count) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    result = (result << 1) | ((code >> i) & 1);
+  }
+  return result;
+}
+
+static void tables_init(void) {
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+    crc_table[i] = crc;
+  }
+
+  for (uint32_t symbol = 0; symbol < 288; ++symbol) {
+    uint32_t code, bits;
+    if (symbol < 144) { code = 0x30 + symbol; bits = 8; }
+    else if (symbol < 256) { code = 0x190 + (symbol - 144); bits = 9; }
+    else if (symbol < 280) { code = symbol - 256; bits = 7; }
+    else { code = 0xC0 + (symbol - 280); bits = 8; }
+    lit_code[symbol] = (uint16_t)reverse_bits(code, bits);
+    lit_bits[symbol] = (uint8_t)bits;
+  }
+
+  for (uint32_t i = 0; i < 29; ++i) {
+    uint32_t last = (i + 1 < 29) ? len_base[i + 1] : DEFLATE_MAX_MATCH + 1;
+    // 258 has its own symbol without extra bits
+    if (i == 27) last = DEFLATE_MAX_MATCH;
+    for (uint32_t length = len_base[i]; length < last; ++length) {
+      uint32_t symbol = 257 + i;
+      len_code[length] = lit_code[symbol] | ((length - len_base[i]) << lit_bits[symbol]);
+      len_bits[length] = (uint8_t)(lit_bits[symbol] + len_extra[i]);
+    }
+  }
+
+  for (uint32_t i = 0; i < 30; ++i) {
+    uint32_t last = (i + 1 < 30) ? dist_base[i + 1] : DEFLATE_WINDOW + 1;
+    for (uint32_t distance = dist_base[i]; distance < last; ++distance) {
+      dist_symbol[distance] = (uint8_t)i;
+    }
+  }
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+static uint32_t adler32(const uint8_t* data, size_t length) {
+  uint32_t a = 1;
+  uint32_t b = 0;
+  while (length > 0) {
+    // largest n such that sums don't overflow before the modulo
+    size_t n = (length < 5552) ? length : 5552;
+    length -= n;
+    while (n--) {
+      a += *data++;
+      b += a;
+    }
+    a %= ADLER_BASE;
+    b %= ADLER_BASE;
+  }
+  return (b << 16) | a;
+}
+
+// Adler-32 of two concatenated blocks, `length` is the size of the second one.
+static uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t length) {
+  uint32_t rem = (uint32_t)(length % ADLER_BASE);
+  uint32_t sum1 = adler1 & 0xFFFF;
+  uint32_t sum2 = (uint32_t)(((uint64_t)rem * sum1) % ADLER_BASE);
+  sum1 += (adler2 & 0xFFFF) + ADLER_BASE - 1;
+  sum2 += ((adler1 >> 16) & 0xFFFF) + ((adler2 >> 16) & 0xFFFF) + ADLER_BASE - rem;
+  if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+  if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+  if (sum2 >= ((uint32_t)ADLER_BASE << 1)) sum2 -= ((uint32_t)ADLER_BASE << 1);
+  if (sum2 >= ADLER_BASE) sum2 -= ADLER_BASE;
+  return sum1 | (sum2 << 16);
+}
+
+struct bit_writer {
+  uint8_t* out;
+  size_t pos;
+  uint64_t bits;
+  uint32_t count;
+};
+
+static void put_bits(struct bit_writer* bw, uint32_t value, uint32_t count) {
+  bw->bits |= (uint64_t)value << bw->count;
+  bw->count += count;
+  if (bw->count >= 32) {
+    bw->out[bw->pos++] = (uint8_t)bw->bits;
+    bw->out[bw->pos++] = (uint8_t)(bw->bits >> 8);
+    bw->out[bw->pos++] = (uint8_t)(bw->bits >> 16);
+    bw->out[bw->pos++] = (uint8_t)(bw->bits >> 24);
+    bw->bits >>= 32;
+    bw->count -= 32;
+  }
+}
+
+static void align_to_byte(struct bit_writer* bw) {
+  while (bw->count > 0) {
+    bw->out[bw->pos++] = (uint8_t)bw->bits;
+    bw->bits >>= 8;
+    bw->count = (bw->count > 8) ? bw->count - 8 : 0;
+  }
+  bw->bits = 0;
+}
+
+static uint32_t read_u32(const uint8_t* data) {
+  uint32_t value;
+  memcpy(&value, data, 4);
+  return value;
+}
+
+static void deflate_data(struct bit_writer* bw, const uint8_t* in, size_t length, bool is_last, int32_t* table) {
+  for (size_t i = 0; i < ((size_t)1 << DEFLATE_HASH_BITS); ++i) {
+    table[i] = -1;
+  }
+  // block header: BFINAL, BTYPE = 01 (fixed Huffman)
+  put_bits(bw, is_last ? 1 : 0, 1);
+  put_bits(bw, 1, 2);
+
+  size_t i = 0;
+  while (i + DEFLATE_MIN_MATCH <= length) {
+    uint32_t value = read_u32(in + i);
+    uint32_t hash = (value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+    int32_t candidate = table[hash];
+    table[hash] = (int32_t)i;
+    if (candidate >= 0 && i - (size_t)candidate <= DEFLATE_WINDOW && read_u32(in + candidate) == value) {
+      size_t max_length = (length - i < DEFLATE_MAX_MATCH) ? length - i : DEFLATE_MAX_MATCH;
+      size_t match = DEFLATE_MIN_MATCH;
+      while (match < max_length && in[candidate + match] == in[i + match]) {
+        match += 1;
+      }
+      uint32_t distance = (uint32_t)(i - (size_t)candidate);
+      uint32_t symbol = dist_symbol[distance];
+      put_bits(bw, len_code[match], len_bits[match]);
+      // fixed distance codes are 5 bits
+      put_bits(bw, reverse_bits(symbol, 5) | ((distance - dist_base[symbol]) << 5), 5 + dist_extra[symbol]);
+      i += match;
+    } else {
+      put_bits(bw, lit_code[in[i]], lit_bits[in[i]]);
+      i += 1;
+    }
+  }
+  for (; i < length; ++i) {
+    put_bits(bw, lit_code[in[i]], lit_bits[in[i]]);
+  }
+  // end of block
+  put_bits(bw, lit_code[256], lit_bits[256]);
+
+  if (!is_last) {
+    // sync flush: empty stored block, ends on a byte boundary
+    put_bits(bw, 0, 3);
+    align_to_byte(bw);
+    put_bits(bw, 0x0000, 16);
+    put_bits(bw, 0xFFFF, 16);
+  }
+  align_to_byte(bw);
+}
+
+struct png_stripe {
+  // IDAT payload
+  uint8_t* data;
+  size_t size;
+  // of the filtered rows
+  uint32_t adler;
+  size_t raw_size;
+  // running CRC of "IDAT" and the payload, not finalized
+  uint32_t crc;
+};
+
+struct png_ctx {
+  const uint8_t* data;
+  size_t stride;
+  uint32_t width;
+  uint32_t height;
+  uint32_t rows_per_stripe;
+  uint32_t stripe_count;
+  struct png_stripe* stripes;
+  bool is_failed;
+};
+
+static void png_encode_stripes(void* arg, uint32_t begin, uint32_t end) {
+  struct png_ctx* ctx = (struct png_ctx*)arg;
+  size_t row_size = 1 + (size_t)ctx->width * 3;
+  int32_t* table = malloc(((size_t)1 << DEFLATE_HASH_BITS) * sizeof(int32_t));
+  uint8_t* raw = malloc(ctx->rows_per_stripe * row_size);
+  if (table == NULL || raw == NULL) {
+    ctx->is_failed = true;
+    goto cleanup;
+  }
+
+  for (uint32_t s = begin; s < end; ++s) {
+    struct png_stripe* stripe = &ctx->stripes[s];
+    uint32_t y_begin = s * ctx->rows_per_stripe;
+    uint32_t y_end = (y_begin + ctx->rows_per_stripe < ctx->height) ? y_begin + ctx->rows_per_stripe : ctx->height;
+
+    // BGRA -> RGB with the Up filter, rows above the stripe are still available
+    uint8_t* out = raw;
+    for (uint32_t y = y_begin; y < y_end; ++y) {
+      const uint8_t* row = ctx->data + y * ctx->stride;
+      *out++ = 2;
+      if (y == 0) {
+        for (uint32_t x = 0; x < ctx->width; ++x) {
+          *out++ = row[x * 4 + 2];
+          *out++ = row[x * 4 + 1];
+          *out++ = row[x * 4 + 0];
+        }
+      } else {
+        const uint8_t* above = row - ctx->stride;
+        for (uint32_t x = 0; x < ctx->width; ++x) {
+          *out++ = (uint8_t)(row[x * 4 + 2] - above[x * 4 + 2]);
+          *out++ = (uint8_t)(row[x * 4 + 1] - above[x * 4 + 1]);
+          *out++ = (uint8_t)(row[x * 4 + 0] - above[x * 4 + 0]);
+        }
+      }
+    }
+    stripe->raw_size = (size_t)(out - raw);
+    stripe->adler = adler32(raw, stripe->raw_size);
+
+    // zlib header, 9 bits per literal at worst, sync flush, adler
+    bool is_first = (s == 0);
+    bool is_last = (s + 1 == ctx->stripe_count);
+    stripe->data = malloc(2 + stripe->raw_size * 9 / 8 + 64);
+    if (stripe->data == NULL) {
+      ctx->is_failed = true;
+      goto cleanup;
+    }
+    struct bit_writer bw = { .out = stripe->data, .pos = 0, .bits = 0, .count = 0 };
+    if (is_first) {
+      // deflate, 32K window, fastest
+      bw.out[bw.pos++] = 0x78;
+      bw.out[bw.pos++] = 0x01;
+    }
+    deflate_data(&bw, raw, stripe->raw_size, is_last, table);
+    stripe->size = bw.pos;
+    stripe->crc = crc32_update(crc32_update(0xFFFFFFFF, (const uint8_t*)"IDAT", 4), stripe->data, stripe->size);
+  }
+
+cleanup:
+  free(table);
+  free(raw);
+}
+
+static void png_write_chunk(uint8_t** out, const char* type, const uint8_t* data, uint32_t length) {
+  put_u32_be(*out, length);
+  memcpy(*out + 4, type, 4);
+  if (length) memcpy(*out + 8, data, length);
+  put_u32_be(*out + 8 + length, ~crc32_update(0xFFFFFFFF, *out + 4, length + 4));
+  *out += 12 + length;
+}
+
+static uint8_t* png_encode(const uint8_t* data, size_t stride, uint32_t width, uint32_t height, size_t* size) {
+  struct png_ctx ctx = {
+    .data = data,
+    .stride = stride,
+    .width = width,
+    .height = height,
+    .rows_per_stripe = stripe_rows(width),
+    .is_failed = false
+  };
+  ctx.stripe_count = (height + ctx.rows_per_stripe - 1) / ctx.rows_per_stripe;
+  if (ctx.stripe_count == 0) {
+    // IDAT must contain a valid zlib stream even for an empty image
+    ctx.stripe_count = 1;
+  }
+  ctx.stripes = calloc(ctx.stripe_count, sizeof(struct png_stripe));
+  if (ctx.stripes == NULL) return NULL;
+  ow_parallel_for(ctx.stripe_count, 1, png_encode_stripes, &ctx);
+
+  uint8_t* result = NULL;
+  if (ctx.is_failed) goto cleanup;
+
+  uint32_t adler = 1;
+  size_t total = 8 + (12 + 13) + 12;
+  for (uint32_t s = 0; s < ctx.stripe_count; ++s) {
+    adler = adler32_combine(adler, ctx.stripes[s].adler, ctx.stripes[s].raw_size);
+    total += 12 + ctx.stripes[s].size;
+  }
+  // adler is appended to the last IDAT
+  total += 4;
+
+  result = malloc(total);
+  if (result == NULL) goto cleanup;
+  uint8_t* out = result;
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  memcpy(out, signature, 8);
+  out += 8;
+
+  uint8_t ihdr[13];
+  put_u32_be(ihdr, width);
+  put_u32_be(ihdr + 4, height);
+  // 8-bit RGB, deflate, adaptive filtering, no interlace
+  ihdr[8] = 8;
+  ihdr[9] = 2;
+  ihdr[10] = 0;
+  ihdr[11] = 0;
+  ihdr[12] = 0;
+  png_write_chunk(&out, "IHDR", ihdr, 13);
+
+  for (uint32_t s = 0; s < ctx.stripe_count; ++s) {
+    struct png_stripe* stripe = &ctx.stripes[s];
+    bool is_last = (s + 1 == ctx.stripe_count);
+    uint32_t length = (uint32_t)stripe->size + (is_last ? 4 : 0);
+    put_u32_be(out, length);
+    memcpy(out + 4, "IDAT", 4);
+    memcpy(out + 8, stripe->data, stripe->size);
+    uint32_t crc = stripe->crc;
+    if (is_last) {
+      put_u32_be(out + 8 + stripe->size, adler);
+      crc = crc32_update(crc, out + 8 + stripe->size, 4);
+    }
+    put_u32_be(out + 8 + length, ~crc);
+    out += 12 + length;
+  }
+  png_write_chunk(&out, "IEND", NULL, 0);
+  *size = (size_t)(out - result);
+
+cleanup:
+  for (uint32_t s = 0; s < ctx.stripe_count; ++s) {
+    free(ctx.stripes[s].data);
+  }
+  free(ctx.stripes);
+  return result;
+}
+
+// QOI: the encoder state at the start of a stripe (previous pixel and the
+// index of recently seen pixels) only depends on pixels before it, so it's
+// computed upfront and stripes are encoded independently. Output is the
+// same as from a sequential encoder, except runs are split at stripe edges.
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xC0
+#define QOI_OP_RGB 0xFE
+
+// r, g, b, a from low to high byte, alpha is always 255
+static uint32_t qoi_pixel(const uint8_t* bgra) {
+  return (uint32_t)bgra[2] | ((uint32_t)bgra[1] << 8) | ((uint32_t)bgra[0] << 16) | 0xFF000000u;
+}
+
+static uint32_t qoi_hash(uint32_t px) {
+  uint32_t r = px & 0xFF;
+  uint32_t g = (px >> 8) & 0xFF;
+  uint32_t b = (px >> 16) & 0xFF;
+  return (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+}
+
+struct qoi_stripe {
+  // last pixel of every hash in the stripe, 0 if none
+  uint32_t seen[64];
+  uint8_t* data;
+  size_t size;
+};
+
+struct qoi_ctx {
+  const uint8_t* data;
+  size_t stride;
+  uint32_t width;
+  uint32_t height;
+  uint32_t rows_per_stripe;
+  uint32_t stripe_count;
+  struct qoi_stripe* stripes;
+  bool is_failed;
+};
+
+static void qoi_scan_stripes(void* arg, uint32_t begin, uint32_t end) {
+  struct qoi_ctx* ctx = (struct qoi_ctx*)arg;
+  for (uint32_t s = begin; s < end; ++s) {
+    struct qoi_stripe* stripe = &ctx->stripes[s];
+    uint32_t y_begin = s * ctx->rows_per_stripe;
+    uint32_t y_end = (y_begin + ctx->rows_per_stripe < ctx->height) ? y_begin + ctx->rows_per_stripe : ctx->height;
+    memset(stripe->seen, 0, sizeof(stripe->seen));
+    for (uint32_t y = y_begin; y < y_end; ++y) {
+      const uint8_t* row = ctx->data + y * ctx->stride;
+      for (uint32_t x = 0; x < ctx->width; ++x) {
+        uint32_t px = qoi_pixel(row + x * 4);
+        stripe->seen[qoi_hash(px)] = px;
+      }
+    }
+  }
+}
+
+static void qoi_encode_stripes(void* arg, uint32_t begin, uint32_t end) {
+  struct qoi_ctx* ctx = (struct qoi_ctx*)arg;
+  for (uint32_t s = begin; s < end; ++s) {
+    struct qoi_stripe* stripe = &ctx->stripes[s];
+    uint32_t y_begin = s * ctx->rows_per_stripe;
+    uint32_t y_end = (y_begin + ctx->rows_per_stripe < ctx->height) ? y_begin + ctx->rows_per_stripe : ctx->height;
+
+    // merge what previous stripes have seen, later stripes win
+    uint32_t index[64];
+    memset(index, 0, sizeof(index));
+    for (uint32_t prev = 0; prev < s; ++prev) {
+      for (int i = 0; i < 64; ++i) {
+        if (ctx->stripes[prev].seen[i] != 0) index[i] = ctx->stripes[prev].seen[i];
+      }
+    }
+    uint32_t px_prev = 0xFF000000u;
+    if (y_begin > 0) {
+      px_prev = qoi_pixel(ctx->data + (y_begin - 1) * ctx->stride + (size_t)(ctx->width - 1) * 4);
+    }
+
+    // 4 bytes per pixel at worst
+    stripe->data = malloc((size_t)(y_end - y_begin) * ctx->width * 4 + 1);
+    if (stripe->data == NULL) {
+      ctx->is_failed = true;
+      return;
+    }
+    uint8_t* out = stripe->data;
+    uint32_t run = 0;
+    for (uint32_t y = y_begin; y < y_end; ++y) {
+      const uint8_t* row = ctx->data + y * ctx->stride;
+      for (uint32_t x = 0; x < ctx->width; ++x) {
+        uint32_t px = qoi_pixel(row + x * 4);
+        if (px == px_prev) {
+          run += 1;
+          if (run == 62) {
+            *out++ = QOI_OP_RUN | (uint8_t)(run - 1);
+            run = 0;
+          }
+          continue;
+        }
+        if (run > 0) {
+          *out++ = QOI_OP_RUN | (uint8_t)(run - 1);
+          run = 0;
+        }
+
+        uint32_t hash = qoi_hash(px);
+        if (index[hash] == px) {
+          *out++ = QOI_OP_INDEX | (uint8_t)hash;
+        } else {
+          index[hash] = px;
+          int8_t dr = (int8_t)((px & 0xFF) - (px_prev & 0xFF));
+          int8_t dg = (int8_t)(((px >> 8) & 0xFF) - ((px_prev >> 8) & 0xFF));
+          int8_t db = (int8_t)(((px >> 16) & 0xFF) - ((px_prev >> 16) & 0xFF));
+          int8_t dr_dg = (int8_t)(dr - dg);
+          int8_t db_dg = (int8_t)(db - dg);
+          if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+            *out++ = QOI_OP_DIFF | (uint8_t)((dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+          } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+            *out++ = QOI_OP_LUMA | (uint8_t)(dg + 32);
+            *out++ = (uint8_t)((dr_dg + 8) << 4 | (db_dg + 8));
+          } else {
+            *out++ = QOI_OP_RGB;
+            *out++ = (uint8_t)(px & 0xFF);
+            *out++ = (uint8_t)((px >> 8) & 0xFF);
+            *out++ = (uint8_t)((px >> 16) & 0xFF);
+          }
+        }
+        px_prev = px;
+      }
+    }
+    if (run > 0) {
+      *out++ = QOI_OP_RUN | (uint8_t)(run - 1);
+    }
+    stripe->size = (size_t)(out - stripe->data);
+  }
+}
+
+static uint8_t* qoi_encode(const uint8_t* data, size_t stride, uint32_t width, uint32_t height, size_t* size) {
+  struct qoi_ctx ctx = {
+    .data = data,
+    .stride = stride,
+    .width = width,
+    .height = height,
+    .rows_per_stripe = stripe_rows(width),
+    .is_failed = false
+  };
+  ctx.stripe_count = (height + ctx.rows_per_stripe - 1) / ctx.rows_per_stripe;
+  ctx.stripes = calloc(ctx.stripe_count ? ctx.stripe_count : 1, sizeof(struct qoi_stripe));
+  if (ctx.stripes == NULL) return NULL;
+  ow_parallel_for(ctx.stripe_count, 1, qoi_scan_stripes, &ctx);
+  ow_parallel_for(ctx.stripe_count, 1, qoi_encode_stripes, &ctx);
+
+  uint8_t* result = NULL;
+  if (ctx.is_failed) goto cleanup;
+
+  size_t total = 14 + 8;
+  for (uint32_t s = 0; s < ctx.stripe_count; ++s) {
+    total += ctx.stripes[s].size;
+  }
+  result = malloc(total);
+  if (result == NULL) goto cleanup;
+
+  uint8_t* out = result;
+  memcpy(out, "qoif", 4);
+  put_u32_be(out + 4, width);
+  put_u32_be(out + 8, height);
+  // RGB, sRGB with linear alpha
+  out[12] = 3;
+  out[13] = 0;
+  out += 14;
+  for (uint32_t s = 0; s < ctx.stripe_count; ++s) {
+    memcpy(out, ctx.stripes[s].data, ctx.stripes[s].size);
+    out += ctx.stripes[s].size;
+  }
+  static const uint8_t padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+  memcpy(out, padding, 8);
+  out += 8;
+  *size = (size_t)(out - result);
+
+cleanup:
+  for (uint32_t s = 0; s < ctx.stripe_count; ++s) {
+    free(ctx.stripes[s].data);
+  }
+  free(ctx.stripes);
+  return result;
+}
+
+uint8_t* ow_image_encode(enum ow_image_encoding encoding, const uint8_t* data, size_t stride, uint32_t width, uint32_t height, size_t* size) {
+  uv_once(&tables_once, tables_init);
+  *size = 0;
+  if (encoding == OW_ENCODING_QOI) {
+    return qoi_encode(data, stride, width, height, size);
+  }
+  return png_encode(data, stride, width, height, size);
+}
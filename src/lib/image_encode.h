@@ -0,0 +1,17 @@
+#ifndef ADDON_SRC_IMAGE_ENCODE_H_
+#define ADDON_SRC_IMAGE_ENCODE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum ow_image_encoding {
+  OW_ENCODING_PNG = 0,
+  OW_ENCODING_QOI
+};
+
+// Encodes a BGRA image as opaque RGB, alpha is ignored because captures don't
+// have a meaningful one. Large images are encoded in stripes on multiple threads.
+// Returns NULL if out of memory, free the result with `free`.
+uint8_t* ow_image_encode(enum ow_image_encoding encoding, const uint8_t* data, size_t stride, uint32_t width, uint32_t height, size_t* size);
+
+#endif // !ADDON_SRC_IMAGE_ENCODE_H_
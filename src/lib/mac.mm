@@ -1,4 +1,5 @@
 #import "mac/OWFullscreenObserver.h"
+#include "matcher.h"
 #include "overlay_window.h"
 #import <AppKit/AppKit.h>
 #import <ApplicationServices/ApplicationServices.h>
@@ -84,6 +85,42 @@ static struct ow_frontmost_app frontmostInfo = {
     .pid = -1, .windowID = 0, .element = NULL, .observer = NULL};
 
 static OWFullscreenObserver *fullscreenObserver = NULL;
+static id activeSpaceObserver = NULL;
+static id activateApplicationObserver = NULL;
+
+static uv_thread_t hook_tid;
+
+/** Matcher passed to `ow_start_hook`, freed once the hook is stopped */
+static struct ow_matcher *targetMatcher = NULL;
+
+/**
+ * Backend runs one hook per process, another one can be started once it's
+ * stopped.
+ */
+struct ow_hook {
+  /** Guards `context` and `isStarted` */
+  uv_mutex_t lock;
+  void *context;
+  bool isStarted;
+  bool hasThread;
+  /** Cleared by `ow_stop_hook`, notifications are ignored after that */
+  volatile bool isRunning;
+  /** Run loop of the hook thread, all observers are handled on it */
+  CFRunLoopRef runLoop;
+  /** Posted by the hook thread once `runLoop` is set */
+  uv_sem_t threadReady;
+};
+
+static uv_once_t hookInitOnce = UV_ONCE_INIT;
+static struct ow_hook processHook;
+
+static void emitEvent(struct ow_event *e) {
+  uv_mutex_lock(&processHook.lock);
+  if (processHook.context != NULL) {
+    ow_emit_event(processHook.context, e);
+  }
+  uv_mutex_unlock(&processHook.lock);
+}
 
 // Window notifications: these are attached to the target window.
 // These must be handled by `hookProcTargetWindow`.
@@ -229,7 +266,7 @@ static void maybeEmitMoveResizeEvent(CGWindowID windowID) {
     if (!areBoundsEqual(bounds, previousBounds)) {
       struct ow_event e = {.type = OW_MOVERESIZE,
                            .data.moveresize = {.bounds = bounds}};
-      ow_emit_event(&e);
+      emitEvent(&e);
       previousBounds = bounds;
       // NSLog(@"maybeEmitMoveResizeEvent: x %d y %d width %d height %d",
       // bounds.x,
@@ -238,10 +275,25 @@ static void maybeEmitMoveResizeEvent(CGWindowID windowID) {
   }
 }
 
+/**
+ * Runs `block` on the hook thread, workspace notifications are delivered on
+ * the thread posting them.
+ */
+static void performOnHookThread(void (^block)(void)) {
+  if (!processHook.isRunning) {
+    return;
+  }
+  CFRunLoopPerformBlock(processHook.runLoop, kCFRunLoopDefaultMode, block);
+  CFRunLoopWakeUp(processHook.runLoop);
+}
+
 /**
  * Calls checkAndHandleWindow with the latest window
  */
 static void handleFocusMaybeChanged() {
+  if (!processHook.isRunning) {
+    return;
+  }
   pid_t frontmostPID = getFrontmostAppPID();
   AXUIElementRef frontmostWindow = copyFrontmostWindow(frontmostPID);
 
@@ -462,13 +514,13 @@ static void checkAndHandleWindow(pid_t pid, AXUIElementRef frontmostWindow) {
     targetInfo.isFocused = true;
     struct ow_event e = {.type = OW_FOCUS};
     // NSLog(@"checkAndHandleWindow: focus");
-    ow_emit_event(&e);
+    emitEvent(&e);
   } else if (!targetFocused && targetInfo.isFocused) {
     if (targetInfo.isDestroyed || frontmostWindowID != overlayWindowID) {
       targetInfo.isFocused = false;
       struct ow_event e = {.type = OW_BLUR};
       // NSLog(@"checkAndHandleWindow: blur");
-      ow_emit_event(&e);
+      emitEvent(&e);
     }
 
     if (targetInfo.isDestroyed) {
@@ -477,7 +529,7 @@ static void checkAndHandleWindow(pid_t pid, AXUIElementRef frontmostWindow) {
       struct ow_event e = {.type = OW_DETACH};
       clearWindowInfo(targetInfo, windowNotificationTypes);
       // NSLog(@"checkAndHandleWindow: detach");
-      ow_emit_event(&e);
+      emitEvent(&e);
     }
   }
 
@@ -489,7 +541,7 @@ static void checkAndHandleWindow(pid_t pid, AXUIElementRef frontmostWindow) {
     struct ow_event e = {.type = OW_FULLSCREEN,
                          .data.fullscreen = {.is_fullscreen = fullscreen}};
     // NSLog(@"checkAndHandleWindow: fullscreen %d", fullscreen ? 1 : 0);
-    ow_emit_event(&e);
+    emitEvent(&e);
   }
 
   frontmostInfo.windowID = frontmostWindowID;
@@ -529,16 +581,17 @@ static void checkAndHandleWindow(pid_t pid, AXUIElementRef frontmostWindow) {
       .type = OW_ATTACH,
       // has_access is set to -1 for undefined
       .data.attach = {.has_access = -1, .is_fullscreen = fullscreen}};
+  e.data.attach.window_id = frontmostWindowID;
   bool getBoundsSuccess = getBounds(frontmostWindowID, &e.data.attach.bounds);
   if (getBoundsSuccess) {
     // emit OW_ATTACH
-    ow_emit_event(&e);
+    emitEvent(&e);
     // NSLog(@"checkAndHandleWindow: attach");
 
     targetInfo.isFocused = true;
     e.type = OW_FOCUS;
     // NSLog(@"checkAndHandleWindow: post-attach focus");
-    ow_emit_event(&e);
+    emitEvent(&e);
   } else {
     // something went wrong, did the target window die right after becoming
     // active?
@@ -556,7 +609,7 @@ static void waitUntilAccessibilityGranted() {
       @{trustedCheckOptionPromptKey : @YES}));
   // NSLog(@"waitUntilAccessibilityGranted: initial %d", trusted);
 
-  while (!trusted) {
+  while (!trusted && processHook.isRunning) {
     [NSThread sleepForTimeInterval:1.0];
     // NSLog(@"waitUntilAccessibilityGranted: polling");
     trusted = AXIsProcessTrustedWithOptions(static_cast<CFDictionaryRef>(
@@ -578,8 +631,10 @@ static void observeFullscreen() {
   fullscreenObserver = [OWFullscreenObserver alloc];
 
   void (^onPossibleFullscreen)(void) = ^() {
-    handleFocusMaybeChanged();
-    pollForWindowChanges();
+    performOnHookThread(^() {
+      handleFocusMaybeChanged();
+      pollForWindowChanges();
+    });
   };
   [fullscreenObserver addBlock:onPossibleFullscreen];
 
@@ -590,13 +645,15 @@ static void observeFullscreen() {
            options:NSKeyValueObservingOptionNew
            context:NULL];
 
-  [[[NSWorkspace sharedWorkspace] notificationCenter]
+  activeSpaceObserver = [[[NSWorkspace sharedWorkspace] notificationCenter]
       addObserverForName:NSWorkspaceActiveSpaceDidChangeNotification
                   object:NULL
                    queue:NULL
               usingBlock:^(NSNotification *note) {
-                handleFocusMaybeChanged();
-                pollForWindowChanges();
+                performOnHookThread(^() {
+                  handleFocusMaybeChanged();
+                  pollForWindowChanges();
+                });
               }];
 }
 
@@ -608,7 +665,8 @@ static void observeFullscreen() {
  * information update much more quickly too.
  */
 static void observeActivateApplication() {
-  [[[NSWorkspace sharedWorkspace] notificationCenter]
+  activateApplicationObserver = [[[NSWorkspace sharedWorkspace]
+      notificationCenter]
       addObserverForName:NSWorkspaceDidActivateApplicationNotification
                   object:NULL
                    queue:NULL
@@ -616,27 +674,82 @@ static void observeActivateApplication() {
                 // NSRunningApplication *app =
                 //     [note.userInfo objectForKey:NSWorkspaceApplicationKey];
                 // NSLog(@"observeActivateApplication %@", app.localizedName);
-                handleFocusMaybeChanged();
+                performOnHookThread(^() {
+                  handleFocusMaybeChanged();
+                });
               }];
 }
 
+/**
+ * Removes all observers created by the hook thread, called on it once the
+ * RunLoop is stopped.
+ */
+static void stopObserving() {
+  if (latestTimer) {
+    [latestTimer invalidate];
+    latestTimer = NULL;
+  }
+  clearWindowInfo(targetInfo, windowNotificationTypes);
+  clearWindowInfo(frontmostInfo, appFocusNotificationTypes);
+
+  NSNotificationCenter *center =
+      [[NSWorkspace sharedWorkspace] notificationCenter];
+  [center removeObserver:activeSpaceObserver];
+  [center removeObserver:activateApplicationObserver];
+  activeSpaceObserver = NULL;
+  activateApplicationObserver = NULL;
+  if (fullscreenObserver) {
+    [[NSApplication sharedApplication]
+        removeObserver:fullscreenObserver
+            forKeyPath:@"currentSystemPresentationOptions"];
+    fullscreenObserver = NULL;
+  }
+}
+
 /**
  * Initializes listeners for the frontmost window, and then starts the event
  * loop.
  */
 static void hookThread(void *_arg) {
+  processHook.runLoop = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+  uv_sem_post(&processHook.threadReady);
+
   observeFullscreen();
   observeActivateApplication();
   waitUntilAccessibilityGranted();
   handleFocusMaybeChanged();
 
   // Start the RunLoop so that our AXObservers added by CFRunLoopAddSource
-  // work properly
-  CFRunLoopRun();
+  // work properly. Returns once `ow_stop_hook` stops it.
+  if (processHook.isRunning) {
+    CFRunLoopRun();
+  }
+  stopObserving();
 }
 
-void ow_start_hook(char *target_window_title, void *overlay_window_id) {
-  targetInfo.title = target_window_title;
+static void initHook() {
+  uv_mutex_init(&processHook.lock);
+  uv_sem_init(&processHook.threadReady, 0);
+}
+
+struct ow_hook *ow_start_hook(struct ow_matcher *matcher,
+                              void *overlay_window_id,
+                              struct ow_hook_options *options, void *context) {
+  uv_once(&hookInitOnce, initHook);
+  uv_mutex_lock(&processHook.lock);
+  bool isStarted = processHook.isStarted;
+  if (!isStarted) {
+    processHook.isStarted = true;
+    processHook.context = context;
+  }
+  uv_mutex_unlock(&processHook.lock);
+  if (isStarted) {
+    return NULL;
+  }
+
+  // only exact title is supported, see `ow_matcher_compile`
+  targetMatcher = matcher;
+  targetInfo.title = matcher->title;
   if (overlay_window_id != NULL) {
     // Cast to a weak pointer to avoid taking ownership of the view
     NSView *overlayView = *(NSView * __weak *)(overlay_window_id);
@@ -644,14 +757,54 @@ void ow_start_hook(char *target_window_title, void *overlay_window_id) {
     overlayInfo.window = overlayWindow;
   }
 
-  uv_thread_create(&hook_tid, hookThread, NULL);
+  processHook.isRunning = true;
+  processHook.hasThread =
+      uv_thread_create(&hook_tid, hookThread, NULL) == 0;
+  if (processHook.hasThread) {
+    uv_sem_wait(&processHook.threadReady);
+  }
+  return &processHook;
+}
+
+// Ends the hook thread and resets the target, so another hook can be started.
+void ow_stop_hook(struct ow_hook *hook) {
+  hook->isRunning = false;
+  if (hook->hasThread) {
+    // runs once the RunLoop is started, if it's not running yet
+    CFRunLoopPerformBlock(hook->runLoop, kCFRunLoopDefaultMode, ^() {
+      CFRunLoopStop(CFRunLoopGetCurrent());
+    });
+    CFRunLoopWakeUp(hook->runLoop);
+    uv_thread_join(&hook_tid);
+    CFRelease(hook->runLoop);
+    hook->runLoop = NULL;
+    hook->hasThread = false;
+  }
+
+  ow_matcher_free(targetMatcher);
+  free(targetMatcher);
+  targetMatcher = NULL;
+  targetInfo.title = NULL;
+  targetInfo.pid = -1;
+  targetInfo.isFocused = false;
+  targetInfo.isDestroyed = false;
+  targetInfo.isFullscreen = false;
+  frontmostInfo.pid = -1;
+  frontmostInfo.windowID = 0;
+  overlayInfo.window = NULL;
+  previousBounds = {.x = -1, .y = -1, .width = 0, .height = 0};
+
+  uv_mutex_lock(&hook->lock);
+  hook->context = NULL;
+  hook->isStarted = false;
+  uv_mutex_unlock(&hook->lock);
 }
 
-void ow_activate_overlay() {
+void ow_activate_overlay(struct ow_hook *hook) {
   [[NSApplication sharedApplication] activateIgnoringOtherApps:YES];
 }
 
-void ow_focus_target() {
+void ow_focus_target(struct ow_hook *hook) {
   if (targetInfo.pid < 0 || !targetInfo.element) {
     return;
   }
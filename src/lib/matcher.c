@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+#include "matcher.h"
+
+const char* ow_matcher_compile(struct ow_matcher* matcher) {
+  if (
+    matcher->title_mode == OW_TITLE_ANY &&
+    matcher->wm_class == NULL &&
+    matcher->pid == 0 &&
+    matcher->exe_name == NULL
+  ) {
+    return "At least one criterion to find the target window is required";
+  }
+
+#ifndef __linux__
+  if (matcher->wm_class != NULL || matcher->pid != 0 || matcher->exe_name != NULL) {
+    return "Only title can be used to find the target window on this platform";
+  }
+#endif
+#ifdef __APPLE__
+  if (matcher->title_mode != OW_TITLE_EXACT) {
+    return "Only exact title can be used to find the target window on this platform";
+  }
+#endif
+
+  if (matcher->title != NULL) {
+    matcher->title_length = strlen(matcher->title);
+  }
+
+  if (matcher->title_mode == OW_TITLE_REGEX) {
+#ifdef OW_MATCHER_HAS_REGEX
+    if (regcomp(&matcher->title_regex, matcher->title, REG_EXTENDED | REG_NOSUB) != 0) {
+      return "Invalid title regular expression";
+    }
+    matcher->has_title_regex = true;
+#else
+    return "Title regular expression is not supported on this platform";
+#endif
+  }
+
+  return NULL;
+}
+
+uint32_t ow_matcher_title_fetch_length(struct ow_matcher* matcher) {
+  switch (matcher->title_mode) {
+  case OW_TITLE_ANY:
+    return 0;
+  case OW_TITLE_EXACT:
+    // one more byte to detect that title is longer
+    return (uint32_t)matcher->title_length + 1;
+  case OW_TITLE_PREFIX:
+    return (uint32_t)matcher->title_length;
+  default:
+    return OW_MATCHER_FETCH_ALL;
+  }
+}
+
+bool ow_matcher_match_title(struct ow_matcher* matcher, const char* title, size_t length, bool is_truncated) {
+  switch (matcher->title_mode) {
+  case OW_TITLE_ANY:
+    return true;
+  case OW_TITLE_EXACT:
+    return title != NULL && !is_truncated && length == matcher->title_length &&
+      memcmp(title, matcher->title, length) == 0;
+  case OW_TITLE_PREFIX:
+    return title != NULL && length >= matcher->title_length &&
+      memcmp(title, matcher->title, matcher->title_length) == 0;
+  case OW_TITLE_SUFFIX:
+    return title != NULL && !is_truncated && length >= matcher->title_length &&
+      memcmp(title + length - matcher->title_length, matcher->title, matcher->title_length) == 0;
+  case OW_TITLE_REGEX: {
+#ifdef OW_MATCHER_HAS_REGEX
+    if (title == NULL) {
+      return false;
+    }
+    char* terminated = malloc(length + 1);
+    memcpy(terminated, title, length);
+    terminated[length] = '\0';
+    bool is_match = (regexec(&matcher->title_regex, terminated, 0, NULL, 0) == 0);
+    free(terminated);
+    return is_match;
+#else
+    return false;
+#endif
+  }
+  }
+  return false;
+}
+
+void ow_matcher_free(struct ow_matcher* matcher) {
+  free(matcher->title);
+  free(matcher->wm_class);
+  free(matcher->exe_name);
+#ifdef OW_MATCHER_HAS_REGEX
+  if (matcher->has_title_regex) {
+    regfree(&matcher->title_regex);
+  }
+#endif
+  memset(matcher, 0, sizeof(struct ow_matcher));
+}
@@ -0,0 +1,65 @@
+#ifndef ADDON_SRC_MATCHER_H_
+#define ADDON_SRC_MATCHER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <regex.h>
+#define OW_MATCHER_HAS_REGEX
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum ow_title_match_mode {
+  OW_TITLE_ANY = 0,
+  OW_TITLE_EXACT,
+  OW_TITLE_PREFIX,
+  OW_TITLE_SUFFIX,
+  OW_TITLE_REGEX,
+};
+
+// Matches full content of a property
+#define OW_MATCHER_FETCH_ALL UINT32_MAX
+
+// Criteria to find the target window, all specified criteria must match.
+struct ow_matcher {
+  enum ow_title_match_mode title_mode;
+  // NULL if `title_mode` is `OW_TITLE_ANY`
+  char* title;
+  size_t title_length;
+#ifdef OW_MATCHER_HAS_REGEX
+  regex_t title_regex;
+  bool has_title_regex;
+#endif
+  // X11: either instance or class part of `WM_CLASS`, NULL to match any
+  char* wm_class;
+  // X11: `_NET_WM_PID`, 0 to match any
+  uint32_t pid;
+  // X11: executable name of the `_NET_WM_PID` process, NULL to match any
+  char* exe_name;
+};
+
+// Takes ownership of strings in `matcher`, these must be allocated with `malloc`.
+// Returns NULL on success, otherwise static error message.
+const char* ow_matcher_compile(struct ow_matcher* matcher);
+
+// Number of title bytes that must be fetched to decide if title matches.
+uint32_t ow_matcher_title_fetch_length(struct ow_matcher* matcher);
+
+// `title` is not required to be null-terminated, `is_truncated` is set
+// when `length` is shorter than the full title.
+bool ow_matcher_match_title(struct ow_matcher* matcher, const char* title, size_t length, bool is_truncated);
+
+// Frees strings and the compiled expression, not the matcher itself.
+// Can be called whether `ow_matcher_compile` succeeded or not.
+void ow_matcher_free(struct ow_matcher* matcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // !ADDON_SRC_MATCHER_H_
@@ -0,0 +1,101 @@
+#include <string.h>
+#include <uv.h>
+#include "metrics.h"
+
+void ow_metrics_init(struct ow_metrics* metrics) {
+  uv_mutex_init(&metrics->lock);
+  memset(metrics->timings, 0, sizeof(metrics->timings));
+  memset(metrics->latencies, 0, sizeof(metrics->latencies));
+}
+
+void ow_metrics_destroy(struct ow_metrics* metrics) {
+  uv_mutex_destroy(&metrics->lock);
+}
+
+static uint32_t highest_bit(uint64_t value) {
+  uint32_t bit = 0;
+  while (value >>= 1) {
+    bit += 1;
+  }
+  return bit;
+}
+
+static uint32_t bucket_index(uint64_t value_us) {
+  if (value_us < OW_LATENCY_SUB_BUCKETS) {
+    return (uint32_t)value_us;
+  }
+  uint32_t shift = highest_bit(value_us) - 3;
+  uint32_t index = (shift + 1) * OW_LATENCY_SUB_BUCKETS + (uint32_t)((value_us >> shift) & (OW_LATENCY_SUB_BUCKETS - 1));
+  return index < OW_LATENCY_BUCKETS ? index : OW_LATENCY_BUCKETS - 1;
+}
+
+static uint64_t bucket_upper_bound(uint32_t index) {
+  if (index < OW_LATENCY_SUB_BUCKETS) {
+    return index;
+  }
+  uint32_t shift = index / OW_LATENCY_SUB_BUCKETS - 1;
+  uint64_t lower = (uint64_t)(OW_LATENCY_SUB_BUCKETS + index % OW_LATENCY_SUB_BUCKETS) << shift;
+  return lower + ((uint64_t)1 << shift) - 1;
+}
+
+void ow_metrics_record_timing(struct ow_metrics* metrics, enum ow_timing_metric metric, uint64_t duration_ns) {
+  if (metrics == NULL) return;
+  uv_mutex_lock(&metrics->lock);
+  struct ow_timing_stats* stats = &metrics->timings[metric];
+  if (stats->count == 0 || duration_ns < stats->min_ns) {
+    stats->min_ns = duration_ns;
+  }
+  if (duration_ns > stats->max_ns) {
+    stats->max_ns = duration_ns;
+  }
+  stats->last_ns = duration_ns;
+  stats->total_ns += duration_ns;
+  stats->count += 1;
+  uv_mutex_unlock(&metrics->lock);
+}
+
+void ow_metrics_read_timing(struct ow_metrics* metrics, enum ow_timing_metric metric, struct ow_timing_stats* stats) {
+  uv_mutex_lock(&metrics->lock);
+  *stats = metrics->timings[metric];
+  uv_mutex_unlock(&metrics->lock);
+}
+
+void ow_metrics_record_latency(struct ow_metrics* metrics, enum ow_latency_stage stage, uint32_t event_type, uint64_t duration_ns) {
+  if (metrics == NULL || event_type == 0 || event_type >= OW_LATENCY_EVENT_COUNT) return;
+  uint64_t duration_us = duration_ns / 1000;
+  uv_mutex_lock(&metrics->lock);
+  struct ow_latency_histogram* histogram = &metrics->latencies[stage][event_type];
+  histogram->buckets[bucket_index(duration_us)] += 1;
+  histogram->count += 1;
+  if (duration_us > histogram->max_us) {
+    histogram->max_us = duration_us;
+  }
+  uv_mutex_unlock(&metrics->lock);
+}
+
+void ow_metrics_read_latency(struct ow_metrics* metrics, enum ow_latency_stage stage, uint32_t event_type, struct ow_latency_histogram* histogram) {
+  uv_mutex_lock(&metrics->lock);
+  *histogram = metrics->latencies[stage][event_type];
+  uv_mutex_unlock(&metrics->lock);
+}
+
+void ow_metrics_reset_latency(struct ow_metrics* metrics) {
+  uv_mutex_lock(&metrics->lock);
+  memset(metrics->latencies, 0, sizeof(metrics->latencies));
+  uv_mutex_unlock(&metrics->lock);
+}
+
+uint64_t ow_latency_histogram_quantile(const struct ow_latency_histogram* histogram, double quantile) {
+  if (histogram->count == 0) return 0;
+  uint64_t rank = (uint64_t)(quantile * histogram->count + 0.5);
+  if (rank < 1) rank = 1;
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < OW_LATENCY_BUCKETS; ++i) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      uint64_t upper = bucket_upper_bound(i);
+      return upper < histogram->max_us ? upper : histogram->max_us;
+    }
+  }
+  return histogram->max_us;
+}
@@ -0,0 +1,77 @@
+#ifndef ADDON_SRC_METRICS_H_
+#define ADDON_SRC_METRICS_H_
+
+#include <stdint.h>
+#include <uv.h>
+
+enum ow_timing_metric {
+  // hook thread start until initial target check is done
+  OW_TIMING_STARTUP = 0,
+  // target window check until OW_ATTACH is emitted
+  OW_TIMING_ATTACH,
+  OW_TIMING_COUNT
+};
+
+struct ow_timing_stats {
+  uint32_t count;
+  uint64_t last_ns;
+  uint64_t min_ns;
+  uint64_t max_ns;
+  uint64_t total_ns;
+};
+
+enum ow_latency_stage {
+  // source event time until received by the hook, recorded only
+  // when the windowing system clock is comparable with the local one
+  OW_LATENCY_SOURCE = 0,
+  // received by the hook until queued for JS
+  OW_LATENCY_HOOK,
+  // queued until dispatched to JS
+  OW_LATENCY_QUEUE,
+  // dispatched to JS until overlay bounds are applied, reported by JS
+  OW_LATENCY_APPLY,
+  OW_LATENCY_STAGE_COUNT
+};
+
+// indexed by `enum ow_event_type`, 0 is unused
+#define OW_LATENCY_EVENT_COUNT 7
+
+// Log-linear buckets over microseconds, 8 per power of two, so every
+// value is within 12.5% of its bucket bounds up to ~71 minutes.
+#define OW_LATENCY_SUB_BUCKETS 8
+#define OW_LATENCY_BUCKETS 240
+
+struct ow_latency_histogram {
+  uint32_t count;
+  uint64_t max_us;
+  uint32_t buckets[OW_LATENCY_BUCKETS];
+};
+
+// Timings and latencies of one hook, kept by whoever started it.
+struct ow_metrics {
+  uv_mutex_t lock;
+  struct ow_timing_stats timings[OW_TIMING_COUNT];
+  struct ow_latency_histogram latencies[OW_LATENCY_STAGE_COUNT][OW_LATENCY_EVENT_COUNT];
+};
+
+void ow_metrics_init(struct ow_metrics* metrics);
+
+void ow_metrics_destroy(struct ow_metrics* metrics);
+
+// Can be called from any thread, does nothing if `metrics` is NULL.
+void ow_metrics_record_timing(struct ow_metrics* metrics, enum ow_timing_metric metric, uint64_t duration_ns);
+
+void ow_metrics_read_timing(struct ow_metrics* metrics, enum ow_timing_metric metric, struct ow_timing_stats* stats);
+
+// Can be called from any thread, does nothing if `metrics` is NULL.
+void ow_metrics_record_latency(struct ow_metrics* metrics, enum ow_latency_stage stage, uint32_t event_type, uint64_t duration_ns);
+
+void ow_metrics_read_latency(struct ow_metrics* metrics, enum ow_latency_stage stage, uint32_t event_type, struct ow_latency_histogram* histogram);
+
+void ow_metrics_reset_latency(struct ow_metrics* metrics);
+
+// Returns the upper bound in microseconds of the bucket that
+// contains the `quantile` (0..1) value, 0 if the histogram is empty.
+uint64_t ow_latency_histogram_quantile(const struct ow_latency_histogram* histogram, double quantile);
+
+#endif // !ADDON_SRC_METRICS_H_
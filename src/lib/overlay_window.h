@@ -5,6 +5,7 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <uv.h>
 
@@ -38,6 +39,8 @@ struct ow_event_attach {
   int is_fullscreen;
   //
   struct ow_window_bounds bounds;
+  // platform-specific window ID of the target
+  uint64_t window_id;
 };
 
 struct ow_event_fullscreen {
@@ -50,6 +53,16 @@ struct ow_event_moveresize {
 
 struct ow_event {
   enum ow_event_type type;
+  // 0 for the target passed to `ow_start_hook`,
+  // index + 1 for `extra_targets` of the hook options
+  uint32_t target_id;
+  // time of the source event in ms of the windowing system clock
+  // (X server time, Windows tick count), 0 if there is none
+  uint32_t source_time_ms;
+  // `uv_hrtime()` when the hook received the source event, 0 if unknown
+  uint64_t receive_ns;
+  // `uv_hrtime()` when queued for JS, set by `ow_emit_event`
+  uint64_t enqueue_ns;
   union {
     struct ow_event_attach attach;
     struct ow_event_fullscreen fullscreen;
@@ -57,20 +70,178 @@ struct ow_event {
   } data;
 };
 
-static uv_thread_t hook_tid;
+struct ow_matcher;
 
-// Passed the title and a pointer to the platform-specific window ID.
+struct ow_hook;
+
+struct ow_pixel_transform;
+
+struct ow_metrics;
+
+// X11: number of targets one hook can track, including the one passed to `ow_start_hook`
+#define OW_MAX_TARGETS 8
+
+// Target tracked by the same hook in addition to the one passed to `ow_start_hook`.
+struct ow_hook_target {
+  struct ow_matcher* matcher;
+  // same format as in `ow_start_hook`, NULL if it has no overlay
+  void* overlay_window_id;
+};
+
+enum ow_moveresize_pacing {
+  // once per burst of received move/resize events
+  OW_PACING_IMMEDIATE = 0,
+  // at most once per refresh of the monitor showing the target
+  OW_PACING_VSYNC,
+  // at most `moveresize_fps` times per second
+  OW_PACING_FIXED,
+};
+
+struct ow_hook_options {
+  // X11: compute move/resize bounds from ConfigureNotify payloads
+  // instead of querying the X server for every event
+  bool track_configure_notify;
+  // X11: capture only the target's own contents using Composite,
+  // windows covering the target (including overlay) are not captured
+  bool capture_composite;
+  // X11: how often OW_MOVERESIZE is emitted while the target moves,
+  // the latest bounds are always emitted when the interval passes
+  enum ow_moveresize_pacing moveresize_pacing;
+  uint32_t moveresize_fps;
+  // X11: hook thread moves the overlay over the target and raises it above
+  // the target's frame itself, as soon as the X server reports changes
+  bool follow_target;
+  // X11: file to record X events and replies read by the hook into,
+  // NULL to not record (see x11/trace.h)
+  char* trace_path;
+  // X11: runs the hook on this loop instead of a dedicated thread, must be
+  // the loop of the thread calling `ow_start_hook`. NULL to use a thread
+  uv_loop_t* loop;
+  // X11: more targets sharing the connection, hook and event queue, at most
+  // `OW_MAX_TARGETS - 1`. Screenshots and capture stream use the first target
+  struct ow_hook_target* extra_targets;
+  uint32_t extra_target_count;
+  // timings and source latencies of the hook are recorded into it,
+  // must outlive the hook. NULL to not record
+  struct ow_metrics* metrics;
+};
+
+// Passed the compiled criteria to find the target (see matcher.h) and
+// a pointer to the platform-specific window ID.
 // Window ID format depends on platform, see
 // https://www.electronjs.org/docs/api/browser-window#wingetnativewindowhandle
-void ow_start_hook(char* target_window_title, void* overlay_window_id);
+// `context` is passed to `ow_emit_*` for events of this hook.
+// Takes ownership of `matcher` and matchers of `extra_targets`, unless it
+// returns NULL because Windows and Mac backends run one hook per process.
+struct ow_hook* ow_start_hook(struct ow_matcher* matcher, void* overlay_window_id, struct ow_hook_options* options, void* context);
+
+// No `ow_emit_*` calls are made for the hook once this returns. With the
+// `loop` option it must be called on the loop's thread before the loop
+// is closed. Ends the hook's thread and frees the hook on every backend,
+// so another one can be started.
+void ow_stop_hook(struct ow_hook* hook);
+
+void ow_activate_overlay(struct ow_hook* hook);
+
+void ow_focus_target(struct ow_hook* hook);
+
+void ow_emit_event(void* context, struct ow_event* event);
+
+// Called on the loop's thread after every burst of events
+// when the hook runs on a loop (see `ow_hook_options`).
+void ow_emit_burst_end(void* context);
+
+// `hook` is NULL if it's not started.
+void ow_screenshot(struct ow_hook* hook, uint8_t* out, uint32_t width, uint32_t height);
+
+// Same as `ow_screenshot`, but captures only `area` of the target,
+// it must be inside of `width` and `height`.
+void ow_screenshot_area(struct ow_hook* hook, uint8_t* out, uint32_t width, uint32_t height, const struct ow_window_bounds* area);
+
+struct ow_window_info {
+  uint64_t window_id;
+  // UTF-8, NULL if unknown
+  char* title;
+  // class part of `WM_CLASS`, NULL if unknown
+  char* wm_class;
+  // 0 if unknown
+  uint32_t pid;
+};
+
+// X11 only. Stores top-level windows into `windows`
+// and returns their count, free with `ow_free_window_list`.
+// `hook` is NULL if it's not started.
+uint32_t ow_list_windows(struct ow_hook* hook, struct ow_window_info** windows);
+
+void ow_free_window_list(struct ow_window_info* windows, uint32_t count);
+
+enum ow_replay_result {
+  // every record of the trace was replayed
+  OW_REPLAY_DONE = 0,
+  // file is not a trace or has an unsupported version
+  OW_REPLAY_UNREADABLE,
+  // hook asked for a reply the trace doesn't have next, or left recorded
+  // replies unread, events after that point were not replayed
+  OW_REPLAY_DIVERGED,
+};
+
+// X11 only. Feeds a trace recorded with `trace_path` through the hook's
+// state machine on the calling thread, emitting the same events without
+// an X server. Targets and options are the ones stored in the trace.
+// Unless `is_real_time`, runs as fast as possible.
+enum ow_replay_result ow_replay_trace(const char* path, bool is_real_time, void* context);
+
+#define OW_FRAME_MAX_RECTS 16
+
+struct ow_frame_info {
+  // starts at 1, incremented for every captured frame
+  uint32_t seq;
+  uint32_t width;
+  uint32_t height;
+};
+
+// Areas of the target that changed, relative to its content area.
+// Collapsed into a single bounding box when there are too many.
+struct ow_frame_damage {
+  uint32_t count;
+  struct ow_window_bounds rects[OW_FRAME_MAX_RECTS];
+};
+
+struct ow_frame_event {
+  struct ow_frame_info frame;
+  // everything that changed since the previous event
+  struct ow_frame_damage damage;
+};
+
+struct ow_stream_options {
+  // 0 to capture on every damage
+  uint32_t max_fps;
+  // used when the target can't be watched for damage
+  uint32_t poll_interval_ms;
+};
+
+enum ow_stream_read_result {
+  OW_STREAM_NO_FRAME = 0,
+  OW_STREAM_READ,
+  OW_STREAM_TOO_SMALL,
+  // crop region doesn't intersect the frame
+  OW_STREAM_OUT_OF_BOUNDS
+};
 
-void ow_activate_overlay();
+// X11 only. Captures the target on a separate thread whenever its
+// contents change. Returns `false` if the stream is already running.
+bool ow_stream_start(struct ow_hook* hook, struct ow_stream_options* options);
 
-void ow_focus_target();
+void ow_stream_stop(struct ow_hook* hook);
 
-void ow_emit_event(struct ow_event* event);
+// Copies the latest captured frame into `out` if it wasn't read yet,
+// applying `transform` unless it's NULL (see pixel_ops.h).
+// `info` is set to the size of the result unless there is no new frame.
+enum ow_stream_read_result ow_stream_read(struct ow_hook* hook, uint8_t* out, size_t capacity, const struct ow_pixel_transform* transform, struct ow_frame_info* info);
 
-void ow_screenshot(uint8_t* out, uint32_t width, uint32_t height);
+// Called by the stream thread for every captured frame,
+// with `context` of the hook.
+void ow_emit_frame(void* context, struct ow_frame_event* event);
 
 #ifdef __cplusplus
 }
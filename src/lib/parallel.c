@@ -0,0 +1,184 @@
+#include <stdbool.h>
+#include <uv.h>
+#include "atomics.h"
+#include "parallel.h"
+
+#define OW_PARALLEL_MAX_WORKERS 7
+// chunks per thread, so threads that start late still get work
+#define OW_PARALLEL_CHUNKS_PER_THREAD 2
+
+struct parallel_job {
+  ow_parallel_fn fn;
+  void* ctx;
+  uint32_t count;
+  uint32_t chunk_size;
+  uint32_t chunk_count;
+  volatile uint32_t next_chunk;
+  volatile uint32_t done_chunks;
+  // workers that may still access this job, guarded by pool_lock
+  uint32_t active_workers;
+};
+
+static uv_once_t pool_once = UV_ONCE_INIT;
+// held while a job runs, guards `user_count` and starting/stopping workers
+static uv_mutex_t submit_lock;
+static uv_mutex_t pool_lock;
+static uv_cond_t job_cond;
+static uv_cond_t done_cond;
+static uint32_t user_count = 0;
+static uv_thread_t workers[OW_PARALLEL_MAX_WORKERS];
+static uint32_t worker_count = 0;
+static bool is_stopping = false;
+static uint32_t job_generation = 0;
+static struct parallel_job* current_job = NULL;
+
+static void run_chunks(struct parallel_job* job) {
+  for (;;) {
+    uint32_t chunk = ow_atomic_fetch_add(&job->next_chunk, 1);
+    if (chunk >= job->chunk_count) {
+      return;
+    }
+    uint32_t begin = chunk * job->chunk_size;
+    uint32_t end = (begin + job->chunk_size < job->count) ? begin + job->chunk_size : job->count;
+    job->fn(job->ctx, begin, end);
+    if (ow_atomic_fetch_add(&job->done_chunks, 1) + 1 == job->chunk_count) {
+      uv_mutex_lock(&pool_lock);
+      uv_cond_signal(&done_cond);
+      uv_mutex_unlock(&pool_lock);
+    }
+  }
+}
+
+static void worker_thread(void* _arg) {
+  uv_mutex_lock(&pool_lock);
+  uint32_t seen_generation = job_generation;
+  for (;;) {
+    while (job_generation == seen_generation && !is_stopping) {
+      uv_cond_wait(&job_cond, &pool_lock);
+    }
+    if (is_stopping) {
+      uv_mutex_unlock(&pool_lock);
+      return;
+    }
+    seen_generation = job_generation;
+    struct parallel_job* job = current_job;
+    if (job == NULL) {
+      continue;
+    }
+    job->active_workers += 1;
+    uv_mutex_unlock(&pool_lock);
+
+    run_chunks(job);
+
+    uv_mutex_lock(&pool_lock);
+    job->active_workers -= 1;
+    if (job->active_workers == 0) {
+      uv_cond_signal(&done_cond);
+    }
+  }
+}
+
+static void pool_init(void) {
+  uv_mutex_init(&submit_lock);
+  uv_mutex_init(&pool_lock);
+  uv_cond_init(&job_cond);
+  uv_cond_init(&done_cond);
+}
+
+// Called with `submit_lock` held.
+static void start_workers(void) {
+  unsigned int threads = uv_available_parallelism();
+  uint32_t count = (threads > 1) ? threads - 1 : 0;
+  if (count > OW_PARALLEL_MAX_WORKERS) {
+    count = OW_PARALLEL_MAX_WORKERS;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    if (uv_thread_create(&workers[i], worker_thread, NULL) != 0) {
+      break;
+    }
+    worker_count += 1;
+  }
+}
+
+// Called with `submit_lock` held, so no job is running.
+static void stop_workers(void) {
+  uv_mutex_lock(&pool_lock);
+  is_stopping = true;
+  uv_cond_broadcast(&job_cond);
+  uv_mutex_unlock(&pool_lock);
+
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    uv_thread_join(&workers[i]);
+  }
+  worker_count = 0;
+  is_stopping = false;
+}
+
+void ow_parallel_retain(void) {
+  uv_once(&pool_once, pool_init);
+  uv_mutex_lock(&submit_lock);
+  user_count += 1;
+  uv_mutex_unlock(&submit_lock);
+}
+
+void ow_parallel_release(void) {
+  uv_mutex_lock(&submit_lock);
+  user_count -= 1;
+  if (user_count == 0 && worker_count != 0) {
+    stop_workers();
+  }
+  uv_mutex_unlock(&submit_lock);
+}
+
+void ow_parallel_for(uint32_t count, uint32_t min_chunk, ow_parallel_fn fn, void* ctx) {
+  if (count == 0) {
+    return;
+  }
+  uint32_t chunk_count = count / (min_chunk ? min_chunk : 1);
+  uv_once(&pool_once, pool_init);
+  if (chunk_count <= 1 || uv_mutex_trylock(&submit_lock) != 0) {
+    fn(ctx, 0, count);
+    return;
+  }
+  if (worker_count == 0 && user_count != 0) {
+    start_workers();
+  }
+
+  uint32_t max_chunks = (worker_count + 1) * OW_PARALLEL_CHUNKS_PER_THREAD;
+  if (chunk_count > max_chunks) {
+    chunk_count = max_chunks;
+  }
+  if (worker_count == 0) {
+    uv_mutex_unlock(&submit_lock);
+    fn(ctx, 0, count);
+    return;
+  }
+
+  struct parallel_job job = {
+    .fn = fn,
+    .ctx = ctx,
+    .count = count,
+    .chunk_size = (count + chunk_count - 1) / chunk_count,
+    .next_chunk = 0,
+    .done_chunks = 0,
+    .active_workers = 0
+  };
+  job.chunk_count = (count + job.chunk_size - 1) / job.chunk_size;
+
+  uv_mutex_lock(&pool_lock);
+  current_job = &job;
+  job_generation += 1;
+  uv_cond_broadcast(&job_cond);
+  uv_mutex_unlock(&pool_lock);
+
+  run_chunks(&job);
+
+  uv_mutex_lock(&pool_lock);
+  while (ow_atomic_load(&job.done_chunks) != job.chunk_count || job.active_workers != 0) {
+    uv_cond_wait(&done_cond, &pool_lock);
+  }
+  current_job = NULL;
+  uv_mutex_unlock(&pool_lock);
+
+  uv_mutex_unlock(&submit_lock);
+}
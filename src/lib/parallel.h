@@ -0,0 +1,21 @@
+#ifndef ADDON_SRC_PARALLEL_H_
+#define ADDON_SRC_PARALLEL_H_
+
+#include <stdint.h>
+
+// Processes items [begin, end).
+typedef void (*ow_parallel_fn)(void* ctx, uint32_t begin, uint32_t end);
+
+// Runs `fn` over [0, count) split into ranges of at least `min_chunk` items,
+// on a shared pool of worker threads and the calling thread. Returns when
+// all items are processed. If the pool is busy with another call or nothing
+// retains it, everything runs on the calling thread.
+void ow_parallel_for(uint32_t count, uint32_t min_chunk, ow_parallel_fn fn, void* ctx);
+
+// The pool's workers are started by the first `ow_parallel_for` once it is
+// retained, and joined when the last user releases it.
+void ow_parallel_retain(void);
+
+void ow_parallel_release(void);
+
+#endif // !ADDON_SRC_PARALLEL_H_
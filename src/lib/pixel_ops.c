@@ -0,0 +1,463 @@
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+#include "cpu_features.h"
+#include "parallel.h"
+#include "pixel_ops.h"
+
+// SSE2 is part of x86-64, AVX2 is selected at runtime
+#ifdef OW_CPU_X64
+#define OW_PIXEL_SSE2
+#include <immintrin.h>
+#endif
+
+// pixels per parallel chunk, smaller images are processed on the calling thread
+#define OW_PIXEL_MIN_CHUNK_PIXELS 65536
+
+typedef void (*convert_row_fn)(const uint8_t* src, uint8_t* dst, uint32_t width);
+// box filter for exactly half the size, `dst_width` pixels from two source rows
+typedef void (*halve_row_fn)(const uint8_t* top, const uint8_t* bottom, uint8_t* dst, uint32_t dst_width);
+typedef void (*bilinear_row_fn)(const uint8_t* top, const uint8_t* bottom, uint32_t fy, const uint32_t* x0s, const uint32_t* x1s, const uint16_t* fxs, uint8_t* dst, uint32_t dst_width);
+
+struct pixel_kernels {
+  convert_row_fn convert[OW_PIXEL_FORMAT_COUNT];
+  halve_row_fn halve_row;
+  bilinear_row_fn bilinear_row;
+};
+
+static struct pixel_kernels kernels;
+static uv_once_t kernels_once = UV_ONCE_INIT;
+
+// Scalar kernels, all SIMD variants must produce exactly the same output.
+
+// Rec. 601 luma in 8-bit fixed point, weights sum to 256
+#define LUMA_B 29
+#define LUMA_G 150
+#define LUMA_R 77
+
+static void convert_bgra_scalar(const uint8_t* src, uint8_t* dst, uint32_t width) {
+  memcpy(dst, src, (size_t)width * 4);
+}
+
+static void convert_rgba_scalar(const uint8_t* src, uint8_t* dst, uint32_t width) {
+  for (uint32_t x = 0; x < width; ++x) {
+    dst[x * 4 + 0] = src[x * 4 + 2];
+    dst[x * 4 + 1] = src[x * 4 + 1];
+    dst[x * 4 + 2] = src[x * 4 + 0];
+    dst[x * 4 + 3] = src[x * 4 + 3];
+  }
+}
+
+static void convert_rgb_scalar(const uint8_t* src, uint8_t* dst, uint32_t width) {
+  for (uint32_t x = 0; x < width; ++x) {
+    dst[x * 3 + 0] = src[x * 4 + 2];
+    dst[x * 3 + 1] = src[x * 4 + 1];
+    dst[x * 3 + 2] = src[x * 4 + 0];
+  }
+}
+
+static void convert_gray_scalar(const uint8_t* src, uint8_t* dst, uint32_t width) {
+  for (uint32_t x = 0; x < width; ++x) {
+    dst[x] = (uint8_t)((src[x * 4 + 0] * LUMA_B + src[x * 4 + 1] * LUMA_G + src[x * 4 + 2] * LUMA_R + 128) >> 8);
+  }
+}
+
+static void halve_row_scalar(const uint8_t* top, const uint8_t* bottom, uint8_t* dst, uint32_t dst_width) {
+  for (uint32_t x = 0; x < dst_width; ++x) {
+    for (int c = 0; c < 4; ++c) {
+      uint32_t sum = top[x * 8 + c] + top[x * 8 + 4 + c] + bottom[x * 8 + c] + bottom[x * 8 + 4 + c];
+      dst[x * 4 + c] = (uint8_t)((sum + 2) >> 2);
+    }
+  }
+}
+
+static void bilinear_row_scalar(const uint8_t* top, const uint8_t* bottom, uint32_t fy, const uint32_t* x0s, const uint32_t* x1s, const uint16_t* fxs, uint8_t* dst, uint32_t dst_width) {
+  for (uint32_t x = 0; x < dst_width; ++x) {
+    uint32_t fx = fxs[x];
+    for (int c = 0; c < 4; ++c) {
+      // vertical first, rounded to 8 bits like the SIMD variant
+      uint32_t left = (top[x0s[x] + c] * (256 - fy) + bottom[x0s[x] + c] * fy + 128) >> 8;
+      uint32_t right = (top[x1s[x] + c] * (256 - fy) + bottom[x1s[x] + c] * fy + 128) >> 8;
+      dst[x * 4 + c] = (uint8_t)((left * (256 - fx) + right * fx + 128) >> 8);
+    }
+  }
+}
+
+#ifdef OW_PIXEL_SSE2
+static __m128i load_pixel(const uint8_t* src) {
+  int32_t value;
+  memcpy(&value, src, 4);
+  return _mm_cvtsi32_si128(value);
+}
+
+static void convert_rgba_sse2(const uint8_t* src, uint8_t* dst, uint32_t width) {
+  const __m128i mask_ag = _mm_set1_epi32((int)0xFF00FF00);
+  const __m128i mask_rb = _mm_set1_epi32(0x00FF00FF);
+  uint32_t x = 0;
+  for (; x + 4 <= width; x += 4) {
+    __m128i px = _mm_loadu_si128((const __m128i*)(src + x * 4));
+    __m128i rb = _mm_and_si128(px, mask_rb);
+    __m128i swapped = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+    px = _mm_or_si128(_mm_and_si128(px, mask_ag), swapped);
+    _mm_storeu_si128((__m128i*)(dst + x * 4), px);
+  }
+  convert_rgba_scalar(src + x * 4, dst + x * 4, width - x);
+}
+
+static __m128i luma_sse2(__m128i px) {
+  const __m128i mask = _mm_set1_epi32(0xFF);
+  // channels are in the low half of 32-bit lanes, 16-bit multiply is exact
+  __m128i b = _mm_mullo_epi16(_mm_and_si128(px, mask), _mm_set1_epi32(LUMA_B));
+  __m128i g = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(px, 8), mask), _mm_set1_epi32(LUMA_G));
+  __m128i r = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(px, 16), mask), _mm_set1_epi32(LUMA_R));
+  __m128i sum = _mm_add_epi32(_mm_add_epi32(b, g), _mm_add_epi32(r, _mm_set1_epi32(128)));
+  return _mm_srli_epi32(sum, 8);
+}
+
+static void convert_gray_sse2(const uint8_t* src, uint8_t* dst, uint32_t width) {
+  uint32_t x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i y0 = luma_sse2(_mm_loadu_si128((const __m128i*)(src + x * 4)));
+    __m128i y1 = luma_sse2(_mm_loadu_si128((const __m128i*)(src + x * 4 + 16)));
+    __m128i y2 = luma_sse2(_mm_loadu_si128((const __m128i*)(src + x * 4 + 32)));
+    __m128i y3 = luma_sse2(_mm_loadu_si128((const __m128i*)(src + x * 4 + 48)));
+    __m128i packed = _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3));
+    _mm_storeu_si128((__m128i*)(dst + x), packed);
+  }
+  convert_gray_scalar(src + x * 4, dst + x, width - x);
+}
+
+static void halve_row_sse2(const uint8_t* top, const uint8_t* bottom, uint8_t* dst, uint32_t dst_width) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i two = _mm_set1_epi16(2);
+  uint32_t x = 0;
+  for (; x + 2 <= dst_width; x += 2) {
+    __m128i t = _mm_loadu_si128((const __m128i*)(top + x * 8));
+    __m128i b = _mm_loadu_si128((const __m128i*)(bottom + x * 8));
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(t, zero), _mm_unpacklo_epi8(b, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(t, zero), _mm_unpackhi_epi8(b, zero));
+    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+    __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+    _mm_storel_epi64((__m128i*)(dst + x * 4), _mm_packus_epi16(sum, sum));
+  }
+  halve_row_scalar(top + x * 8, bottom + x * 8, dst + x * 4, dst_width - x);
+}
+
+static void bilinear_row_sse2(const uint8_t* top, const uint8_t* bottom, uint32_t fy, const uint32_t* x0s, const uint32_t* x1s, const uint16_t* fxs, uint8_t* dst, uint32_t dst_width) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi16(128);
+  const __m128i wy_top = _mm_set1_epi16((short)(256 - fy));
+  const __m128i wy_bottom = _mm_set1_epi16((short)fy);
+  for (uint32_t x = 0; x < dst_width; ++x) {
+    // [left, right] of both rows as 16-bit channels
+    __m128i t = _mm_unpacklo_epi8(_mm_unpacklo_epi32(load_pixel(top + x0s[x]), load_pixel(top + x1s[x])), zero);
+    __m128i b = _mm_unpacklo_epi8(_mm_unpacklo_epi32(load_pixel(bottom + x0s[x]), load_pixel(bottom + x1s[x])), zero);
+    // products never exceed 255 * 256, no overflow in 16 bits
+    __m128i v = _mm_add_epi16(_mm_mullo_epi16(t, wy_top), _mm_mullo_epi16(b, wy_bottom));
+    v = _mm_srli_epi16(_mm_add_epi16(v, round), 8);
+    __m128i wx = _mm_unpacklo_epi64(_mm_set1_epi16((short)(256 - fxs[x])), _mm_set1_epi16((short)fxs[x]));
+    __m128i h = _mm_mullo_epi16(v, wx);
+    h = _mm_add_epi16(h, _mm_srli_si128(h, 8));
+    h = _mm_srli_epi16(_mm_add_epi16(h, round), 8);
+    int32_t value = _mm_cvtsi128_si32(_mm_packus_epi16(h, h));
+    memcpy(dst + x * 4, &value, 4);
+  }
+}
+
+OW_TARGET_AVX2
+static void convert_rgba_avx2(const uint8_t* src, uint8_t* dst, uint32_t width) {
+  const __m256i shuffle = _mm256_setr_epi8(
+    2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+    2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  uint32_t x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m256i px = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+    _mm256_storeu_si256((__m256i*)(dst + x * 4), _mm256_shuffle_epi8(px, shuffle));
+  }
+  convert_rgba_scalar(src + x * 4, dst + x * 4, width - x);
+}
+
+OW_TARGET_AVX2
+static void convert_rgb_avx2(const uint8_t* src, uint8_t* dst, uint32_t width) {
+  // 4 pixels into the low 12 bytes
+  const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  uint32_t x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x * 4)), shuffle);
+    __m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x * 4 + 16)), shuffle);
+    __m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x * 4 + 32)), shuffle);
+    __m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x * 4 + 48)), shuffle);
+    _mm_storeu_si128((__m128i*)(dst + x * 3), _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+    _mm_storeu_si128((__m128i*)(dst + x * 3 + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+    _mm_storeu_si128((__m128i*)(dst + x * 3 + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+  }
+  convert_rgb_scalar(src + x * 4, dst + x * 3, width - x);
+}
+
+OW_TARGET_AVX2
+static __m256i luma_avx2(__m256i px) {
+  const __m256i mask = _mm256_set1_epi32(0xFF);
+  __m256i b = _mm256_mullo_epi16(_mm256_and_si256(px, mask), _mm256_set1_epi32(LUMA_B));
+  __m256i g = _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask), _mm256_set1_epi32(LUMA_G));
+  __m256i r = _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(px, 16), mask), _mm256_set1_epi32(LUMA_R));
+  __m256i sum = _mm256_add_epi32(_mm256_add_epi32(b, g), _mm256_add_epi32(r, _mm256_set1_epi32(128)));
+  return _mm256_srli_epi32(sum, 8);
+}
+
+OW_TARGET_AVX2
+static void convert_gray_avx2(const uint8_t* src, uint8_t* dst, uint32_t width) {
+  // packs work within 128-bit lanes, this restores pixel order
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  uint32_t x = 0;
+  for (; x + 32 <= width; x += 32) {
+    __m256i y0 = luma_avx2(_mm256_loadu_si256((const __m256i*)(src + x * 4)));
+    __m256i y1 = luma_avx2(_mm256_loadu_si256((const __m256i*)(src + x * 4 + 32)));
+    __m256i y2 = luma_avx2(_mm256_loadu_si256((const __m256i*)(src + x * 4 + 64)));
+    __m256i y3 = luma_avx2(_mm256_loadu_si256((const __m256i*)(src + x * 4 + 96)));
+    __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(y0, y1), _mm256_packs_epi32(y2, y3));
+    _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permutevar8x32_epi32(packed, order));
+  }
+  convert_gray_sse2(src + x * 4, dst + x, width - x);
+}
+#endif
+
+static void kernels_init(void) {
+  kernels.convert[OW_PIXEL_BGRA] = convert_bgra_scalar;
+  kernels.convert[OW_PIXEL_RGBA] = convert_rgba_scalar;
+  kernels.convert[OW_PIXEL_RGB] = convert_rgb_scalar;
+  kernels.convert[OW_PIXEL_GRAY] = convert_gray_scalar;
+  kernels.halve_row = halve_row_scalar;
+  kernels.bilinear_row = bilinear_row_scalar;
+#ifdef OW_PIXEL_SSE2
+  kernels.convert[OW_PIXEL_RGBA] = convert_rgba_sse2;
+  kernels.convert[OW_PIXEL_GRAY] = convert_gray_sse2;
+  kernels.halve_row = halve_row_sse2;
+  kernels.bilinear_row = bilinear_row_sse2;
+  if (ow_cpu_has_avx2()) {
+    kernels.convert[OW_PIXEL_RGBA] = convert_rgba_avx2;
+    kernels.convert[OW_PIXEL_RGB] = convert_rgb_avx2;
+    kernels.convert[OW_PIXEL_GRAY] = convert_gray_avx2;
+  }
+#endif
+}
+
+uint32_t ow_pixel_format_size(enum ow_pixel_format format) {
+  switch (format) {
+  case OW_PIXEL_RGB: return 3;
+  case OW_PIXEL_GRAY: return 1;
+  default: return 4;
+  }
+}
+
+bool ow_pixel_transform_resolve(const struct ow_pixel_transform* transform, uint32_t src_width, uint32_t src_height, struct ow_pixel_transform* resolved) {
+  *resolved = *transform;
+  if ((unsigned)transform->format >= OW_PIXEL_FORMAT_COUNT) {
+    return false;
+  }
+
+  struct ow_window_bounds* crop = &resolved->crop;
+  if (crop->width == 0 || crop->height == 0) {
+    crop->x = 0;
+    crop->y = 0;
+    crop->width = src_width;
+    crop->height = src_height;
+  } else {
+    int64_t x0 = crop->x > 0 ? crop->x : 0;
+    int64_t y0 = crop->y > 0 ? crop->y : 0;
+    int64_t x1 = (int64_t)crop->x + crop->width;
+    int64_t y1 = (int64_t)crop->y + crop->height;
+    if (x1 > src_width) x1 = src_width;
+    if (y1 > src_height) y1 = src_height;
+    if (x1 <= x0 || y1 <= y0) {
+      return false;
+    }
+    crop->x = (int32_t)x0;
+    crop->y = (int32_t)y0;
+    crop->width = (uint32_t)(x1 - x0);
+    crop->height = (uint32_t)(y1 - y0);
+  }
+  if (crop->width == 0 || crop->height == 0) {
+    return false;
+  }
+
+  // keep aspect ratio if only one side is specified
+  if (resolved->width == 0 && resolved->height == 0) {
+    resolved->width = crop->width;
+    resolved->height = crop->height;
+  } else if (resolved->width == 0) {
+    resolved->width = (uint32_t)(((uint64_t)crop->width * resolved->height + crop->height / 2) / crop->height);
+  } else if (resolved->height == 0) {
+    resolved->height = (uint32_t)(((uint64_t)crop->height * resolved->width + crop->width / 2) / crop->width);
+  }
+  if (resolved->width == 0) resolved->width = 1;
+  if (resolved->height == 0) resolved->height = 1;
+  return true;
+}
+
+bool ow_pixel_transform_is_identity(const struct ow_pixel_transform* resolved, uint32_t src_width, uint32_t src_height) {
+  return (
+    resolved->format == OW_PIXEL_BGRA &&
+    resolved->crop.x == 0 && resolved->crop.y == 0 &&
+    resolved->crop.width == src_width && resolved->crop.height == src_height &&
+    resolved->width == src_width && resolved->height == src_height
+  );
+}
+
+struct transform_ctx {
+  const struct ow_pixel_transform* transform;
+  // top-left pixel of the crop region
+  const uint8_t* src;
+  size_t src_stride;
+  uint8_t* out;
+  size_t out_stride;
+  bool is_scaled;
+  bool is_halved;
+  // source pixel ranges for box filter, or pixels and weights for bilinear,
+  // x offsets are in bytes
+  uint32_t* x0s;
+  uint32_t* x1s;
+  uint16_t* fxs;
+  uint32_t* y0s;
+  uint32_t* y1s;
+  uint16_t* fys;
+};
+
+static void box_row(struct transform_ctx* ctx, uint32_t y, uint8_t* dst) {
+  uint32_t y0 = ctx->y0s[y];
+  uint32_t y1 = ctx->y1s[y];
+  for (uint32_t x = 0; x < ctx->transform->width; ++x) {
+    uint32_t sum[4] = { 0, 0, 0, 0 };
+    for (uint32_t sy = y0; sy < y1; ++sy) {
+      const uint8_t* row = ctx->src + sy * ctx->src_stride;
+      for (uint32_t offset = ctx->x0s[x]; offset < ctx->x1s[x]; offset += 4) {
+        sum[0] += row[offset + 0];
+        sum[1] += row[offset + 1];
+        sum[2] += row[offset + 2];
+        sum[3] += row[offset + 3];
+      }
+    }
+    uint32_t count = (y1 - y0) * ((ctx->x1s[x] - ctx->x0s[x]) / 4);
+    for (int c = 0; c < 4; ++c) {
+      dst[x * 4 + c] = (uint8_t)((sum[c] + count / 2) / count);
+    }
+  }
+}
+
+static void transform_rows(void* arg, uint32_t begin, uint32_t end) {
+  struct transform_ctx* ctx = (struct transform_ctx*)arg;
+  const struct ow_pixel_transform* transform = ctx->transform;
+  convert_row_fn convert = kernels.convert[transform->format];
+
+  // scaled row before conversion
+  uint8_t* row = NULL;
+  if (ctx->is_scaled && transform->format != OW_PIXEL_BGRA) {
+    row = malloc((size_t)transform->width * 4);
+    if (row == NULL) return;
+  }
+
+  for (uint32_t y = begin; y < end; ++y) {
+    uint8_t* out = ctx->out + y * ctx->out_stride;
+    if (!ctx->is_scaled) {
+      convert(ctx->src + y * ctx->src_stride, out, transform->width);
+      continue;
+    }
+
+    uint8_t* scaled = (row != NULL) ? row : out;
+    if (transform->filter == OW_SCALE_BILINEAR) {
+      kernels.bilinear_row(
+        ctx->src + ctx->y0s[y] * ctx->src_stride,
+        ctx->src + ctx->y1s[y] * ctx->src_stride,
+        ctx->fys[y], ctx->x0s, ctx->x1s, ctx->fxs,
+        scaled, transform->width);
+    } else if (ctx->is_halved) {
+      kernels.halve_row(
+        ctx->src + (2 * y) * ctx->src_stride,
+        ctx->src + (2 * y + 1) * ctx->src_stride,
+        scaled, transform->width);
+    } else {
+      box_row(ctx, y, scaled);
+    }
+    if (row != NULL) {
+      convert(row, out, transform->width);
+    }
+  }
+  free(row);
+}
+
+// Source range [*start, *stop) of each destination pixel, at least one pixel.
+static void box_spans(uint32_t src_size, uint32_t dst_size, uint32_t scale, uint32_t* starts, uint32_t* stops) {
+  for (uint32_t i = 0; i < dst_size; ++i) {
+    uint32_t start = (uint32_t)(((uint64_t)i * src_size) / dst_size);
+    uint32_t stop = (uint32_t)(((uint64_t)(i + 1) * src_size) / dst_size);
+    if (stop <= start) stop = start + 1;
+    if (stop > src_size) stop = src_size;
+    starts[i] = start * scale;
+    stops[i] = stop * scale;
+  }
+}
+
+// Two nearest source pixels of each destination pixel center and weight of the second one.
+static void bilinear_taps(uint32_t src_size, uint32_t dst_size, uint32_t scale, uint32_t* first, uint32_t* second, uint16_t* weights) {
+  for (uint32_t i = 0; i < dst_size; ++i) {
+    int64_t pos = (int64_t)(((2 * (uint64_t)i + 1) * src_size * 256) / (2 * (uint64_t)dst_size)) - 128;
+    if (pos < 0) pos = 0;
+    uint32_t index = (uint32_t)(pos >> 8);
+    uint32_t weight = (uint32_t)(pos & 0xFF);
+    if (index >= src_size - 1) {
+      index = src_size - 1;
+      weight = 0;
+    }
+    first[i] = index * scale;
+    second[i] = (weight != 0) ? (index + 1) * scale : index * scale;
+    weights[i] = (uint16_t)weight;
+  }
+}
+
+void ow_pixel_transform_apply(const struct ow_pixel_transform* resolved, const uint8_t* src, size_t src_stride, uint8_t* out) {
+  if (resolved->width == 0 || resolved->height == 0) {
+    return;
+  }
+  uv_once(&kernels_once, kernels_init);
+
+  struct transform_ctx ctx = {
+    .transform = resolved,
+    .src = src + (size_t)resolved->crop.y * src_stride + (size_t)resolved->crop.x * 4,
+    .src_stride = src_stride,
+    .out = out,
+    .out_stride = (size_t)resolved->width * ow_pixel_format_size(resolved->format),
+    .is_scaled = (resolved->width != resolved->crop.width || resolved->height != resolved->crop.height),
+    .is_halved = (resolved->crop.width == resolved->width * 2 && resolved->crop.height == resolved->height * 2)
+  };
+
+  bool has_taps = ctx.is_scaled && !(resolved->filter == OW_SCALE_BOX && ctx.is_halved);
+  if (has_taps) {
+    ctx.x0s = malloc(resolved->width * sizeof(uint32_t));
+    ctx.x1s = malloc(resolved->width * sizeof(uint32_t));
+    ctx.fxs = malloc(resolved->width * sizeof(uint16_t));
+    ctx.y0s = malloc(resolved->height * sizeof(uint32_t));
+    ctx.y1s = malloc(resolved->height * sizeof(uint32_t));
+    ctx.fys = malloc(resolved->height * sizeof(uint16_t));
+    if (!ctx.x0s || !ctx.x1s || !ctx.fxs || !ctx.y0s || !ctx.y1s || !ctx.fys) {
+      goto cleanup;
+    }
+    if (resolved->filter == OW_SCALE_BILINEAR) {
+      bilinear_taps(resolved->crop.width, resolved->width, 4, ctx.x0s, ctx.x1s, ctx.fxs);
+      bilinear_taps(resolved->crop.height, resolved->height, 1, ctx.y0s, ctx.y1s, ctx.fys);
+    } else {
+      box_spans(resolved->crop.width, resolved->width, 4, ctx.x0s, ctx.x1s);
+      box_spans(resolved->crop.height, resolved->height, 1, ctx.y0s, ctx.y1s);
+    }
+  }
+
+  uint32_t min_rows = OW_PIXEL_MIN_CHUNK_PIXELS / resolved->width;
+  ow_parallel_for(resolved->height, min_rows ? min_rows : 1, transform_rows, &ctx);
+
+cleanup:
+  free(ctx.x0s);
+  free(ctx.x1s);
+  free(ctx.fxs);
+  free(ctx.y0s);
+  free(ctx.y1s);
+  free(ctx.fys);
+}
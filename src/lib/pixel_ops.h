@@ -0,0 +1,47 @@
+#ifndef ADDON_SRC_PIXEL_OPS_H_
+#define ADDON_SRC_PIXEL_OPS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "overlay_window.h"
+
+enum ow_pixel_format {
+  OW_PIXEL_BGRA = 0,
+  OW_PIXEL_RGBA,
+  OW_PIXEL_RGB,
+  OW_PIXEL_GRAY,
+  OW_PIXEL_FORMAT_COUNT
+};
+
+enum ow_scale_filter {
+  // average of all source pixels covered by the destination pixel
+  OW_SCALE_BOX = 0,
+  OW_SCALE_BILINEAR
+};
+
+// Post-processing of a BGRA capture: crop, then scale, then convert.
+struct ow_pixel_transform {
+  // region of the source, whole source if width or height is 0
+  struct ow_window_bounds crop;
+  // size of the result, size of the cropped region if 0
+  uint32_t width;
+  uint32_t height;
+  enum ow_scale_filter filter;
+  enum ow_pixel_format format;
+};
+
+uint32_t ow_pixel_format_size(enum ow_pixel_format format);
+
+// Clamps crop to the source and fills in the defaults.
+// Returns `false` if the crop region is outside of the source.
+bool ow_pixel_transform_resolve(const struct ow_pixel_transform* transform, uint32_t src_width, uint32_t src_height, struct ow_pixel_transform* resolved);
+
+// `true` if a resolved transform leaves the source as is.
+bool ow_pixel_transform_is_identity(const struct ow_pixel_transform* resolved, uint32_t src_width, uint32_t src_height);
+
+// Applies a resolved transform, `out` must have `width * height * ow_pixel_format_size(format)` bytes.
+// Large images are processed on multiple threads.
+void ow_pixel_transform_apply(const struct ow_pixel_transform* resolved, const uint8_t* src, size_t src_stride, uint8_t* out);
+
+#endif // !ADDON_SRC_PIXEL_OPS_H_
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+#include "probe_set.h"
+#include "region_stats.h"
+
+// Two clusters are captured together if that reads at most
+// this many pixels more than capturing them separately.
+#define OW_PROBE_MERGE_SLACK 4096
+
+static uint64_t area_of(const struct ow_window_bounds* rect) {
+  return (uint64_t)rect->width * rect->height;
+}
+
+static struct ow_window_bounds union_of(const struct ow_window_bounds* a, const struct ow_window_bounds* b) {
+  int64_t left = a->x < b->x ? a->x : b->x;
+  int64_t top = a->y < b->y ? a->y : b->y;
+  int64_t a_right = (int64_t)a->x + a->width;
+  int64_t b_right = (int64_t)b->x + b->width;
+  int64_t a_bottom = (int64_t)a->y + a->height;
+  int64_t b_bottom = (int64_t)b->y + b->height;
+  struct ow_window_bounds result = {
+    (int32_t)left,
+    (int32_t)top,
+    (uint32_t)((a_right > b_right ? a_right : b_right) - left),
+    (uint32_t)((a_bottom > b_bottom ? a_bottom : b_bottom) - top)
+  };
+  return result;
+}
+
+// Returns `false` if nothing is left.
+static bool clip_to(struct ow_window_bounds* rect, const struct ow_window_bounds* bounds) {
+  int64_t left = rect->x > bounds->x ? rect->x : bounds->x;
+  int64_t top = rect->y > bounds->y ? rect->y : bounds->y;
+  int64_t right = (int64_t)rect->x + rect->width;
+  int64_t bottom = (int64_t)rect->y + rect->height;
+  int64_t bounds_right = (int64_t)bounds->x + bounds->width;
+  int64_t bounds_bottom = (int64_t)bounds->y + bounds->height;
+  if (right > bounds_right) right = bounds_right;
+  if (bottom > bounds_bottom) bottom = bounds_bottom;
+  if (right <= left || bottom <= top) {
+    return false;
+  }
+  rect->x = (int32_t)left;
+  rect->y = (int32_t)top;
+  rect->width = (uint32_t)(right - left);
+  rect->height = (uint32_t)(bottom - top);
+  return true;
+}
+
+bool ow_probe_set_init(struct ow_probe_set* set, const struct ow_window_bounds* regions, uint32_t count) {
+  memset(set, 0, sizeof(struct ow_probe_set));
+  for (uint32_t i = 0; i < count; ++i) {
+    if (regions[i].width == 0 || regions[i].height == 0) {
+      return false;
+    }
+  }
+
+  size_t size = (count ? count : 1);
+  set->count = count;
+  set->regions = malloc(size * sizeof(struct ow_window_bounds));
+  set->region_cluster = malloc(size * sizeof(uint32_t));
+  set->clusters = malloc(size * sizeof(struct ow_window_bounds));
+  if (count) {
+    memcpy(set->regions, regions, count * sizeof(struct ow_window_bounds));
+    memcpy(set->clusters, regions, count * sizeof(struct ow_window_bounds));
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    set->region_cluster[i] = i;
+  }
+  set->cluster_count = count;
+
+  // greedy, there are only a few dozen regions
+  bool is_merged = true;
+  while (is_merged) {
+    is_merged = false;
+    for (uint32_t a = 0; a < set->cluster_count && !is_merged; ++a) {
+      for (uint32_t b = a + 1; b < set->cluster_count && !is_merged; ++b) {
+        struct ow_window_bounds merged = union_of(&set->clusters[a], &set->clusters[b]);
+        if (area_of(&merged) > area_of(&set->clusters[a]) + area_of(&set->clusters[b]) + OW_PROBE_MERGE_SLACK) {
+          continue;
+        }
+        set->clusters[a] = merged;
+        // last cluster takes the place of `b`
+        uint32_t last = set->cluster_count - 1;
+        set->clusters[b] = set->clusters[last];
+        for (uint32_t i = 0; i < count; ++i) {
+          if (set->region_cluster[i] == b) set->region_cluster[i] = a;
+          else if (set->region_cluster[i] == last) set->region_cluster[i] = b;
+        }
+        set->cluster_count = last;
+        is_merged = true;
+      }
+    }
+  }
+  return true;
+}
+
+void ow_probe_set_free(struct ow_probe_set* set) {
+  free(set->regions);
+  free(set->region_cluster);
+  free(set->clusters);
+  memset(set, 0, sizeof(struct ow_probe_set));
+}
+
+static void write_stats(const struct ow_region_stats* stats, uint32_t* out) {
+  out[0] = stats->count;
+  for (int c = 0; c < 3; ++c) {
+    out[1 + c] = stats->mean[c];
+    out[4 + c] = stats->min[c];
+    out[7 + c] = stats->max[c];
+    for (int bin = 0; bin < OW_REGION_HISTOGRAM_BINS; ++bin) {
+      out[10 + c * OW_REGION_HISTOGRAM_BINS + bin] = stats->histogram[c][bin];
+    }
+  }
+}
+
+void ow_probe_set_read(struct ow_probe_set* set, ow_probe_capture_fn capture, struct ow_hook* hook, uint32_t width, uint32_t height, uint32_t* out) {
+  memset(out, 0, (size_t)set->count * OW_PROBE_STATS_LENGTH * sizeof(uint32_t));
+
+  struct ow_window_bounds target = { 0, 0, width, height };
+  uint8_t* pixels = NULL;
+  size_t capacity = 0;
+  for (uint32_t k = 0; k < set->cluster_count; ++k) {
+    struct ow_window_bounds area = set->clusters[k];
+    if (!clip_to(&area, &target)) continue;
+
+    size_t size = (size_t)area.width * area.height * 4;
+    if (size > capacity) {
+      free(pixels);
+      pixels = malloc(size);
+      capacity = pixels ? size : 0;
+      if (pixels == NULL) return;
+    }
+    capture(hook, pixels, width, height, &area);
+
+    for (uint32_t i = 0; i < set->count; ++i) {
+      if (set->region_cluster[i] != k) continue;
+      struct ow_window_bounds region = set->regions[i];
+      if (!clip_to(&region, &area)) continue;
+
+      struct ow_region_stats stats;
+      const uint8_t* start = pixels + ((size_t)(region.y - area.y) * area.width + (region.x - area.x)) * 4;
+      ow_region_stats_compute(start, (size_t)area.width * 4, region.width, region.height, &stats);
+      write_stats(&stats, out + (size_t)i * OW_PROBE_STATS_LENGTH);
+    }
+  }
+  free(pixels);
+}
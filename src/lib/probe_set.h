@@ -0,0 +1,36 @@
+#ifndef ADDON_SRC_PROBE_SET_H_
+#define ADDON_SRC_PROBE_SET_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "overlay_window.h"
+
+// Packed result of one region, all values are uint32:
+// [count, mean r g b, min r g b, max r g b, histogram r[16] g[16] b[16]]
+// `count` is 0 if the region is outside of the target.
+#define OW_PROBE_STATS_LENGTH 58
+
+// Same signature as `ow_screenshot_area`.
+typedef void (*ow_probe_capture_fn)(struct ow_hook* hook, uint8_t* out, uint32_t width, uint32_t height, const struct ow_window_bounds* area);
+
+// Regions relative to the target's content area. Nearby regions are grouped
+// into clusters, each cluster is captured as one rectangle.
+struct ow_probe_set {
+  uint32_t count;
+  struct ow_window_bounds* regions;
+  // cluster of every region
+  uint32_t* region_cluster;
+  uint32_t cluster_count;
+  struct ow_window_bounds* clusters;
+};
+
+// Returns `false` if a region is empty.
+bool ow_probe_set_init(struct ow_probe_set* set, const struct ow_window_bounds* regions, uint32_t count);
+
+void ow_probe_set_free(struct ow_probe_set* set);
+
+// Captures the regions of a `width` x `height` target of `hook` and writes
+// `count * OW_PROBE_STATS_LENGTH` values into `out`.
+void ow_probe_set_read(struct ow_probe_set* set, ow_probe_capture_fn capture, struct ow_hook* hook, uint32_t width, uint32_t height, uint32_t* out);
+
+#endif // !ADDON_SRC_PROBE_SET_H_
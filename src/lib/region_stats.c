@@ -0,0 +1,112 @@
+#include <string.h>
+#include "cpu_features.h"
+#include "region_stats.h"
+
+#ifdef OW_CPU_X64
+#include <immintrin.h>
+#endif
+
+struct stats_acc {
+  uint64_t sum[3];
+  uint8_t min[3];
+  uint8_t max[3];
+};
+
+// Pixel by pixel, also used for the tail of SIMD rows.
+static void acc_pixels(const uint8_t* px, uint32_t count, struct stats_acc* acc) {
+  for (uint32_t i = 0; i < count; ++i, px += 4) {
+    // BGRA -> RGB
+    for (int c = 0; c < 3; ++c) {
+      uint8_t value = px[2 - c];
+      acc->sum[c] += value;
+      if (value < acc->min[c]) acc->min[c] = value;
+      if (value > acc->max[c]) acc->max[c] = value;
+    }
+  }
+}
+
+static void histogram_pixels(const uint8_t* px, uint32_t count, struct ow_region_stats* stats) {
+  for (uint32_t i = 0; i < count; ++i, px += 4) {
+    stats->histogram[0][px[2] >> 4] += 1;
+    stats->histogram[1][px[1] >> 4] += 1;
+    stats->histogram[2][px[0] >> 4] += 1;
+  }
+}
+
+#ifdef OW_CPU_X64
+// SSE2 is part of x86-64. Sums use SAD against zero on one channel at a
+// time, min/max are kept per byte and reduced at the end.
+static void acc_rows_sse2(const uint8_t* data, size_t stride, uint32_t width, uint32_t height, struct stats_acc* acc) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i mask_b = _mm_set1_epi32(0x000000FF);
+  const __m128i mask_g = _mm_set1_epi32(0x0000FF00);
+  const __m128i mask_r = _mm_set1_epi32(0x00FF0000);
+  __m128i sum_b = zero;
+  __m128i sum_g = zero;
+  __m128i sum_r = zero;
+  __m128i min = _mm_set1_epi8((char)0xFF);
+  __m128i max = zero;
+
+  for (uint32_t y = 0; y < height; ++y) {
+    const uint8_t* row = data + y * stride;
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+      __m128i px = _mm_loadu_si128((const __m128i*)(row + x * 4));
+      sum_b = _mm_add_epi64(sum_b, _mm_sad_epu8(_mm_and_si128(px, mask_b), zero));
+      sum_g = _mm_add_epi64(sum_g, _mm_sad_epu8(_mm_and_si128(px, mask_g), zero));
+      sum_r = _mm_add_epi64(sum_r, _mm_sad_epu8(_mm_and_si128(px, mask_r), zero));
+      min = _mm_min_epu8(min, px);
+      max = _mm_max_epu8(max, px);
+    }
+    acc_pixels(row + x * 4, width - x, acc);
+  }
+
+  uint64_t sums[3][2];
+  _mm_storeu_si128((__m128i*)sums[0], sum_r);
+  _mm_storeu_si128((__m128i*)sums[1], sum_g);
+  _mm_storeu_si128((__m128i*)sums[2], sum_b);
+  uint8_t mins[16], maxs[16];
+  _mm_storeu_si128((__m128i*)mins, min);
+  _mm_storeu_si128((__m128i*)maxs, max);
+  for (int c = 0; c < 3; ++c) {
+    acc->sum[c] += sums[c][0] + sums[c][1];
+    for (int i = 0; i < 4; ++i) {
+      uint8_t lane_min = mins[i * 4 + 2 - c];
+      uint8_t lane_max = maxs[i * 4 + 2 - c];
+      if (lane_min < acc->min[c]) acc->min[c] = lane_min;
+      if (lane_max > acc->max[c]) acc->max[c] = lane_max;
+    }
+  }
+}
+#endif
+
+void ow_region_stats_compute(const uint8_t* data, size_t stride, uint32_t width, uint32_t height, struct ow_region_stats* stats) {
+  memset(stats, 0, sizeof(struct ow_region_stats));
+  if (width == 0 || height == 0) {
+    return;
+  }
+
+  struct stats_acc acc = {
+    .sum = { 0, 0, 0 },
+    .min = { 0xFF, 0xFF, 0xFF },
+    .max = { 0, 0, 0 }
+  };
+#ifdef OW_CPU_X64
+  acc_rows_sse2(data, stride, width, height, &acc);
+#else
+  for (uint32_t y = 0; y < height; ++y) {
+    acc_pixels(data + y * stride, width, &acc);
+  }
+#endif
+  // scattered increments don't vectorize
+  for (uint32_t y = 0; y < height; ++y) {
+    histogram_pixels(data + y * stride, width, stats);
+  }
+
+  stats->count = width * height;
+  for (int c = 0; c < 3; ++c) {
+    stats->mean[c] = (uint8_t)((acc.sum[c] + stats->count / 2) / stats->count);
+    stats->min[c] = acc.min[c];
+    stats->max[c] = acc.max[c];
+  }
+}
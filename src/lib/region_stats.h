@@ -0,0 +1,21 @@
+#ifndef ADDON_SRC_REGION_STATS_H_
+#define ADDON_SRC_REGION_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OW_REGION_HISTOGRAM_BINS 16
+
+// Color statistics of a BGRA region, channels are in RGB order.
+struct ow_region_stats {
+  uint32_t count;
+  uint8_t mean[3];
+  uint8_t min[3];
+  uint8_t max[3];
+  // value >> 4 of each channel
+  uint32_t histogram[3][OW_REGION_HISTOGRAM_BINS];
+};
+
+void ow_region_stats_compute(const uint8_t* data, size_t stride, uint32_t width, uint32_t height, struct ow_region_stats* stats);
+
+#endif // !ADDON_SRC_REGION_STATS_H_
@@ -0,0 +1,64 @@
+#include <string.h>
+#include "atomics.h"
+#include "target_state.h"
+
+void ow_target_state_init(struct ow_target_state_block* block) {
+  memset(block, 0, sizeof(struct ow_target_state_block));
+}
+
+void ow_target_state_apply(struct ow_target_state_block* block, struct ow_event* event) {
+  // single writer, can read its own state without seqlock
+  struct ow_target_state next = block->state;
+  next.generation += 1;
+
+  switch (event->type) {
+  case OW_ATTACH:
+    next.flags |= OW_STATE_ATTACHED;
+    if (event->data.attach.is_fullscreen == 1) {
+      next.flags |= OW_STATE_FULLSCREEN;
+    } else if (event->data.attach.is_fullscreen == 0) {
+      next.flags &= ~OW_STATE_FULLSCREEN;
+    }
+    next.bounds = event->data.attach.bounds;
+    next.window_id = event->data.attach.window_id;
+    break;
+  case OW_FOCUS:
+    next.flags |= OW_STATE_FOCUSED;
+    break;
+  case OW_BLUR:
+    next.flags &= ~OW_STATE_FOCUSED;
+    break;
+  case OW_DETACH:
+    next.flags &= ~(OW_STATE_ATTACHED | OW_STATE_FOCUSED);
+    next.window_id = 0;
+    break;
+  case OW_FULLSCREEN:
+    if (event->data.fullscreen.is_fullscreen) {
+      next.flags |= OW_STATE_FULLSCREEN;
+    } else {
+      next.flags &= ~OW_STATE_FULLSCREEN;
+    }
+    break;
+  case OW_MOVERESIZE:
+    next.bounds = event->data.moveresize.bounds;
+    break;
+  }
+
+  uint32_t seq = block->seq;
+  ow_atomic_store(&block->seq, seq + 1);
+  ow_atomic_fence();
+  block->state = next;
+  ow_atomic_store(&block->seq, seq + 2);
+}
+
+void ow_target_state_read(struct ow_target_state_block* block, struct ow_target_state* state) {
+  uint32_t seq_begin;
+  uint32_t seq_end = 0;
+  do {
+    seq_begin = ow_atomic_load(&block->seq);
+    if (seq_begin & 1) continue;
+    *state = block->state;
+    ow_atomic_fence();
+    seq_end = ow_atomic_load(&block->seq);
+  } while ((seq_begin & 1) || seq_begin != seq_end);
+}
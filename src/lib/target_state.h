@@ -0,0 +1,36 @@
+#ifndef ADDON_SRC_TARGET_STATE_H_
+#define ADDON_SRC_TARGET_STATE_H_
+
+#include <stdint.h>
+#include "overlay_window.h"
+
+enum ow_target_state_flags {
+  OW_STATE_ATTACHED = 1 << 0,
+  OW_STATE_FOCUSED = 1 << 1,
+  OW_STATE_FULLSCREEN = 1 << 2,
+};
+
+struct ow_target_state {
+  // incremented on every change
+  uint32_t generation;
+  // `enum ow_target_state_flags`
+  uint32_t flags;
+  struct ow_window_bounds bounds;
+  uint64_t window_id;
+};
+
+// Latest known state of the target window. Written only by the hook thread,
+// readers on any thread get a consistent snapshot without blocking the writer.
+struct ow_target_state_block {
+  volatile uint32_t seq;
+  struct ow_target_state state;
+};
+
+void ow_target_state_init(struct ow_target_state_block* block);
+
+// Called by the hook thread before the event is queued for JS.
+void ow_target_state_apply(struct ow_target_state_block* block, struct ow_event* event);
+
+void ow_target_state_read(struct ow_target_state_block* block, struct ow_target_state* state);
+
+#endif // !ADDON_SRC_TARGET_STATE_H_
@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+#include "cpu_features.h"
+#include "parallel.h"
+#include "tile_hash.h"
+
+#ifdef OW_CPU_X64
+#include <immintrin.h>
+#endif
+
+// pixels per parallel chunk, smaller images are hashed on the calling thread
+#define OW_TILE_HASH_MIN_CHUNK_PIXELS 65536
+#define OW_TILE_HASH_MAX_SIZE 256
+
+// Continues the CRC of each tile in the row with its part of one image row.
+typedef void (*hash_row_fn)(const uint8_t* row, uint32_t row_bytes, uint32_t tile_bytes, uint32_t* crcs, uint32_t cols);
+
+static uv_once_t crc_once = UV_ONCE_INIT;
+// CRC32C (Castagnoli), slicing-by-8
+static uint32_t crc_table[8][256];
+static hash_row_fn hash_row;
+
+static uint32_t crc32c_update_scalar(uint32_t crc, const uint8_t* data, size_t length) {
+  while (length >= 8) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    word ^= crc;
+    crc = (
+      crc_table[7][word & 0xFF] ^
+      crc_table[6][(word >> 8) & 0xFF] ^
+      crc_table[5][(word >> 16) & 0xFF] ^
+      crc_table[4][(word >> 24) & 0xFF] ^
+      crc_table[3][(word >> 32) & 0xFF] ^
+      crc_table[2][(word >> 40) & 0xFF] ^
+      crc_table[1][(word >> 48) & 0xFF] ^
+      crc_table[0][word >> 56]
+    );
+    data += 8;
+    length -= 8;
+  }
+  while (length--) {
+    crc = crc_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+static void hash_row_scalar(const uint8_t* row, uint32_t row_bytes, uint32_t tile_bytes, uint32_t* crcs, uint32_t cols) {
+  for (uint32_t c = 0; c < cols; ++c) {
+    uint32_t begin = c * tile_bytes;
+    uint32_t length = (row_bytes - begin < tile_bytes) ? row_bytes - begin : tile_bytes;
+    crcs[c] = crc32c_update_scalar(crcs[c], row + begin, length);
+  }
+}
+
+#ifdef OW_CPU_X64
+OW_TARGET_SSE42
+static uint32_t crc32c_update_sse42(uint32_t crc, const uint8_t* data, size_t length) {
+  uint64_t crc64 = crc;
+  while (length >= 8) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+    data += 8;
+    length -= 8;
+  }
+  crc = (uint32_t)crc64;
+  while (length--) {
+    crc = _mm_crc32_u8(crc, *data++);
+  }
+  return crc;
+}
+
+OW_TARGET_SSE42
+static void hash_row_sse42(const uint8_t* row, uint32_t row_bytes, uint32_t tile_bytes, uint32_t* crcs, uint32_t cols) {
+  uint32_t full_tiles = row_bytes / tile_bytes;
+  uint32_t c = 0;
+  // crc32 has a latency of 3 cycles, three tiles at once keep it busy
+  for (; c + 3 <= full_tiles; c += 3) {
+    const uint8_t* p0 = row + c * tile_bytes;
+    const uint8_t* p1 = p0 + tile_bytes;
+    const uint8_t* p2 = p1 + tile_bytes;
+    uint64_t crc0 = crcs[c];
+    uint64_t crc1 = crcs[c + 1];
+    uint64_t crc2 = crcs[c + 2];
+    for (uint32_t i = 0; i < tile_bytes; i += 8) {
+      uint64_t w0, w1, w2;
+      memcpy(&w0, p0 + i, 8);
+      memcpy(&w1, p1 + i, 8);
+      memcpy(&w2, p2 + i, 8);
+      crc0 = _mm_crc32_u64(crc0, w0);
+      crc1 = _mm_crc32_u64(crc1, w1);
+      crc2 = _mm_crc32_u64(crc2, w2);
+    }
+    crcs[c] = (uint32_t)crc0;
+    crcs[c + 1] = (uint32_t)crc1;
+    crcs[c + 2] = (uint32_t)crc2;
+  }
+  for (; c < cols; ++c) {
+    uint32_t begin = c * tile_bytes;
+    uint32_t length = (row_bytes - begin < tile_bytes) ? row_bytes - begin : tile_bytes;
+    crcs[c] = crc32c_update_sse42(crcs[c], row + begin, length);
+  }
+}
+#endif
+
+static void crc_init(void) {
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+    }
+    crc_table[0][i] = crc;
+  }
+  for (uint32_t i = 0; i < 256; ++i) {
+    for (int k = 1; k < 8; ++k) {
+      crc_table[k][i] = (crc_table[k - 1][i] >> 8) ^ crc_table[0][crc_table[k - 1][i] & 0xFF];
+    }
+  }
+
+  hash_row = hash_row_scalar;
+#ifdef OW_CPU_X64
+  if (ow_cpu_has_sse42()) {
+    hash_row = hash_row_sse42;
+  }
+#endif
+}
+
+void ow_tile_hash_init(struct ow_tile_hash* th, uint32_t tile_size) {
+  memset(th, 0, sizeof(struct ow_tile_hash));
+  if (tile_size == 0) tile_size = OW_TILE_HASH_DEFAULT_SIZE;
+  if (tile_size > OW_TILE_HASH_MAX_SIZE) tile_size = OW_TILE_HASH_MAX_SIZE;
+  // whole 64-bit words per tile row
+  th->tile_size = (tile_size + 7) & ~7u;
+}
+
+void ow_tile_hash_free(struct ow_tile_hash* th) {
+  free(th->hashes);
+  free(th->dirty);
+  th->hashes = NULL;
+  th->dirty = NULL;
+  th->cols = 0;
+  th->rows = 0;
+  th->has_previous = false;
+}
+
+void ow_tile_hash_reset(struct ow_tile_hash* th) {
+  th->has_previous = false;
+}
+
+struct hash_ctx {
+  struct ow_tile_hash* th;
+  const uint8_t* data;
+  size_t stride;
+  uint32_t row_bytes;
+  uint32_t tile_bytes;
+  bool is_comparable;
+};
+
+static void hash_tile_rows(void* arg, uint32_t begin, uint32_t end) {
+  struct hash_ctx* ctx = (struct hash_ctx*)arg;
+  struct ow_tile_hash* th = ctx->th;
+
+  uint32_t* crcs = malloc(th->cols * sizeof(uint32_t));
+  if (crcs == NULL) return;
+
+  for (uint32_t r = begin; r < end; ++r) {
+    for (uint32_t c = 0; c < th->cols; ++c) {
+      crcs[c] = 0xFFFFFFFF;
+    }
+    uint32_t y_end = (r + 1) * th->tile_size;
+    if (y_end > th->height) y_end = th->height;
+    for (uint32_t y = r * th->tile_size; y < y_end; ++y) {
+      hash_row(ctx->data + y * ctx->stride, ctx->row_bytes, ctx->tile_bytes, crcs, th->cols);
+    }
+
+    uint32_t* hashes = th->hashes + r * th->cols;
+    uint8_t* dirty = th->dirty + r * th->cols;
+    for (uint32_t c = 0; c < th->cols; ++c) {
+      uint32_t hash = ~crcs[c];
+      dirty[c] = !ctx->is_comparable || hashes[c] != hash;
+      hashes[c] = hash;
+    }
+  }
+  free(crcs);
+}
+
+uint32_t ow_tile_hash_update(struct ow_tile_hash* th, const uint8_t* data, size_t stride, uint32_t width, uint32_t height, uint32_t bytes_per_pixel) {
+  uv_once(&crc_once, crc_init);
+
+  bool is_comparable = th->has_previous && th->width == width && th->height == height;
+  if (!is_comparable) {
+    uint32_t cols = (width + th->tile_size - 1) / th->tile_size;
+    uint32_t rows = (height + th->tile_size - 1) / th->tile_size;
+    if (cols * rows != th->cols * th->rows) {
+      ow_tile_hash_free(th);
+      if (cols * rows != 0) {
+        th->hashes = malloc((size_t)cols * rows * sizeof(uint32_t));
+        th->dirty = malloc((size_t)cols * rows);
+        if (th->hashes == NULL || th->dirty == NULL) {
+          ow_tile_hash_free(th);
+          return 0;
+        }
+      }
+    }
+    th->width = width;
+    th->height = height;
+    th->cols = cols;
+    th->rows = rows;
+  }
+  th->has_previous = true;
+  th->changed_pixels = 0;
+  if (th->cols == 0 || th->rows == 0) {
+    return 0;
+  }
+
+  struct hash_ctx ctx = {
+    .th = th,
+    .data = data,
+    .stride = stride,
+    .row_bytes = width * bytes_per_pixel,
+    .tile_bytes = th->tile_size * bytes_per_pixel,
+    .is_comparable = is_comparable
+  };
+  uint32_t min_rows = OW_TILE_HASH_MIN_CHUNK_PIXELS / (width * th->tile_size);
+  ow_parallel_for(th->rows, min_rows ? min_rows : 1, hash_tile_rows, &ctx);
+
+  uint32_t changed = 0;
+  for (uint32_t r = 0; r < th->rows; ++r) {
+    uint32_t tile_height = (r + 1 == th->rows) ? th->height - r * th->tile_size : th->tile_size;
+    for (uint32_t c = 0; c < th->cols; ++c) {
+      if (!th->dirty[r * th->cols + c]) continue;
+      uint32_t tile_width = (c + 1 == th->cols) ? th->width - c * th->tile_size : th->tile_size;
+      th->changed_pixels += (uint64_t)tile_width * tile_height;
+      changed += 1;
+    }
+  }
+  return changed;
+}
+
+uint32_t ow_tile_hash_rects(const struct ow_tile_hash* th, struct ow_window_bounds** rects) {
+  *rects = NULL;
+  if (!th->has_previous || th->changed_pixels == 0) {
+    return 0;
+  }
+
+  struct ow_window_bounds* result = malloc((size_t)th->cols * th->rows * sizeof(struct ow_window_bounds));
+  // rect that covers a run starting at the column in the previous/current tile row
+  int32_t* prev_open = malloc(th->cols * sizeof(int32_t));
+  int32_t* open = malloc(th->cols * sizeof(int32_t));
+  uint32_t count = 0;
+  if (result == NULL || prev_open == NULL || open == NULL) {
+    free(result);
+    result = NULL;
+    goto cleanup;
+  }
+  for (uint32_t c = 0; c < th->cols; ++c) {
+    prev_open[c] = -1;
+  }
+
+  for (uint32_t r = 0; r < th->rows; ++r) {
+    for (uint32_t c = 0; c < th->cols; ++c) {
+      open[c] = -1;
+    }
+    int32_t y = (int32_t)(r * th->tile_size);
+    uint32_t tile_height = (r + 1 == th->rows) ? th->height - r * th->tile_size : th->tile_size;
+
+    uint32_t c = 0;
+    while (c < th->cols) {
+      if (!th->dirty[r * th->cols + c]) {
+        c += 1;
+        continue;
+      }
+      uint32_t run_start = c;
+      while (c < th->cols && th->dirty[r * th->cols + c]) {
+        c += 1;
+      }
+      int32_t x = (int32_t)(run_start * th->tile_size);
+      uint32_t right = c * th->tile_size;
+      uint32_t width = ((right < th->width) ? right : th->width) - (uint32_t)x;
+
+      // grow the rect from the row above if it has the same span
+      int32_t above = prev_open[run_start];
+      if (above >= 0 && result[above].width == width) {
+        result[above].height += tile_height;
+        open[run_start] = above;
+      } else {
+        struct ow_window_bounds rect = { x, y, width, tile_height };
+        result[count] = rect;
+        open[run_start] = (int32_t)count;
+        count += 1;
+      }
+    }
+
+    int32_t* swap = prev_open;
+    prev_open = open;
+    open = swap;
+  }
+
+cleanup:
+  free(prev_open);
+  free(open);
+  *rects = result;
+  return count;
+}
@@ -0,0 +1,47 @@
+#ifndef ADDON_SRC_TILE_HASH_H_
+#define ADDON_SRC_TILE_HASH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "overlay_window.h"
+
+#define OW_TILE_HASH_DEFAULT_SIZE 32
+
+// Detects which parts of an image changed since the previous one by keeping
+// a CRC32C of every square tile. Not thread-safe, one instance per image source.
+struct ow_tile_hash
+{
+  // multiple of 8 pixels
+  uint32_t tile_size;
+  // size of the previous image
+  uint32_t width;
+  uint32_t height;
+  uint32_t cols;
+  uint32_t rows;
+  bool has_previous;
+  // cols * rows, of the previous image
+  uint32_t* hashes;
+  // cols * rows, non-zero if the tile changed in the last update
+  uint8_t* dirty;
+  // pixels inside dirty tiles
+  uint64_t changed_pixels;
+};
+
+void ow_tile_hash_init(struct ow_tile_hash* th, uint32_t tile_size);
+
+void ow_tile_hash_free(struct ow_tile_hash* th);
+
+// Next update reports the whole image as changed.
+void ow_tile_hash_reset(struct ow_tile_hash* th);
+
+// Hashes the image and compares it to the previous one, everything is changed
+// if the size is different. Returns the number of changed tiles.
+// Large images are hashed on multiple threads.
+uint32_t ow_tile_hash_update(struct ow_tile_hash* th, const uint8_t* data, size_t stride, uint32_t width, uint32_t height, uint32_t bytes_per_pixel);
+
+// Stores changed tiles merged into rectangles into `rects` and returns
+// their count, free with `free`.
+uint32_t ow_tile_hash_rects(const struct ow_tile_hash* th, struct ow_window_bounds** rects);
+
+#endif // !ADDON_SRC_TILE_HASH_H_
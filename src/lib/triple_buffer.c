@@ -0,0 +1,43 @@
+#include <stdlib.h>
+#include <string.h>
+#include "atomics.h"
+#include "triple_buffer.h"
+
+#define OW_TRIPLE_BUFFER_FRESH 4
+#define OW_TRIPLE_BUFFER_INDEX 3
+
+void ow_triple_buffer_init(struct ow_triple_buffer* tb) {
+  memset(tb, 0, sizeof(struct ow_triple_buffer));
+  tb->back = 0;
+  tb->middle = 1;
+  tb->front = 2;
+}
+
+void ow_triple_buffer_free(struct ow_triple_buffer* tb) {
+  for (int i = 0; i < 3; ++i) {
+    free(tb->frames[i].data);
+  }
+  ow_triple_buffer_init(tb);
+}
+
+struct ow_frame* ow_triple_buffer_back(struct ow_triple_buffer* tb, size_t size) {
+  struct ow_frame* frame = &tb->frames[tb->back];
+  if (frame->capacity < size) {
+    free(frame->data);
+    frame->data = malloc(size);
+    frame->capacity = (frame->data != NULL) ? size : 0;
+  }
+  return frame;
+}
+
+void ow_triple_buffer_publish(struct ow_triple_buffer* tb) {
+  tb->back = ow_atomic_exchange(&tb->middle, tb->back | OW_TRIPLE_BUFFER_FRESH) & OW_TRIPLE_BUFFER_INDEX;
+}
+
+struct ow_frame* ow_triple_buffer_acquire(struct ow_triple_buffer* tb) {
+  if (ow_atomic_load(&tb->middle) & OW_TRIPLE_BUFFER_FRESH) {
+    tb->front = ow_atomic_exchange(&tb->middle, tb->front) & OW_TRIPLE_BUFFER_INDEX;
+  }
+  struct ow_frame* frame = &tb->frames[tb->front];
+  return (frame->seq != 0) ? frame : NULL;
+}
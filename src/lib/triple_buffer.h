@@ -0,0 +1,45 @@
+#ifndef ADDON_SRC_TRIPLE_BUFFER_H_
+#define ADDON_SRC_TRIPLE_BUFFER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct ow_frame {
+  uint8_t* data;
+  size_t capacity;
+  uint32_t seq;
+  uint32_t width;
+  uint32_t height;
+};
+
+// Lock-free exchange of frames between one producer and one consumer.
+// Producer always has a buffer to write into, consumer always gets the
+// latest published frame, and neither waits for the other.
+struct ow_triple_buffer {
+  struct ow_frame frames[3];
+  // index of the last published frame, `OW_TRIPLE_BUFFER_FRESH` is set
+  // until the consumer takes it
+  volatile uint32_t middle;
+  // owned by producer
+  uint32_t back;
+  // owned by consumer
+  uint32_t front;
+};
+
+void ow_triple_buffer_init(struct ow_triple_buffer* tb);
+
+// Releases frame memory, neither side may use the buffer at this point.
+void ow_triple_buffer_free(struct ow_triple_buffer* tb);
+
+// Called by producer. Returns frame to write into with at least `size` bytes of data.
+struct ow_frame* ow_triple_buffer_back(struct ow_triple_buffer* tb, size_t size);
+
+// Called by producer after writing the back frame.
+void ow_triple_buffer_publish(struct ow_triple_buffer* tb);
+
+// Called by consumer. Returns the latest published frame, that may be the
+// same frame as on the previous call, or NULL if nothing was published yet.
+struct ow_frame* ow_triple_buffer_acquire(struct ow_triple_buffer* tb);
+
+#endif // !ADDON_SRC_TRIPLE_BUFFER_H_
@@ -5,12 +5,14 @@
 #include <Windows.h>
 #include <oleacc.h>
 #include "overlay_window.h"
+#include "matcher.h"
+#include "metrics.h"
 
 #define OW_FOREGROUND_TIMER_MS 83 // 12 fps
 
 struct ow_target_window
 {
-  char* title;
+  struct ow_matcher* matcher;
   HWND hwnd;
   HWINEVENTHOOK location_hook;
   HWINEVENTHOOK destroy_hook;
@@ -23,12 +25,33 @@ struct ow_overlay_window
   HWND hwnd;
 };
 
+// Backend runs one hook per process, another one can be started once it's stopped.
+struct ow_hook
+{
+  // guards `context`, `metrics` and `is_started`
+  uv_mutex_t lock;
+  void* context;
+  struct ow_metrics* metrics;
+  bool is_started;
+  bool has_thread;
+  // thread running the message loop, it exits on WM_QUIT
+  DWORD thread_id;
+  // posted by the hook thread once it has a message queue
+  uv_sem_t thread_ready;
+};
+
+static uv_once_t hook_init_once = UV_ONCE_INIT;
+static struct ow_hook process_hook;
+static uv_thread_t hook_tid;
 static HWND foreground_window = NULL;
 static HWINEVENTHOOK fg_window_namechange_hook = NULL;
 static UINT WM_OVERLAY_UIPI_TEST = WM_NULL;
+// `uv_hrtime()` and tick count of the WinEvent being handled, 0 during startup
+static uint64_t event_receive_ns = 0;
+static DWORD event_tick_time = 0;
 
 static struct ow_target_window target_info = {
-  .title = NULL,
+  .matcher = NULL,
   .hwnd = NULL,
   .location_hook = NULL,
   .destroy_hook = NULL,
@@ -42,6 +65,27 @@ static struct ow_overlay_window overlay_info = {
 
 static VOID CALLBACK hook_proc(HWINEVENTHOOK, DWORD, HWND, LONG, LONG, DWORD, DWORD);
 
+// Stamps events with the WinEvent that caused them.
+static void emit_event(struct ow_event* e) {
+  e->receive_ns = event_receive_ns;
+  e->source_time_ms = event_tick_time;
+  uv_mutex_lock(&process_hook.lock);
+  if (event_receive_ns != 0) {
+    // event time is from `GetTickCount`, so it's always comparable
+    DWORD latency_ms = GetTickCount() - event_tick_time;
+    ow_metrics_record_latency(process_hook.metrics, OW_LATENCY_SOURCE, e->type, (uint64_t)latency_ms * 1000000);
+  }
+  if (process_hook.context != NULL) {
+    ow_emit_event(process_hook.context, e);
+  }
+  uv_mutex_unlock(&process_hook.lock);
+}
+
+static void receive_event(DWORD dwmsEventTime) {
+  event_receive_ns = uv_hrtime();
+  event_tick_time = dwmsEventTime;
+}
+
 static bool has_uipi_access(HWND hwnd) {
   SetLastError(ERROR_SUCCESS);
   PostMessage(hwnd, WM_OVERLAY_UIPI_TEST, 0, 0);
@@ -134,7 +178,7 @@ static void handle_movesize_event(struct ow_target_window* target_info) {
         .bounds = bounds
       }
     };
-    ow_emit_event(&e);
+    emit_event(&e);
   }
 }
 
@@ -149,21 +193,21 @@ static void check_and_handle_window(HWND hwnd, struct ow_target_window* target_i
       if (target_info->is_focused) {
         target_info->is_focused = false;
         struct ow_event e = { .type = OW_BLUR };
-        ow_emit_event(&e);
+        emit_event(&e);
       }
 
       if (target_info->is_destroyed) {
         target_info->hwnd = NULL;
         target_info->is_destroyed = false;
         struct ow_event e = { .type = OW_DETACH };
-        ow_emit_event(&e);
+        emit_event(&e);
       }
     }
     else if (target_info->hwnd == hwnd) {
       if (!target_info->is_focused) {
         target_info->is_focused = true;
         struct ow_event e = { .type = OW_FOCUS };
-        ow_emit_event(&e);
+        emit_event(&e);
       }
       return;
     }
@@ -173,7 +217,7 @@ static void check_and_handle_window(HWND hwnd, struct ow_target_window* target_i
   if (!get_title(hwnd, &title) || title == NULL) {
     return;
   }
-  bool is_equal = (strcmp(title, target_info->title) == 0);
+  bool is_equal = ow_matcher_match_title(target_info->matcher, title, strlen(title), false);
   free(title);
   if (!is_equal) {
     return;
@@ -205,17 +249,18 @@ static void check_and_handle_window(HWND hwnd, struct ow_target_window* target_i
     .type = OW_ATTACH,
     .data.attach = {
       .has_access = -1,
-      .is_fullscreen = -1
+      .is_fullscreen = -1,
+      .window_id = (uint64_t)(uintptr_t)hwnd
     }
   };
   e.data.attach.has_access = has_uipi_access(target_info->hwnd);
   if (get_content_bounds(target_info->hwnd, &e.data.attach.bounds)) {
     // emit OW_ATTACH
-    ow_emit_event(&e);
+    emit_event(&e);
 
     target_info->is_focused = true;
     e.type = OW_FOCUS;
-    ow_emit_event(&e);
+    emit_event(&e);
   }
   else {
     // something went wrong, did the target window die right after becoming active?
@@ -252,6 +297,8 @@ static VOID CALLBACK hook_proc(
     : "(unknown)";
   printf("[%d] %s hwnd=%p idObject=%d idChild=%d\n", dwmsEventTime, e_str, hwnd, idObject, idChild); */
 
+  receive_event(dwmsEventTime);
+
   if (event == EVENT_OBJECT_DESTROY) {
     if (hwnd == target_info.hwnd && idObject == OBJID_WINDOW && idChild == CHILDID_SELF) {
       target_info.is_destroyed = true;
@@ -297,6 +344,7 @@ static VOID CALLBACK hook_proc(
 
 static VOID CALLBACK foreground_timer_proc(HWND _hwnd, UINT msg, UINT_PTR timerId, DWORD dwmsEventTime)
 {
+  receive_event(dwmsEventTime);
   HWND system_foreground = GetForegroundWindow();
 
   if (
@@ -309,15 +357,21 @@ static VOID CALLBACK foreground_timer_proc(HWND _hwnd, UINT msg, UINT_PTR timerI
 }
 
 static void hook_thread(void* _arg) {
-  SetWinEventHook(
+  MSG message;
+  // creates the message queue, so `ow_stop_hook` can post WM_QUIT to it
+  PeekMessageW(&message, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+  process_hook.thread_id = GetCurrentThreadId();
+  uv_sem_post(&process_hook.thread_ready);
+
+  HWINEVENTHOOK foreground_hook = SetWinEventHook(
     EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND,
     NULL, hook_proc, 0, 0, WINEVENT_OUTOFCONTEXT);
-  SetWinEventHook(
+  HWINEVENTHOOK minimize_hook = SetWinEventHook(
     EVENT_SYSTEM_MINIMIZEEND, EVENT_SYSTEM_MINIMIZEEND,
     NULL, hook_proc, 0, 0, WINEVENT_OUTOFCONTEXT);
   // FIXES: ForegroundLockTimeout (even when = 0); Also edge cases when apps stealing FG window.
   // NOTE:  Using timer because WH_SHELL & WH_CBT hooks require dll injection
-  SetTimer(NULL, 0, OW_FOREGROUND_TIMER_MS, foreground_timer_proc);
+  UINT_PTR foreground_timer = SetTimer(NULL, 0, OW_FOREGROUND_TIMER_MS, foreground_timer_proc);
 
   foreground_window = GetForegroundWindow();
   if (foreground_window != NULL) {
@@ -328,49 +382,115 @@ static void hook_thread(void* _arg) {
     check_and_handle_window(foreground_window, &target_info);
   }
 
-  MSG message;
   while (GetMessageW(&message, (HWND)NULL, 0, 0) != FALSE) {
     TranslateMessage(&message);
     DispatchMessageW(&message);
   }
+
+  KillTimer(NULL, foreground_timer);
+  UnhookWinEvent(foreground_hook);
+  UnhookWinEvent(minimize_hook);
+  if (fg_window_namechange_hook != NULL) {
+    UnhookWinEvent(fg_window_namechange_hook);
+    fg_window_namechange_hook = NULL;
+  }
+  if (target_info.location_hook != NULL) {
+    UnhookWinEvent(target_info.location_hook);
+    UnhookWinEvent(target_info.destroy_hook);
+  }
+}
+
+static void init_hook() {
+  uv_mutex_init(&process_hook.lock);
+  uv_sem_init(&process_hook.thread_ready, 0);
 }
 
-void ow_start_hook(char* target_window_title, void* overlay_window_id) {
-  target_info.title = target_window_title;
+struct ow_hook* ow_start_hook(struct ow_matcher* matcher, void* overlay_window_id, struct ow_hook_options* options, void* context) {
+  uv_once(&hook_init_once, init_hook);
+  uv_mutex_lock(&process_hook.lock);
+  bool is_started = process_hook.is_started;
+  if (!is_started) {
+    process_hook.is_started = true;
+    process_hook.context = context;
+    process_hook.metrics = options->metrics;
+  }
+  uv_mutex_unlock(&process_hook.lock);
+  if (is_started) {
+    return NULL;
+  }
+
+  target_info.matcher = matcher;
   if (overlay_window_id != NULL) {
     overlay_info.hwnd = *((HWND*)overlay_window_id);
   }
   WM_OVERLAY_UIPI_TEST = RegisterWindowMessage("ELECTRON_OVERLAY_UIPI_TEST");
-  uv_thread_create(&hook_tid, hook_thread, NULL);
+  process_hook.has_thread = uv_thread_create(&hook_tid, hook_thread, NULL) == 0;
+  if (process_hook.has_thread) {
+    uv_sem_wait(&process_hook.thread_ready);
+  }
+  return &process_hook;
 }
 
-void ow_activate_overlay() {
+// Ends the hook thread and resets the target, so another hook can be started.
+void ow_stop_hook(struct ow_hook* hook) {
+  if (hook->has_thread) {
+    PostThreadMessageW(hook->thread_id, WM_QUIT, 0, 0);
+    uv_thread_join(&hook_tid);
+    hook->has_thread = false;
+  }
+
+  ow_matcher_free(target_info.matcher);
+  free(target_info.matcher);
+  target_info.matcher = NULL;
+  target_info.hwnd = NULL;
+  target_info.location_hook = NULL;
+  target_info.destroy_hook = NULL;
+  target_info.is_focused = false;
+  target_info.is_destroyed = false;
+  overlay_info.hwnd = NULL;
+  foreground_window = NULL;
+  event_receive_ns = 0;
+  event_tick_time = 0;
+
+  uv_mutex_lock(&hook->lock);
+  hook->context = NULL;
+  hook->metrics = NULL;
+  hook->is_started = false;
+  uv_mutex_unlock(&hook->lock);
+}
+
+void ow_activate_overlay(struct ow_hook* hook) {
   SetForegroundWindow(overlay_info.hwnd);
 }
 
-void ow_focus_target() {
+void ow_focus_target(struct ow_hook* hook) {
   SetForegroundWindow(target_info.hwnd);
 }
 
-void ow_screenshot(uint8_t* out, uint32_t width, uint32_t height) {
+void ow_screenshot(struct ow_hook* hook, uint8_t* out, uint32_t width, uint32_t height) {
+  struct ow_window_bounds area = { 0, 0, width, height };
+  ow_screenshot_area(hook, out, width, height, &area);
+}
+
+void ow_screenshot_area(struct ow_hook* hook, uint8_t* out, uint32_t width, uint32_t height, const struct ow_window_bounds* area) {
   POINT screenPos = {0, 0};
   ClientToScreen(target_info.hwnd, &screenPos);
 
   BITMAPINFOHEADER bi;
   bi.biSize = sizeof(BITMAPINFOHEADER);
-  bi.biWidth = width;
-  bi.biHeight = -((int32_t)height); // top-down DIB
+  bi.biWidth = area->width;
+  bi.biHeight = -((int32_t)area->height); // top-down DIB
   bi.biPlanes = 1;
   bi.biBitCount = 32;
   bi.biCompression = BI_RGB;
-  bi.biSizeImage = (width * height * 4);
+  bi.biSizeImage = (area->width * area->height * 4);
 
   HDC dcSrc = GetDC(GetDesktopWindow());
   HDC dcDest = CreateCompatibleDC(dcSrc);
   uint8_t* bmpData;
   HBITMAP bmp = CreateDIBSection(dcSrc, (BITMAPINFO*)&bi, DIB_RGB_COLORS, &bmpData, NULL, 0);
   SelectObject(dcDest, bmp);
-  BitBlt(dcDest, 0, 0, width, height, dcSrc, screenPos.x, screenPos.y, SRCCOPY);
+  BitBlt(dcDest, 0, 0, area->width, area->height, dcSrc, screenPos.x + area->x, screenPos.y + area->y, SRCCOPY);
 
   memcpy(out, bmpData, bi.biSizeImage);
 
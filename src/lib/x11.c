@@ -2,83 +2,408 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include <xcb/xcb.h>
+#include <xcb/xcbext.h>
 #include "overlay_window.h"
+#include "matcher.h"
+#include "metrics.h"
+#include "x11/capture.h"
+#include "x11/client_list.h"
+#include "x11/damage_stream.h"
+#include "x11/refresh_rate.h"
+#include "x11/trace.h"
+#include "x11/window_cache.h"
 
-static xcb_connection_t* x_conn;
-static xcb_window_t root;
-static xcb_atom_t ATOM_NET_ACTIVE_WINDOW;
-static xcb_atom_t ATOM_NET_WM_NAME;
-static xcb_atom_t ATOM_UTF8_STRING;
-static xcb_atom_t ATOM_NET_WM_STATE;
-static xcb_atom_t ATOM_NET_WM_STATE_FULLSCREEN;
+// "instance\0class\0"
+#define WM_CLASS_FETCH_LENGTH 256
 
 struct ow_target_window
 {
-  char* title;
+  // index in `targets`, emitted as `target_id`
+  uint32_t id;
+  struct ow_matcher* matcher;
+  xcb_window_t overlay_id;
   xcb_window_t window_id;
   bool is_focused;
   bool is_destroyed;
   bool is_fullscreen;
+  // last bounds emitted with OW_ATTACH or OW_MOVERESIZE
+  struct ow_window_bounds bounds;
+  // received ConfigureNotify that is not handled yet
+  bool moveresize_pending;
+  // bounds computed from ConfigureNotify payload
+  struct ow_window_bounds pending_bounds;
+  // `pending_bounds` were fetched from the X server for the pending move/resize
+  bool is_pending_bounds_fetched;
+  // when the latest ConfigureNotify of the pending move/resize was received
+  uint64_t pending_receive_ns;
+  struct ow_frame_offset frame;
+  // when OW_MOVERESIZE was last emitted
+  uint64_t moveresize_emitted_ns;
+  // pending move/resize was held back by pacing until this time, 0 if none
+  uint64_t moveresize_deadline_ns;
+  // Set with `follow_target`: top-level ancestor of the target (its WM frame
+  // or the target itself) and its sibling below, from its last ConfigureNotify
+  xcb_window_t target_frame;
+  xcb_window_t frame_above_sibling;
+  // bounds the overlay was last moved to
+  struct ow_window_bounds followed_bounds;
 };
 
-struct ow_overlay_window
+struct ow_atoms
 {
-  xcb_window_t window_id;
+  xcb_atom_t net_active_window;
+  xcb_atom_t net_wm_name;
+  xcb_atom_t utf8_string;
+  xcb_atom_t net_wm_state;
+  xcb_atom_t net_wm_state_fullscreen;
+  xcb_atom_t net_wm_pid;
+  xcb_atom_t net_client_list;
 };
 
-static xcb_window_t active_window = XCB_WINDOW_NONE;
+// State of one hook, owned by its thread or loop. Every environment
+// that starts a hook gets its own connection and state.
+struct ow_hook
+{
+  // passed to `ow_emit_*`
+  void* context;
+  xcb_connection_t* x_conn;
+  xcb_window_t root;
+  struct ow_atoms atoms;
+  struct ow_hook_options options;
 
-static struct ow_target_window target_info = {
-  .title = NULL,
-  .window_id = XCB_WINDOW_NONE,
-  .is_focused = false,
-  .is_destroyed = false,
-  .is_fullscreen = false // initial state of *overlay* window
-};
+  xcb_window_t active_window;
+  // First one is passed to `ow_start_hook`, the rest are `extra_targets`.
+  // There are few of them, so they are looked up by window ID linearly.
+  struct ow_target_window targets[OW_MAX_TARGETS];
+  uint32_t target_count;
+
+  struct ow_window_cache window_cache;
+  struct ow_capture capture;
+  struct ow_damage_stream damage_stream;
+  struct ow_refresh_rates refresh_rates;
+  struct ow_client_list client_list;
+  // `_NET_CLIENT_LIST` changed, refreshed once per burst of events
+  bool client_list_stale;
+
+  // when the current burst of X events was read, 0 during startup
+  uint64_t burst_receive_ns;
+  // time used for pacing, same as `burst_receive_ns` unless replaying
+  // where it's the recorded time, so the same move/resize are held back
+  uint64_t time_ns;
+  // server time of the X event being handled, 0 if it has none
+  xcb_timestamp_t event_server_time;
+
+  struct ow_trace trace;
+  bool is_recording;
+  bool is_replaying;
+  // replay needed a record that is not next in the trace,
+  // state machine or its options differ from the recording
+  bool is_trace_diverged;
 
-static struct ow_overlay_window overlay_info = {
-  .window_id = XCB_WINDOW_NONE
+  // Without the `loop` option
+  uv_thread_t thread;
+  bool has_thread;
+  // Set with the `loop` option, used instead of `thread`
+  uv_poll_t x_poll;
+  uv_timer_t timer;
+  // signalled by other threads that used `x_conn`, see `ow_damage_stream`
+  uv_async_t wakeup;
+  bool is_on_loop;
+  // handles not closed yet by `ow_stop_hook`, freed with the last one
+  int open_handles;
 };
 
-static xcb_window_t get_active_window() {
-  xcb_get_property_reply_t* prop_reply = xcb_get_property_reply(x_conn, xcb_get_property(x_conn, 0, root, ATOM_NET_ACTIVE_WINDOW, XCB_ATOM_WINDOW, 0, 1), NULL);
+// Returns NULL if the window is not a target.
+static struct ow_target_window* find_target(struct ow_hook* hook, xcb_window_t wid) {
+  if (wid == XCB_WINDOW_NONE) {
+    return NULL;
+  }
+  for (uint32_t i = 0; i < hook->target_count; ++i) {
+    if (hook->targets[i].window_id == wid) {
+      return &hook->targets[i];
+    }
+  }
+  return NULL;
+}
+
+// nesting of WM frames is never that deep
+#define MAX_FRAME_DEPTH 8
+
+// used when the refresh rate of the target's monitor is unknown
+#define FALLBACK_REFRESH_HZ 60
+
+// X server time is in ms of CLOCK_MONOTONIC on Linux, same as `uv_hrtime()`.
+// Larger differences mean the clocks are not comparable (e.g. remote display).
+#define MAX_SOURCE_LATENCY_MS 60000
+
+static void follow_event(struct ow_hook* hook, struct ow_target_window* target, const struct ow_event* e);
+static void flush_moveresize(struct ow_hook* hook, struct ow_target_window* target_info, bool is_forced);
+
+// Stamps events with the target and the X event that caused them.
+static void emit_event(struct ow_hook* hook, struct ow_target_window* target, struct ow_event* e) {
+  if (e->type != OW_MOVERESIZE) {
+    // keep order of events emitted to JS, move/resize held back by pacing goes first
+    flush_moveresize(hook, target, true);
+  }
+  e->target_id = target->id;
+  follow_event(hook, target, e);
+  if (e->receive_ns == 0) {
+    e->receive_ns = hook->burst_receive_ns;
+  }
+  e->source_time_ms = hook->event_server_time;
+  if (hook->event_server_time != 0 && hook->burst_receive_ns != 0 && !hook->is_replaying) {
+    uint32_t latency_ms = (uint32_t)(hook->burst_receive_ns / 1000000) - hook->event_server_time;
+    if (latency_ms < MAX_SOURCE_LATENCY_MS) {
+      ow_metrics_record_latency(hook->options.metrics, OW_LATENCY_SOURCE, e->type, (uint64_t)latency_ms * 1000000);
+    }
+  }
+  ow_emit_event(hook->context, e);
+}
+
+// Returns the next reply from the trace, NULL if it's not there.
+static void* replay_reply(struct ow_hook* hook) {
+  struct ow_trace_record record;
+  if (hook->is_trace_diverged || !ow_trace_peek(&hook->trace, &record) || record.type != OW_TRACE_REPLY) {
+    hook->is_trace_diverged = true;
+    return NULL;
+  }
+  ow_trace_skip(&hook->trace);
+  if (record.length == 0) {
+    return NULL;
+  }
+  const xcb_generic_reply_t* header = (const xcb_generic_reply_t*)record.data;
+  if (record.length < sizeof(xcb_generic_reply_t) || record.length != 32 + (uint64_t)header->length * 4) {
+    hook->is_trace_diverged = true;
+    return NULL;
+  }
+  void* reply = malloc(record.length);
+  memcpy(reply, record.data, record.length);
+  return reply;
+}
+
+// Same as typed `xcb_*_reply` functions. All replies read by
+// the state machine go through here, so they can be traced.
+static void* wait_for_reply(struct ow_hook* hook, unsigned int sequence) {
+  if (hook->is_replaying) {
+    return replay_reply(hook);
+  }
+  xcb_generic_reply_t* reply = xcb_wait_for_reply(hook->x_conn, sequence, NULL);
+  if (hook->is_recording) {
+    ow_trace_write(&hook->trace, OW_TRACE_REPLY, reply, (reply != NULL) ? 32 + reply->length * 4 : 0);
+  }
+  return reply;
+}
+
+static xcb_window_t get_active_window(struct ow_hook* hook) {
+  xcb_get_property_reply_t* prop_reply = wait_for_reply(hook, xcb_get_property(hook->x_conn, 0, hook->root, hook->atoms.net_active_window, XCB_ATOM_WINDOW, 0, 1).sequence);
   if (prop_reply == NULL) {
     return XCB_WINDOW_NONE;
   }
-  xcb_window_t active_window = *((xcb_window_t*)xcb_get_property_value(prop_reply));
+  xcb_window_t wid = *((xcb_window_t*)xcb_get_property_value(prop_reply));
   free(prop_reply);
-  return active_window;
+  return wid;
 }
 
-static bool get_title(xcb_window_t wid, char** title) {
-  if (wid == XCB_WINDOW_NONE) {
-    *title = NULL;
-    return true;
+struct match_cookie {
+  bool has_pid;
+  bool has_wm_class;
+  bool has_title;
+  xcb_get_property_cookie_t pid;
+  xcb_get_property_cookie_t wm_class;
+  xcb_get_property_cookie_t title;
+};
+
+enum match_result {
+  MATCH_ERROR = -1,
+  MATCH_FALSE = 0,
+  MATCH_TRUE = 1
+};
+
+// Fetches only as many bytes as needed to compare, see `ow_matcher_title_fetch_length`.
+static xcb_get_property_cookie_t request_title_match(struct ow_hook* hook, xcb_window_t wid, uint32_t title_length) {
+  uint32_t long_length = (title_length == OW_MATCHER_FETCH_ALL) ? 100000 : (title_length + 3) / 4;
+  return xcb_get_property(hook->x_conn, 0, wid, hook->atoms.net_wm_name, hook->atoms.utf8_string, 0, long_length);
+}
+
+static struct match_cookie request_match(struct ow_hook* hook, struct ow_matcher* matcher, xcb_window_t wid) {
+  struct match_cookie cookie = {
+    .has_pid = (matcher->pid != 0 || matcher->exe_name != NULL),
+    .has_wm_class = (matcher->wm_class != NULL),
+    .has_title = (matcher->title_mode != OW_TITLE_ANY)
+  };
+  if (cookie.has_pid) {
+    cookie.pid = xcb_get_property(hook->x_conn, 0, wid, hook->atoms.net_wm_pid, XCB_ATOM_CARDINAL, 0, 1);
   }
-  xcb_get_property_reply_t* prop_reply = xcb_get_property_reply(x_conn, xcb_get_property(x_conn, 0, wid, ATOM_NET_WM_NAME, ATOM_UTF8_STRING, 0, 100000), NULL);
-  if (prop_reply == NULL) {
+  if (cookie.has_wm_class) {
+    cookie.wm_class = xcb_get_property(hook->x_conn, 0, wid, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 0, WM_CLASS_FETCH_LENGTH / 4);
+  }
+  if (cookie.has_title) {
+    cookie.title = request_title_match(hook, wid, ow_matcher_title_fetch_length(matcher));
+  }
+  return cookie;
+}
+
+static bool is_process_exe_name(uint32_t pid, const char* exe_name) {
+  char path[64];
+  char buf[4096];
+
+  snprintf(path, sizeof(path), "/proc/%u/exe", pid);
+  ssize_t length = readlink(path, buf, sizeof(buf) - 1);
+  if (length > 0) {
+    buf[length] = '\0';
+    const char* basename = strrchr(buf, '/');
+    return strcmp(basename ? basename + 1 : buf, exe_name) == 0;
+  }
+
+  // not owned by us, `comm` is truncated to 15 bytes
+  snprintf(path, sizeof(path), "/proc/%u/comm", pid);
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
     return false;
   }
-  int buffLenUtf8 = xcb_get_property_value_length(prop_reply);
-  if (buffLenUtf8 == 0) {
-    *title = NULL;
-    free(prop_reply);
-    return true;
+  bool is_equal = false;
+  if (fgets(buf, sizeof(buf), file) != NULL) {
+    buf[strcspn(buf, "\n")] = '\0';
+    is_equal = (strncmp(buf, exe_name, 15) == 0);
   }
-  *title = malloc(buffLenUtf8 + 1);
-  memcpy(*title, xcb_get_property_value(prop_reply), buffLenUtf8);
-  (*title)[buffLenUtf8] = '\0';
-  free(prop_reply);
-  return true;
+  fclose(file);
+  return is_equal;
+}
+
+// `/proc` is read outside of the X connection, so only the result is traced.
+static bool is_exe_name(struct ow_hook* hook, uint32_t pid, const char* exe_name) {
+  if (hook->is_replaying) {
+    struct ow_trace_record record;
+    if (hook->is_trace_diverged || !ow_trace_peek(&hook->trace, &record) || record.type != OW_TRACE_EXE_MATCH || record.length != 1) {
+      hook->is_trace_diverged = true;
+      return false;
+    }
+    ow_trace_skip(&hook->trace);
+    return record.data[0] != 0;
+  }
+  uint8_t is_equal = is_process_exe_name(pid, exe_name);
+  if (hook->is_recording) {
+    ow_trace_write(&hook->trace, OW_TRACE_EXE_MATCH, &is_equal, 1);
+  }
+  return is_equal;
+}
+
+static bool is_wm_class(xcb_get_property_reply_t* reply, const char* wm_class) {
+  const char* value = (const char*)xcb_get_property_value(reply);
+  const char* end = value + xcb_get_property_value_length(reply);
+  size_t wm_class_length = strlen(wm_class);
+  while (value < end) {
+    const char* part_end = memchr(value, '\0', end - value);
+    size_t part_length = (part_end ? part_end : end) - value;
+    if (part_length == wm_class_length && memcmp(value, wm_class, part_length) == 0) {
+      return true;
+    }
+    value += part_length + 1;
+  }
+  return false;
+}
+
+static bool is_pid_match(struct ow_hook* hook, struct ow_matcher* matcher, xcb_get_property_reply_t* reply) {
+  if (xcb_get_property_value_length(reply) != sizeof(uint32_t)) {
+    return false;
+  }
+  uint32_t pid = *((uint32_t*)xcb_get_property_value(reply));
+  return (
+    (matcher->pid == 0 || pid == matcher->pid) &&
+    (matcher->exe_name == NULL || is_exe_name(hook, pid, matcher->exe_name))
+  );
+}
+
+static bool is_title_match(struct ow_matcher* matcher, xcb_get_property_reply_t* reply) {
+  int length = xcb_get_property_value_length(reply);
+  return ow_matcher_match_title(
+    matcher,
+    length ? (const char*)xcb_get_property_value(reply) : NULL,
+    length,
+    reply->bytes_after > 0
+  );
+}
+
+// Checks cheap criteria first, replies for the rest are discarded on mismatch.
+static enum match_result match_reply(struct ow_hook* hook, struct ow_matcher* matcher, struct match_cookie cookie) {
+  enum match_result result = MATCH_TRUE;
+
+  if (cookie.has_pid) {
+    xcb_get_property_reply_t* reply = wait_for_reply(hook, cookie.pid.sequence);
+    if (reply == NULL) {
+      result = MATCH_ERROR;
+    } else {
+      if (!is_pid_match(hook, matcher, reply)) {
+        result = MATCH_FALSE;
+      }
+      free(reply);
+    }
+  }
+
+  if (cookie.has_wm_class) {
+    if (result != MATCH_TRUE) {
+      xcb_discard_reply(hook->x_conn, cookie.wm_class.sequence);
+    } else {
+      xcb_get_property_reply_t* reply = wait_for_reply(hook, cookie.wm_class.sequence);
+      if (reply == NULL) {
+        result = MATCH_ERROR;
+      } else {
+        if (!is_wm_class(reply, matcher->wm_class)) {
+          result = MATCH_FALSE;
+        }
+        free(reply);
+      }
+    }
+  }
+
+  if (cookie.has_title) {
+    if (result != MATCH_TRUE) {
+      xcb_discard_reply(hook->x_conn, cookie.title.sequence);
+    } else {
+      xcb_get_property_reply_t* reply = wait_for_reply(hook, cookie.title.sequence);
+      if (reply == NULL) {
+        result = MATCH_ERROR;
+      } else {
+        if (!is_title_match(matcher, reply)) {
+          result = MATCH_FALSE;
+        }
+        free(reply);
+      }
+    }
+  }
+
+  return result;
+}
+
+struct content_bounds_cookie {
+  xcb_get_geometry_cookie_t geometry;
+  xcb_translate_coordinates_cookie_t translate;
+};
+
+static struct content_bounds_cookie request_content_bounds(struct ow_hook* hook, xcb_window_t wid) {
+  struct content_bounds_cookie cookie = {
+    .geometry = xcb_get_geometry(hook->x_conn, wid),
+    .translate = xcb_translate_coordinates(hook->x_conn, wid, hook->root, 0, 0)
+  };
+  return cookie;
+}
+
+static void discard_content_bounds(struct ow_hook* hook, struct content_bounds_cookie cookie) {
+  xcb_discard_reply(hook->x_conn, cookie.geometry.sequence);
+  xcb_discard_reply(hook->x_conn, cookie.translate.sequence);
 }
 
-static bool get_content_bounds(xcb_window_t wid, struct ow_window_bounds* bounds) {
-  xcb_get_geometry_reply_t* geometry = xcb_get_geometry_reply(x_conn, xcb_get_geometry(x_conn, wid), NULL);
+static bool get_content_bounds_reply(struct ow_hook* hook, struct content_bounds_cookie cookie, struct ow_window_bounds* bounds, struct ow_frame_offset* frame) {
+  xcb_get_geometry_reply_t* geometry = wait_for_reply(hook, cookie.geometry.sequence);
   if (geometry == NULL) {
+    xcb_discard_reply(hook->x_conn, cookie.translate.sequence);
     return false;
   }
-  xcb_translate_coordinates_reply_t* translated = xcb_translate_coordinates_reply(x_conn, xcb_translate_coordinates(x_conn, wid, root, 0, 0), NULL);
+  xcb_translate_coordinates_reply_t* translated = wait_for_reply(hook, cookie.translate.sequence);
   if (translated == NULL) {
     free(geometry);
     return false;
@@ -88,20 +413,34 @@ static bool get_content_bounds(xcb_window_t wid, struct ow_window_bounds* bounds
   bounds->y = translated->dst_y;
   bounds->width = geometry->width;
   bounds->height = geometry->height;
+  if (frame != NULL) {
+    frame->rel_x = geometry->x + geometry->border_width;
+    frame->rel_y = geometry->y + geometry->border_width;
+    frame->parent_x = bounds->x - frame->rel_x;
+    frame->parent_y = bounds->y - frame->rel_y;
+  }
   free(translated);
   free(geometry);
   return true;
 }
 
-static bool is_fullscreen_window(xcb_window_t wid, bool* is_fullscreen) {
-  xcb_get_property_reply_t* prop_reply = xcb_get_property_reply(x_conn, xcb_get_property(x_conn, 0, wid, ATOM_NET_WM_STATE, XCB_ATOM_ATOM, 0, 100000), NULL);
+static bool get_content_bounds(struct ow_hook* hook, xcb_window_t wid, struct ow_window_bounds* bounds, struct ow_frame_offset* frame) {
+  return get_content_bounds_reply(hook, request_content_bounds(hook, wid), bounds, frame);
+}
+
+static xcb_get_property_cookie_t request_wm_state(struct ow_hook* hook, xcb_window_t wid) {
+  return xcb_get_property(hook->x_conn, 0, wid, hook->atoms.net_wm_state, XCB_ATOM_ATOM, 0, 100000);
+}
+
+static bool is_fullscreen_reply(struct ow_hook* hook, xcb_get_property_cookie_t cookie, bool* is_fullscreen) {
+  xcb_get_property_reply_t* prop_reply = wait_for_reply(hook, cookie.sequence);
   if (prop_reply == NULL) {
     return false;
   }
   *is_fullscreen = false;
   xcb_atom_t* wm_state = (xcb_atom_t*)xcb_get_property_value(prop_reply);
   for (unsigned i = 0; i < prop_reply->value_len; ++i) {
-    if (wm_state[i] == ATOM_NET_WM_STATE_FULLSCREEN) {
+    if (wm_state[i] == hook->atoms.net_wm_state_fullscreen) {
       *is_fullscreen = true;
     }
   }
@@ -109,22 +448,220 @@ static bool is_fullscreen_window(xcb_window_t wid, bool* is_fullscreen) {
   return true;
 }
 
-static void handle_moveresize_xevent(struct ow_target_window* target_info) {
-  struct ow_window_bounds bounds;
-  if (get_content_bounds(target_info->window_id, &bounds)) {
-    struct ow_event e = {
-      .type = OW_MOVERESIZE,
-      .data.moveresize = {
-        .bounds = bounds
-      }
-    };
-    ow_emit_event(&e);
+static bool is_fullscreen_window(struct ow_hook* hook, xcb_window_t wid, bool* is_fullscreen) {
+  return is_fullscreen_reply(hook, request_wm_state(hook, wid), is_fullscreen);
+}
+
+static bool bounds_equal(struct ow_window_bounds* a, struct ow_window_bounds* b) {
+  return a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height;
+}
+
+static void handle_moveresize_xevent(struct ow_hook* hook, struct ow_target_window* target_info, xcb_configure_notify_event_t* event) {
+  if (hook->options.track_configure_notify) {
+    struct ow_window_bounds* bounds = &target_info->pending_bounds;
+    struct ow_frame_offset* frame = &target_info->frame;
+    if (event->response_type & 0x80) {
+      // synthetic event sent by WM, position is in root coordinates (ICCCM 4.1.5)
+      bounds->x = event->x + event->border_width;
+      bounds->y = event->y + event->border_width;
+      frame->parent_x = bounds->x - frame->rel_x;
+      frame->parent_y = bounds->y - frame->rel_y;
+    } else {
+      // real event, position is relative to parent
+      frame->rel_x = event->x + event->border_width;
+      frame->rel_y = event->y + event->border_width;
+      bounds->x = frame->parent_x + frame->rel_x;
+      bounds->y = frame->parent_y + frame->rel_y;
+    }
+    bounds->width = event->width;
+    bounds->height = event->height;
   }
+  target_info->moveresize_pending = true;
+  target_info->is_pending_bounds_fetched = false;
+  target_info->pending_receive_ns = hook->burst_receive_ns;
+}
+
+static bool is_following(struct ow_hook* hook, struct ow_target_window* target) {
+  return hook->options.follow_target && target->overlay_id != XCB_WINDOW_NONE;
+}
+
+static void raise_overlay(struct ow_hook* hook, struct ow_target_window* target) {
+  uint32_t values[] = { XCB_STACK_MODE_ABOVE };
+  xcb_configure_window(hook->x_conn, target->overlay_id, XCB_CONFIG_WINDOW_STACK_MODE, values);
 }
 
-static void handle_fullscreen_xevent(struct ow_target_window* target_info) {
+static void move_overlay(struct ow_hook* hook, struct ow_target_window* target, struct ow_window_bounds* bounds) {
+  if (bounds->width == 0 || bounds->height == 0 || bounds_equal(bounds, &target->followed_bounds)) {
+    return;
+  }
+  target->followed_bounds = *bounds;
+  // overlay is override-redirect, so its position is in root coordinates
+  uint32_t values[] = { (uint32_t)bounds->x, (uint32_t)bounds->y, bounds->width, bounds->height };
+  xcb_configure_window(hook->x_conn, target->overlay_id,
+    XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
+}
+
+// Walks up from the window to the child of root, one round trip per level.
+static xcb_window_t find_frame(struct ow_hook* hook, xcb_window_t wid) {
+  for (int depth = 0; depth < MAX_FRAME_DEPTH; ++depth) {
+    xcb_query_tree_reply_t* reply = wait_for_reply(hook, xcb_query_tree(hook->x_conn, wid).sequence);
+    if (reply == NULL) {
+      return XCB_WINDOW_NONE;
+    }
+    xcb_window_t parent = reply->parent;
+    free(reply);
+    if (parent == hook->root || parent == XCB_WINDOW_NONE) {
+      return wid;
+    }
+    wid = parent;
+  }
+  return XCB_WINDOW_NONE;
+}
+
+// Returns NULL if the window is not a frame of a followed target.
+static struct ow_target_window* find_target_by_frame(struct ow_hook* hook, xcb_window_t frame) {
+  for (uint32_t i = 0; i < hook->target_count; ++i) {
+    if (hook->targets[i].target_frame == frame) {
+      return &hook->targets[i];
+    }
+  }
+  return NULL;
+}
+
+// Listens for restacking of the frame of `wid`, so the overlay
+// can be raised above it again. XCB_WINDOW_NONE stops listening.
+static void watch_frame(struct ow_hook* hook, struct ow_target_window* target, xcb_window_t wid) {
+  xcb_window_t frame = (wid != XCB_WINDOW_NONE) ? find_frame(hook, wid) : XCB_WINDOW_NONE;
+  xcb_window_t prev_frame = target->target_frame;
+  if (frame == prev_frame) {
+    return;
+  }
+  target->target_frame = frame;
+  target->frame_above_sibling = XCB_WINDOW_NONE;
+  // cached windows keep their own event mask
+  if (
+    prev_frame != XCB_WINDOW_NONE &&
+    ow_window_cache_peek(&hook->window_cache, prev_frame) == NULL &&
+    find_target_by_frame(hook, prev_frame) == NULL
+  ) {
+    uint32_t mask[] = { XCB_EVENT_MASK_NO_EVENT };
+    xcb_change_window_attributes(hook->x_conn, prev_frame, XCB_CW_EVENT_MASK, mask);
+  }
+  if (frame != XCB_WINDOW_NONE && ow_window_cache_peek(&hook->window_cache, frame) == NULL) {
+    uint32_t mask[] = { XCB_EVENT_MASK_STRUCTURE_NOTIFY };
+    xcb_change_window_attributes(hook->x_conn, frame, XCB_CW_EVENT_MASK, mask);
+  }
+}
+
+// Moves and raises the overlay along with the events, before JS receives them.
+static void follow_event(struct ow_hook* hook, struct ow_target_window* target, const struct ow_event* e) {
+  if (!is_following(hook, target)) {
+    return;
+  }
+  if (e->type == OW_ATTACH) {
+    struct ow_window_bounds bounds = e->data.attach.bounds;
+    move_overlay(hook, target, &bounds);
+    watch_frame(hook, target, e->data.attach.window_id);
+  } else if (e->type == OW_MOVERESIZE) {
+    struct ow_window_bounds bounds = e->data.moveresize.bounds;
+    move_overlay(hook, target, &bounds);
+  } else if (e->type == OW_FOCUS) {
+    raise_overlay(hook, target);
+  } else if (e->type == OW_DETACH) {
+    watch_frame(hook, target, XCB_WINDOW_NONE);
+  }
+}
+
+// Called on ConfigureNotify of `target_frame`. The WM raised the frame
+// over the overlay when it's right above it or its sibling changed.
+static void handle_restack_xevent(struct ow_hook* hook, struct ow_target_window* target_info, xcb_configure_notify_event_t* event) {
+  if (event->above_sibling == target_info->frame_above_sibling && event->above_sibling != target_info->overlay_id) {
+    return;
+  }
+  target_info->frame_above_sibling = event->above_sibling;
+  if (target_info->is_focused) {
+    raise_overlay(hook, target_info);
+  }
+}
+
+static void handle_reparent_xevent(struct ow_hook* hook, struct ow_target_window* target_info) {
+  // new frame, cached offset is no longer valid
+  if (get_content_bounds(hook, target_info->window_id, &target_info->pending_bounds, &target_info->frame)) {
+    target_info->moveresize_pending = true;
+    target_info->is_pending_bounds_fetched = true;
+    target_info->pending_receive_ns = hook->burst_receive_ns;
+  }
+  if (is_following(hook, target_info)) {
+    watch_frame(hook, target_info, target_info->window_id);
+  }
+}
+
+// Fetches bounds for the pending move/resize unless they are computed
+// from ConfigureNotify payloads or were already fetched.
+static bool resolve_pending_bounds(struct ow_hook* hook, struct ow_target_window* target_info) {
+  if (hook->options.track_configure_notify || target_info->is_pending_bounds_fetched) {
+    return true;
+  }
+  if (!get_content_bounds(hook, target_info->window_id, &target_info->pending_bounds, NULL)) {
+    return false;
+  }
+  target_info->is_pending_bounds_fetched = true;
+  return true;
+}
+
+static uint64_t moveresize_interval(struct ow_hook* hook, struct ow_target_window* target_info) {
+  if (hook->options.moveresize_pacing == OW_PACING_VSYNC) {
+    uint64_t interval_ns = ow_refresh_rates_interval(&hook->refresh_rates, &target_info->bounds);
+    return interval_ns ? interval_ns : 1000000000 / FALLBACK_REFRESH_HZ;
+  }
+  if (hook->options.moveresize_pacing == OW_PACING_FIXED && hook->options.moveresize_fps != 0) {
+    return 1000000000 / hook->options.moveresize_fps;
+  }
+  return 0;
+}
+
+// Emits OW_MOVERESIZE once for all ConfigureNotify received since last call.
+// Unless `is_forced`, it's held back until the pacing interval passes.
+static void flush_moveresize(struct ow_hook* hook, struct ow_target_window* target_info, bool is_forced) {
+  if (!target_info->moveresize_pending) {
+    return;
+  }
+  if (!is_forced) {
+    uint64_t interval_ns = moveresize_interval(hook, target_info);
+    if (interval_ns != 0 && hook->time_ns - target_info->moveresize_emitted_ns < interval_ns) {
+      target_info->moveresize_deadline_ns = target_info->moveresize_emitted_ns + interval_ns;
+      return;
+    }
+  }
+  target_info->moveresize_pending = false;
+  target_info->moveresize_deadline_ns = 0;
+
+  if (!resolve_pending_bounds(hook, target_info)) {
+    return;
+  }
+  if (bounds_equal(&target_info->pending_bounds, &target_info->bounds)) {
+    return;
+  }
+  target_info->bounds = target_info->pending_bounds;
+  if (target_info->id == 0) {
+    ow_damage_stream_set_target(&hook->damage_stream, target_info->window_id, target_info->bounds.width, target_info->bounds.height);
+  }
+
+  struct ow_event e = {
+    .type = OW_MOVERESIZE,
+    // held back by pacing, but observed when the ConfigureNotify was received
+    .receive_ns = target_info->pending_receive_ns,
+    .data.moveresize = {
+      .bounds = target_info->bounds
+    }
+  };
+  emit_event(hook, target_info, &e);
+  target_info->moveresize_emitted_ns = hook->time_ns;
+}
+
+static void handle_fullscreen_xevent(struct ow_hook* hook, struct ow_target_window* target_info) {
   bool is_fullscreen;
-  if (is_fullscreen_window(target_info->window_id, &is_fullscreen)) {
+  if (is_fullscreen_window(hook, target_info->window_id, &is_fullscreen)) {
     if (is_fullscreen != target_info->is_fullscreen) {
       target_info->is_fullscreen = is_fullscreen;
       struct ow_event e = {
@@ -133,193 +670,908 @@ static void handle_fullscreen_xevent(struct ow_target_window* target_info) {
           .is_fullscreen = target_info->is_fullscreen
         }
       };
-      ow_emit_event(&e);
+      emit_event(hook, target_info, &e);
     }
   }
 }
 
-static void check_and_handle_window(xcb_window_t wid, struct ow_target_window* target_info) {
-  if (target_info->window_id != XCB_WINDOW_NONE) {
-    if (target_info->window_id != wid) {
-      if (target_info->is_focused) {
-        target_info->is_focused = false;
-        struct ow_event e = { .type = OW_BLUR };
-        ow_emit_event(&e);
-      }
+static struct ow_window_cache_entry* cache_window(struct ow_hook* hook, xcb_window_t wid) {
+  // cached data is kept valid by listening for
+  // `_NET_WM_NAME`, `_NET_WM_STATE` and move/resize/reparent/destroy
+  uint32_t mask[] = { XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_STRUCTURE_NOTIFY };
+  xcb_change_window_attributes(hook->x_conn, wid, XCB_CW_EVENT_MASK, mask);
 
-      if (target_info->is_destroyed) {
-        target_info->window_id = XCB_WINDOW_NONE;
+  xcb_window_t evicted;
+  struct ow_window_cache_entry* entry = ow_window_cache_insert(&hook->window_cache, wid, &evicted);
+  if (evicted != XCB_WINDOW_NONE && find_target(hook, evicted) == NULL && evicted != hook->active_window) {
+    uint32_t mask[] = { XCB_EVENT_MASK_NO_EVENT };
+    xcb_change_window_attributes(hook->x_conn, evicted, XCB_CW_EVENT_MASK, mask);
+  }
+  return entry;
+}
 
-        target_info->is_destroyed = false;
-        struct ow_event e = { .type = OW_DETACH };
-        ow_emit_event(&e);
-      }
+// Returns the class part of `WM_CLASS`, NULL if not set.
+static char* get_wm_class_name(xcb_get_property_reply_t* reply) {
+  const char* value = (const char*)xcb_get_property_value(reply);
+  int length = xcb_get_property_value_length(reply);
+  const char* instance_end = memchr(value, '\0', length);
+  if (instance_end == NULL || instance_end + 1 >= value + length) {
+    return NULL;
+  }
+  const char* class_name = instance_end + 1;
+  return strndup(class_name, (value + length) - class_name);
+}
+
+// Syncs `client_list` with `_NET_CLIENT_LIST`. Properties of all new windows
+// are requested at once, so this costs two round trips no matter how many
+// windows appeared. New windows are also checked against matchers of targets
+// in `discover_mask` (bit per target), the first window matching each one is
+// stored into `found` and not considered for the others.
+static void update_client_list(struct ow_hook* hook, uint32_t discover_mask, xcb_window_t found[OW_MAX_TARGETS]) {
+  hook->client_list_stale = false;
+
+  xcb_get_property_reply_t* list_reply = wait_for_reply(hook,
+    xcb_get_property(hook->x_conn, 0, hook->root, hook->atoms.net_client_list, XCB_ATOM_WINDOW, 0, 100000).sequence);
+  if (list_reply == NULL) {
+    return;
+  }
+  ow_client_list_update(
+    &hook->client_list,
+    (xcb_window_t*)xcb_get_property_value(list_reply),
+    xcb_get_property_value_length(list_reply) / sizeof(xcb_window_t));
+  free(list_reply);
+
+  // hook thread is the only writer, can read without lock
+  struct ow_client_info* clients = hook->client_list.clients;
+  uint32_t count = hook->client_list.count;
+
+  // one title request must be enough for all matchers
+  uint32_t title_length = 0;
+  bool has_title = false;
+  for (uint32_t t = 0; t < hook->target_count; ++t) {
+    struct ow_matcher* matcher = hook->targets[t].matcher;
+    if ((discover_mask & (1u << t)) && matcher->title_mode != OW_TITLE_ANY) {
+      uint32_t length = ow_matcher_title_fetch_length(matcher);
+      has_title = true;
+      title_length = (length > title_length) ? length : title_length;
     }
-    else if (target_info->window_id == wid) {
-      if (!target_info->is_focused) {
-        target_info->is_focused = true;
-        struct ow_event e = { .type = OW_FOCUS };
-        ow_emit_event(&e);
+  }
+  struct {
+    xcb_get_property_cookie_t pid;
+    xcb_get_property_cookie_t wm_class;
+    xcb_get_property_cookie_t title;
+  }* cookies = malloc((count ? count : 1) * sizeof(*cookies));
+  for (uint32_t i = 0; i < count; ++i) {
+    if (clients[i].has_info) continue;
+    xcb_window_t wid = clients[i].window_id;
+    cookies[i].pid = xcb_get_property(hook->x_conn, 0, wid, hook->atoms.net_wm_pid, XCB_ATOM_CARDINAL, 0, 1);
+    cookies[i].wm_class = xcb_get_property(hook->x_conn, 0, wid, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 0, WM_CLASS_FETCH_LENGTH / 4);
+    if (has_title) {
+      cookies[i].title = request_title_match(hook, wid, title_length);
+    }
+  }
+
+  for (uint32_t i = 0; i < count; ++i) {
+    if (clients[i].has_info) continue;
+    xcb_get_property_reply_t* pid = wait_for_reply(hook, cookies[i].pid.sequence);
+    xcb_get_property_reply_t* wm_class = wait_for_reply(hook, cookies[i].wm_class.sequence);
+    xcb_get_property_reply_t* title = has_title ? wait_for_reply(hook, cookies[i].title.sequence) : NULL;
+
+    ow_client_list_set_info(
+      &hook->client_list,
+      i,
+      (pid != NULL && xcb_get_property_value_length(pid) == sizeof(uint32_t)) ? *((uint32_t*)xcb_get_property_value(pid)) : 0,
+      (wm_class != NULL) ? get_wm_class_name(wm_class) : NULL);
+
+    for (uint32_t t = 0; t < hook->target_count && pid != NULL && wm_class != NULL; ++t) {
+      struct ow_matcher* matcher = hook->targets[t].matcher;
+      bool has_target_title = matcher->title_mode != OW_TITLE_ANY;
+      if (
+        (discover_mask & (1u << t)) && found[t] == XCB_WINDOW_NONE &&
+        (!has_target_title || title != NULL) &&
+        ((matcher->pid == 0 && matcher->exe_name == NULL) || is_pid_match(hook, matcher, pid)) &&
+        (matcher->wm_class == NULL || is_wm_class(wm_class, matcher->wm_class)) &&
+        (!has_target_title || is_title_match(matcher, title))
+      ) {
+        found[t] = clients[i].window_id;
+        break;
       }
-      return;
     }
+    free(pid);
+    free(wm_class);
+    free(title);
   }
+  free(cookies);
+}
+
+// Attaches to the window if it's the target and no other target is attached
+// to it. `is_focused` is false if the window was found without becoming active.
+static void try_attach(struct ow_hook* hook, xcb_window_t wid, struct ow_target_window* target_info, bool is_focused) {
+  uint64_t check_start = uv_hrtime();
 
-  char* title = NULL;
-  if (!get_title(wid, &title) || title == NULL) {
+  struct ow_target_window* attached = find_target(hook, wid);
+  if (attached != NULL && attached != target_info) {
     return;
   }
-  bool is_equal = (strcmp(title, target_info->title) == 0);
-  free(title);
-  if (!is_equal) {
+  // Cached windows are already subscribed to property and structure changes,
+  // others must be subscribed before geometry and `_NET_WM_STATE` are requested
+  // so changes made between the replies and the subscription aren't missed.
+  struct ow_window_cache_entry* entry = ow_window_cache_get(&hook->window_cache, wid);
+  if (entry == NULL) {
+    entry = cache_window(hook, wid);
+  }
+  uint32_t target_bit = 1u << target_info->id;
+  if ((entry->match_known & target_bit) && !(entry->match_mask & target_bit)) {
     return;
   }
 
-  if (target_info->window_id != XCB_WINDOW_NONE) {
+  // Send all requests needed to attach that can't be answered from cache
+  // at once and collect replies afterwards, so attaching costs a single round trip.
+  bool need_match = !(entry->match_known & target_bit);
+  bool need_wm_state = !entry->has_wm_state;
+  bool need_geometry = !entry->has_geometry;
+  struct match_cookie match_cookie = { 0 };
+  xcb_get_property_cookie_t wm_state_cookie = { 0 };
+  struct content_bounds_cookie bounds_cookie = { { 0 }, { 0 } };
+  if (need_match) match_cookie = request_match(hook, target_info->matcher, wid);
+  if (need_wm_state) wm_state_cookie = request_wm_state(hook, wid);
+  if (need_geometry) bounds_cookie = request_content_bounds(hook, wid);
+
+  if (need_match) {
+    enum match_result result = match_reply(hook, target_info->matcher, match_cookie);
+    if (result != MATCH_ERROR) {
+      entry->match_known |= target_bit;
+      if (result == MATCH_TRUE) {
+        entry->match_mask |= target_bit;
+      } else {
+        entry->match_mask &= ~target_bit;
+      }
+    }
+  }
+  if (!(entry->match_known & entry->match_mask & target_bit)) {
+    if (need_wm_state) xcb_discard_reply(hook->x_conn, wm_state_cookie.sequence);
+    if (need_geometry) discard_content_bounds(hook, bounds_cookie);
+    return;
+  }
+  if (need_wm_state) {
+    entry->has_wm_state = is_fullscreen_reply(hook, wm_state_cookie, &entry->is_fullscreen);
+  }
+  if (need_geometry) {
+    entry->has_geometry = get_content_bounds_reply(hook, bounds_cookie, &entry->bounds, &entry->frame);
+  }
+
+  if (
+    target_info->window_id != XCB_WINDOW_NONE &&
+    ow_window_cache_peek(&hook->window_cache, target_info->window_id) == NULL
+  ) {
     uint32_t mask[] = { XCB_EVENT_MASK_NO_EVENT };
-    xcb_change_window_attributes(x_conn, target_info->window_id, XCB_CW_EVENT_MASK, mask);
+    xcb_change_window_attributes(hook->x_conn, target_info->window_id, XCB_CW_EVENT_MASK, mask);
   }
 
   target_info->window_id = wid;
 
-  // listen for `_NET_WM_STATE` fullscreen and window move/resize/destroy
-  uint32_t mask[] = { XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_STRUCTURE_NOTIFY };
-  xcb_change_window_attributes(x_conn, target_info->window_id, XCB_CW_EVENT_MASK, mask);
-
   struct ow_event e = {
     .type = OW_ATTACH,
     .data.attach = {
       .has_access = -1,
-      .is_fullscreen = -1
+      .is_fullscreen = -1,
+      .window_id = wid
     }
   };
-  bool is_fullscreen;
-  if (
-    is_fullscreen_window(target_info->window_id, &is_fullscreen) &&
-    get_content_bounds(target_info->window_id, &e.data.attach.bounds)
-  ) {
-    if (is_fullscreen != target_info->is_fullscreen) {
-      target_info->is_fullscreen = is_fullscreen;
-      e.data.attach.is_fullscreen = is_fullscreen;
+  if (entry->has_wm_state && entry->has_geometry) {
+    e.data.attach.bounds = entry->bounds;
+    target_info->bounds = entry->bounds;
+    target_info->frame = entry->frame;
+    target_info->moveresize_pending = false;
+    if (entry->is_fullscreen != target_info->is_fullscreen) {
+      target_info->is_fullscreen = entry->is_fullscreen;
+      e.data.attach.is_fullscreen = entry->is_fullscreen;
+    }
+    if (target_info->id == 0) {
+      ow_damage_stream_set_target(&hook->damage_stream, wid, entry->bounds.width, entry->bounds.height);
     }
     // emit OW_ATTACH
-    ow_emit_event(&e);
+    emit_event(hook, target_info, &e);
+    ow_metrics_record_timing(hook->options.metrics, OW_TIMING_ATTACH, uv_hrtime() - check_start);
 
-    target_info->is_focused = true;
-    e.type = OW_FOCUS;
-    ow_emit_event(&e);
+    if (is_focused) {
+      target_info->is_focused = true;
+      e.type = OW_FOCUS;
+    } else {
+      // found in background, overlay stays hidden until the target is activated
+      e.type = OW_BLUR;
+    }
+    emit_event(hook, target_info, &e);
   } else {
     // something went wrong, did the target window die right after becoming active?
     target_info->window_id = XCB_WINDOW_NONE;
   }
 }
 
-static void hook_proc(xcb_generic_event_t* generic_event) {
-  if (generic_event->response_type == XCB_DESTROY_NOTIFY) {
-    xcb_destroy_notify_event_t* event = (xcb_destroy_notify_event_t*)generic_event;
-    if (event->window == target_info.window_id) {
-      target_info.is_destroyed = true;
-      check_and_handle_window(XCB_WINDOW_NONE, &target_info);
+static void check_and_handle_window(struct ow_hook* hook, xcb_window_t wid, struct ow_target_window* target_info) {
+  if (target_info->window_id != XCB_WINDOW_NONE) {
+    if (target_info->window_id != wid) {
+      if (target_info->is_focused) {
+        target_info->is_focused = false;
+        struct ow_event e = { .type = OW_BLUR };
+        emit_event(hook, target_info, &e);
+      }
+
+      if (target_info->is_destroyed) {
+        target_info->window_id = XCB_WINDOW_NONE;
+
+        target_info->is_destroyed = false;
+        if (target_info->id == 0) {
+          ow_damage_stream_set_target(&hook->damage_stream, XCB_WINDOW_NONE, 0, 0);
+          ow_capture_release_window(&hook->capture);
+        }
+        struct ow_event e = { .type = OW_DETACH };
+        emit_event(hook, target_info, &e);
+      }
+    }
+    else if (target_info->window_id == wid) {
+      if (!target_info->is_focused) {
+        target_info->is_focused = true;
+        struct ow_event e = { .type = OW_FOCUS };
+        emit_event(hook, target_info, &e);
+      }
+      return;
     }
+  }
+
+  if (wid == XCB_WINDOW_NONE) {
     return;
   }
-  if (generic_event->response_type == XCB_CONFIGURE_NOTIFY) {
+
+  try_attach(hook, wid, target_info, true);
+}
+
+static void check_active_window(struct ow_hook* hook) {
+  for (uint32_t i = 0; i < hook->target_count; ++i) {
+    check_and_handle_window(hook, hook->active_window, &hook->targets[i]);
+  }
+}
+
+static void hook_proc(struct ow_hook* hook, xcb_generic_event_t* generic_event) {
+  if (ow_damage_stream_handle_event(&hook->damage_stream, generic_event)) {
+    return;
+  }
+  if (ow_refresh_rates_handle_event(&hook->refresh_rates, generic_event)) {
+    return;
+  }
+
+  uint8_t response_type = generic_event->response_type & ~0x80;
+
+  if (response_type == XCB_CONFIGURE_NOTIFY) {
     xcb_configure_notify_event_t* event = (xcb_configure_notify_event_t*)generic_event;
-    if (event->window == target_info.window_id) {
-      handle_moveresize_xevent(&target_info);
+    struct ow_window_cache_entry* entry = ow_window_cache_peek(&hook->window_cache, event->window);
+    if (entry != NULL) {
+      entry->has_geometry = false;
+    }
+    struct ow_target_window* framed = find_target_by_frame(hook, event->window);
+    if (framed != NULL && !(event->response_type & 0x80)) {
+      handle_restack_xevent(hook, framed, event);
+    }
+    struct ow_target_window* target = find_target(hook, event->window);
+    if (target != NULL) {
+      handle_moveresize_xevent(hook, target, event);
+      if (hook->options.capture_composite && target->id == 0) {
+        ow_capture_window_configured(&hook->capture, event->window, event->width, event->height);
+      }
+    }
+    return;
+  }
+  if (response_type == 0) {
+    xcb_generic_error_t* error = (xcb_generic_error_t*)generic_event;
+    if (error->error_code == XCB_WINDOW) {
+      // window was destroyed before we started listening for DestroyNotify
+      ow_window_cache_remove(&hook->window_cache, error->resource_id);
+    }
+    return;
+  }
+  if (response_type == XCB_REPARENT_NOTIFY) {
+    xcb_reparent_notify_event_t* event = (xcb_reparent_notify_event_t*)generic_event;
+    struct ow_window_cache_entry* entry = ow_window_cache_peek(&hook->window_cache, event->window);
+    if (entry != NULL) {
+      entry->has_geometry = false;
+    }
+    struct ow_target_window* target = find_target(hook, event->window);
+    if (target != NULL) {
+      handle_reparent_xevent(hook, target);
+    }
+    return;
+  }
+  if (response_type == XCB_MAP_NOTIFY) {
+    xcb_map_notify_event_t* event = (xcb_map_notify_event_t*)generic_event;
+    if (hook->options.capture_composite) {
+      ow_capture_window_mapped(&hook->capture, event->window);
     }
     return;
   }
-  if (generic_event->response_type == XCB_PROPERTY_NOTIFY) {
+  if (response_type == XCB_DESTROY_NOTIFY) {
+    xcb_destroy_notify_event_t* event = (xcb_destroy_notify_event_t*)generic_event;
+    ow_window_cache_remove(&hook->window_cache, event->window);
+    struct ow_target_window* target = find_target(hook, event->window);
+    if (target != NULL) {
+      target->is_destroyed = true;
+      check_and_handle_window(hook, XCB_WINDOW_NONE, target);
+    }
+    return;
+  }
+  if (response_type == XCB_PROPERTY_NOTIFY) {
     xcb_property_notify_event_t* event = (xcb_property_notify_event_t*)generic_event;
-    if (event->window == root && event->atom == ATOM_NET_ACTIVE_WINDOW) {
-      xcb_window_t old_active = active_window;
-      active_window = get_active_window();
-
-      if (old_active != target_info.window_id) {
-        uint32_t mask[] = { XCB_EVENT_MASK_NO_EVENT };
-        xcb_change_window_attributes(x_conn, old_active, XCB_CW_EVENT_MASK, mask);
+    hook->event_server_time = event->time;
+    struct ow_window_cache_entry* entry = ow_window_cache_peek(&hook->window_cache, event->window);
+    if (entry != NULL) {
+      if (
+        event->atom == hook->atoms.net_wm_name ||
+        event->atom == XCB_ATOM_WM_CLASS ||
+        event->atom == hook->atoms.net_wm_pid
+      ) {
+        entry->match_known = 0;
+      } else if (event->atom == hook->atoms.net_wm_state) {
+        entry->has_wm_state = false;
       }
-      if (active_window != XCB_WINDOW_NONE && active_window != target_info.window_id) {
-        // listen for `_NET_WM_NAME`
-        uint32_t mask[] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
-        xcb_change_window_attributes(x_conn, active_window, XCB_CW_EVENT_MASK, mask);
-      }
-      check_and_handle_window(active_window, &target_info);
-    } else if (event->window == target_info.window_id && event->atom == ATOM_NET_WM_STATE) {
-      handle_fullscreen_xevent(&target_info);
-    } else if (event->window == active_window && event->atom == ATOM_NET_WM_NAME) {
-      check_and_handle_window(active_window, &target_info);
+    }
+
+    struct ow_target_window* target = find_target(hook, event->window);
+    if (event->window == hook->root && event->atom == hook->atoms.net_client_list) {
+      hook->client_list_stale = true;
+    } else if (event->window == hook->root && event->atom == hook->atoms.net_active_window) {
+      // previously active window stays in cache and keeps its event mask
+      hook->active_window = get_active_window(hook);
+      check_active_window(hook);
+    } else if (target != NULL && event->atom == hook->atoms.net_wm_state) {
+      handle_fullscreen_xevent(hook, target);
+    } else if (event->window == hook->active_window && entry != NULL && entry->match_known == 0) {
+      check_active_window(hook);
     }
     return;
   }
 }
 
-static void hook_thread(void* _arg) {
-  x_conn = xcb_connect(NULL, NULL);
-  xcb_screen_t* screen = xcb_setup_roots_iterator(xcb_get_setup(x_conn)).data;
-  root = screen->root;
-
-  xcb_intern_atom_reply_t* atom_reply;
-  atom_reply = xcb_intern_atom_reply(x_conn, xcb_intern_atom(x_conn, 0, strlen("_NET_ACTIVE_WINDOW"), "_NET_ACTIVE_WINDOW"), NULL);
-  ATOM_NET_ACTIVE_WINDOW = atom_reply->atom;
-  free(atom_reply);
-  atom_reply = xcb_intern_atom_reply(x_conn, xcb_intern_atom(x_conn, 0, strlen("_NET_WM_NAME"), "_NET_WM_NAME"), NULL);
-  ATOM_NET_WM_NAME = atom_reply->atom;
-  free(atom_reply);
-  atom_reply = xcb_intern_atom_reply(x_conn, xcb_intern_atom(x_conn, 0, strlen("UTF8_STRING"), "UTF8_STRING"), NULL);
-  ATOM_UTF8_STRING = atom_reply->atom;
-  free(atom_reply);
-  atom_reply = xcb_intern_atom_reply(x_conn, xcb_intern_atom(x_conn, 0, strlen("_NET_WM_STATE"), "_NET_WM_STATE"), NULL);
-  ATOM_NET_WM_STATE = atom_reply->atom;
-  free(atom_reply);
-  atom_reply = xcb_intern_atom_reply(x_conn, xcb_intern_atom(x_conn, 0, strlen("_NET_WM_STATE_FULLSCREEN"), "_NET_WM_STATE_FULLSCREEN"), NULL);
-  ATOM_NET_WM_STATE_FULLSCREEN = atom_reply->atom;
-  free(atom_reply);
-
-  if (overlay_info.window_id != XCB_WINDOW_NONE) {
-    // Electron window is created with `show: false`,
-    // this override-redirect is being set before window is mapped.
-    uint32_t values[] = {1};
-    xcb_change_window_attributes(x_conn, overlay_info.window_id, XCB_CW_OVERRIDE_REDIRECT, values);
-  }
-
-  // listen for `_NET_ACTIVE_WINDOW` changes
+static void intern_atoms(struct ow_hook* hook) {
+  struct {
+    const char* name;
+    xcb_atom_t* atom;
+  } atoms[] = {
+    { "_NET_ACTIVE_WINDOW", &hook->atoms.net_active_window },
+    { "_NET_WM_NAME", &hook->atoms.net_wm_name },
+    { "UTF8_STRING", &hook->atoms.utf8_string },
+    { "_NET_WM_STATE", &hook->atoms.net_wm_state },
+    { "_NET_WM_STATE_FULLSCREEN", &hook->atoms.net_wm_state_fullscreen },
+    { "_NET_WM_PID", &hook->atoms.net_wm_pid },
+    { "_NET_CLIENT_LIST", &hook->atoms.net_client_list },
+  };
+  #define ATOMS_COUNT (sizeof(atoms) / sizeof(atoms[0]))
+
+  xcb_intern_atom_cookie_t cookies[ATOMS_COUNT];
+  for (size_t i = 0; i < ATOMS_COUNT; ++i) {
+    cookies[i] = xcb_intern_atom(hook->x_conn, 0, strlen(atoms[i].name), atoms[i].name);
+  }
+  for (size_t i = 0; i < ATOMS_COUNT; ++i) {
+    xcb_intern_atom_reply_t* atom_reply = wait_for_reply(hook, cookies[i].sequence);
+    *atoms[i].atom = (atom_reply != NULL) ? atom_reply->atom : XCB_ATOM_NONE;
+    free(atom_reply);
+  }
+  #undef ATOMS_COUNT
+}
+
+// Earliest time a held back move/resize is due, 0 if there is none.
+static uint64_t moveresize_deadline(struct ow_hook* hook) {
+  uint64_t deadline_ns = 0;
+  for (uint32_t i = 0; i < hook->target_count; ++i) {
+    uint64_t target_deadline_ns = hook->targets[i].moveresize_deadline_ns;
+    if (target_deadline_ns != 0 && (deadline_ns == 0 || target_deadline_ns < deadline_ns)) {
+      deadline_ns = target_deadline_ns;
+    }
+  }
+  return deadline_ns;
+}
+
+// Same as `xcb_wait_for_event`, but returns NULL when
+// the held back move/resize is due.
+static xcb_generic_event_t* wait_for_event(struct ow_hook* hook) {
+  uint64_t moveresize_deadline_ns = moveresize_deadline(hook);
+  if (moveresize_deadline_ns == 0) {
+    return xcb_wait_for_event(hook->x_conn);
+  }
+  struct pollfd fd = { .fd = xcb_get_file_descriptor(hook->x_conn), .events = POLLIN };
+  for (;;) {
+    xcb_generic_event_t* event = xcb_poll_for_event(hook->x_conn);
+    if (event != NULL || xcb_connection_has_error(hook->x_conn)) {
+      return event;
+    }
+    uint64_t now = uv_hrtime();
+    if (now >= moveresize_deadline_ns) {
+      return NULL;
+    }
+    // round up, so it doesn't spin for the last fraction of a millisecond,
+    // events the stream thread read into the queue wait until then at most
+    int timeout_ms = (int)((moveresize_deadline_ns - now + 999999) / 1000000);
+    poll(&fd, 1, timeout_ms);
+  }
+}
+
+// Sets up everything after `x_conn` and `root` are known and
+// attaches to the target if it already exists.
+static void hook_startup(struct ow_hook* hook) {
+  ow_damage_stream_connect(&hook->damage_stream, hook->x_conn, hook->is_on_loop ? &hook->wakeup : NULL);
+  ow_refresh_rates_connect(&hook->refresh_rates, hook->x_conn, hook->root);
+  intern_atoms(hook);
+  ow_damage_stream_query_extension(&hook->damage_stream);
+  if (hook->options.moveresize_pacing == OW_PACING_VSYNC) {
+    ow_refresh_rates_query_extension(&hook->refresh_rates);
+  }
+
+  for (uint32_t i = 0; i < hook->target_count; ++i) {
+    if (hook->targets[i].overlay_id != XCB_WINDOW_NONE) {
+      // Electron window is created with `show: false`,
+      // this override-redirect is being set before window is mapped.
+      uint32_t values[] = {1};
+      xcb_change_window_attributes(hook->x_conn, hook->targets[i].overlay_id, XCB_CW_OVERRIDE_REDIRECT, values);
+    }
+  }
+
+  // listen for `_NET_ACTIVE_WINDOW` and `_NET_CLIENT_LIST` changes
   uint32_t mask[] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
-  xcb_change_window_attributes(x_conn, root, XCB_CW_EVENT_MASK, mask);
+  xcb_change_window_attributes(hook->x_conn, hook->root, XCB_CW_EVENT_MASK, mask);
 
-  active_window = get_active_window();
-  if (active_window != XCB_WINDOW_NONE) {
-    // listen for `_NET_WM_NAME`
-    uint32_t mask[] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
-    xcb_change_window_attributes(x_conn, active_window, XCB_CW_EVENT_MASK, mask);
-    check_and_handle_window(active_window, &target_info);
+  hook->active_window = get_active_window(hook);
+  if (hook->active_window != XCB_WINDOW_NONE) {
+    check_active_window(hook);
   }
-  xcb_flush(x_conn);
+  // targets may already exist in background
+  uint32_t discover_mask = 0;
+  xcb_window_t found[OW_MAX_TARGETS] = { XCB_WINDOW_NONE };
+  for (uint32_t i = 0; i < hook->target_count; ++i) {
+    if (hook->targets[i].window_id == XCB_WINDOW_NONE) {
+      discover_mask |= 1u << i;
+    }
+  }
+  update_client_list(hook, discover_mask, found);
+  for (uint32_t i = 0; i < hook->target_count; ++i) {
+    if (found[i] == XCB_WINDOW_NONE || find_target(hook, found[i]) != NULL) continue;
+    struct ow_window_cache_entry* entry = ow_window_cache_get(&hook->window_cache, found[i]);
+    if (entry == NULL) {
+      entry = cache_window(hook, found[i]);
+    }
+    entry->match_known |= 1u << i;
+    entry->match_mask |= 1u << i;
+    try_attach(hook, found[i], &hook->targets[i], false);
+  }
+  xcb_flush(hook->x_conn);
+}
 
-  xcb_generic_event_t* event;
-  while ((event = xcb_wait_for_event(x_conn))) {
-    event->response_type = event->response_type & ~0x80;
-    hook_proc(event);
-    xcb_flush(x_conn);
+static void handle_event(struct ow_hook* hook, xcb_generic_event_t* event) {
+  if (hook->is_recording) {
+    ow_trace_write(&hook->trace, OW_TRACE_EVENT, event, OW_TRACE_EVENT_LENGTH);
+  }
+  hook->event_server_time = 0;
+  hook_proc(hook, event);
+}
+
+// Called after the whole burst of already received events was handled.
+static void end_burst(struct ow_hook* hook) {
+  hook->event_server_time = 0;
+  for (uint32_t i = 0; i < hook->target_count; ++i) {
+    struct ow_target_window* target = &hook->targets[i];
+    // overlay follows every move, even those held back from JS by pacing
+    if (is_following(hook, target) && target->moveresize_pending && resolve_pending_bounds(hook, target)) {
+      move_overlay(hook, target, &target->pending_bounds);
+    }
+    flush_moveresize(hook, target, false);
+  }
+  if (hook->client_list_stale) {
+    update_client_list(hook, 0, NULL);
+  }
+  xcb_flush(hook->x_conn);
+  if (hook->is_recording) {
+    ow_trace_flush(&hook->trace);
+  }
+}
+
+static void handle_timeout(struct ow_hook* hook) {
+  if (hook->is_recording) {
+    ow_trace_write_time(&hook->trace, OW_TRACE_TIMEOUT, hook->time_ns);
+  }
+  for (uint32_t i = 0; i < hook->target_count; ++i) {
+    uint64_t deadline_ns = hook->targets[i].moveresize_deadline_ns;
+    if (deadline_ns != 0 && deadline_ns <= hook->time_ns) {
+      flush_moveresize(hook, &hook->targets[i], true);
+    }
+  }
+  xcb_flush(hook->x_conn);
+}
+
+// Connects on the thread calling `ow_start_hook`, so the hook can be
+// stopped at any time. Returns `false` if there is no X server to connect to.
+static bool connect_hook(struct ow_hook* hook) {
+  hook->time_ns = uv_hrtime();
+  hook->x_conn = xcb_connect(NULL, NULL);
+  if (xcb_connection_has_error(hook->x_conn)) {
+    return false;
+  }
+  xcb_screen_t* screen = xcb_setup_roots_iterator(xcb_get_setup(hook->x_conn)).data;
+  hook->root = screen->root;
+
+  if (hook->options.trace_path != NULL) {
+    struct ow_trace_header header = {
+      .root = hook->root,
+      .start_ns = hook->time_ns,
+      .options = hook->options,
+      .matcher_count = hook->target_count
+    };
+    for (uint32_t i = 0; i < hook->target_count; ++i) {
+      header.matchers[i] = hook->targets[i].matcher;
+    }
+    hook->is_recording = ow_trace_create(&hook->trace, hook->options.trace_path, &header);
+  }
+  // not connected when replaying, nothing can be captured
+  ow_capture_connect(&hook->capture);
+  return true;
+}
+
+// Attaches to the target if it already exists, on the hook's thread or loop.
+static void start_hook(struct ow_hook* hook) {
+  // no events were handled yet, still the time `connect_hook` started
+  uint64_t startup_start = hook->time_ns;
+  hook_startup(hook);
+  ow_metrics_record_timing(hook->options.metrics, OW_TIMING_STARTUP, uv_hrtime() - startup_start);
+}
+
+// Handles `event` and all events already queued after it.
+static void handle_burst(struct ow_hook* hook, xcb_generic_event_t* event) {
+  // all queued events were read by now, one timestamp is enough for them
+  hook->burst_receive_ns = uv_hrtime();
+  hook->time_ns = hook->burst_receive_ns;
+  if (hook->is_recording) {
+    ow_trace_write_time(&hook->trace, OW_TRACE_BURST, hook->time_ns);
+  }
+  // handle the whole burst of already received events before
+  // emitting move/resize and flushing requests
+  do {
+    handle_event(hook, event);
     free(event);
+  } while ((event = xcb_poll_for_queued_event(hook->x_conn)));
+  end_burst(hook);
+}
+
+static void hook_thread(void* arg) {
+  struct ow_hook* hook = arg;
+  start_hook(hook);
+
+  xcb_generic_event_t* event;
+  while ((event = wait_for_event(hook)) || !xcb_connection_has_error(hook->x_conn)) {
+    if (event == NULL) {
+      // pacing interval passed without new events
+      hook->time_ns = uv_hrtime();
+      handle_timeout(hook);
+      continue;
+    }
+    handle_burst(hook, event);
+  }
+}
+
+static void on_hook_timer(uv_timer_t* handle);
+
+// Handles everything that can be read without blocking. Replies read
+// while handling a burst can queue events without the fd becoming
+// readable again, so it reads until the queue is empty. Other threads
+// that may have queued events signal `wakeup`.
+static void read_events(struct ow_hook* hook) {
+  xcb_generic_event_t* event;
+  while ((event = xcb_poll_for_event(hook->x_conn))) {
+    handle_burst(hook, event);
+  }
+  uint64_t moveresize_deadline_ns = moveresize_deadline(hook);
+  if (xcb_connection_has_error(hook->x_conn)) {
+    uv_poll_stop(&hook->x_poll);
+    uv_timer_stop(&hook->timer);
+  } else if (moveresize_deadline_ns != 0) {
+    uint64_t now = uv_hrtime();
+    // round up, so it doesn't fire for the last fraction of a millisecond
+    uint64_t timeout_ms = (moveresize_deadline_ns > now) ? (moveresize_deadline_ns - now + 999999) / 1000000 : 0;
+    uv_timer_start(&hook->timer, on_hook_timer, timeout_ms, 0);
+  }
+  ow_emit_burst_end(hook->context);
+}
+
+static void on_x_readable(uv_poll_t* handle, int status, int events) {
+  read_events(handle->data);
+}
+
+// Fires when the held back move/resize is due, and once after startup
+// to deliver events emitted while attaching.
+static void on_hook_timer(uv_timer_t* handle) {
+  struct ow_hook* hook = handle->data;
+  uint64_t moveresize_deadline_ns = moveresize_deadline(hook);
+  if (moveresize_deadline_ns != 0 && uv_hrtime() >= moveresize_deadline_ns) {
+    // pacing interval passed without new events
+    hook->time_ns = uv_hrtime();
+    handle_timeout(hook);
   }
+  read_events(hook);
 }
 
-void ow_start_hook(char* target_window_title, void* overlay_window_id) {
-  target_info.title = target_window_title;
+// Runs on the calling thread, which must be the loop's thread.
+static void on_hook_wakeup(uv_async_t* handle) {
+  read_events(handle->data);
+}
+
+static void start_on_loop(struct ow_hook* hook, uv_loop_t* loop) {
+  uv_async_init(loop, &hook->wakeup, on_hook_wakeup);
+  hook->wakeup.data = hook;
+  hook->is_on_loop = true;
+  start_hook(hook);
+  uv_timer_init(loop, &hook->timer);
+  hook->timer.data = hook;
+  uv_timer_start(&hook->timer, on_hook_timer, 0, 0);
+  uv_poll_init(loop, &hook->x_poll, xcb_get_file_descriptor(hook->x_conn));
+  hook->x_poll.data = hook;
+  uv_poll_start(&hook->x_poll, UV_READABLE, on_x_readable);
+  hook->open_handles = 3;
+}
+
+static void init_target(struct ow_hook* hook, struct ow_matcher* matcher, void* overlay_window_id) {
+  struct ow_target_window* target = &hook->targets[hook->target_count];
+  target->id = hook->target_count;
+  target->matcher = matcher;
   if (overlay_window_id != NULL) {
-    overlay_info.window_id = *((xcb_window_t*)overlay_window_id);
+    target->overlay_id = *((xcb_window_t*)overlay_window_id);
   }
-  uv_thread_create(&hook_tid, hook_thread, NULL);
+  hook->target_count += 1;
 }
 
-void ow_activate_overlay() {
-  xcb_set_input_focus(x_conn, XCB_INPUT_FOCUS_PARENT, overlay_info.window_id, XCB_CURRENT_TIME);
-  xcb_flush(x_conn);
+static struct ow_hook* create_hook(struct ow_matcher* matcher, void* overlay_window_id, struct ow_hook_options* options, void* context) {
+  struct ow_hook* hook = calloc(1, sizeof(struct ow_hook));
+  hook->context = context;
+  hook->options = *options;
+  // read only here, they belong to the caller
+  hook->options.extra_targets = NULL;
+  hook->options.extra_target_count = 0;
+  init_target(hook, matcher, overlay_window_id);
+  for (uint32_t i = 0; i < options->extra_target_count && hook->target_count < OW_MAX_TARGETS; ++i) {
+    init_target(hook, options->extra_targets[i].matcher, options->extra_targets[i].overlay_window_id);
+  }
+  ow_window_cache_init(&hook->window_cache);
+  ow_client_list_init(&hook->client_list);
+  ow_capture_init(&hook->capture);
+  ow_damage_stream_init(&hook->damage_stream, &hook->capture, options->capture_composite, context);
+  ow_refresh_rates_init(&hook->refresh_rates);
+  ow_trace_init(&hook->trace);
+  return hook;
 }
 
-void ow_focus_target() {
-  xcb_set_input_focus(x_conn, XCB_INPUT_FOCUS_PARENT, target_info.window_id, XCB_CURRENT_TIME);
-  xcb_flush(x_conn);
+// Frees everything once the hook's thread or loop handles are gone.
+static void free_hook(struct ow_hook* hook) {
+  if (hook->is_recording) {
+    ow_trace_close(&hook->trace);
+  }
+  ow_damage_stream_free(&hook->damage_stream);
+  ow_capture_free(&hook->capture);
+  ow_refresh_rates_free(&hook->refresh_rates);
+  ow_client_list_free_all(&hook->client_list);
+  if (hook->x_conn != NULL) {
+    xcb_disconnect(hook->x_conn);
+  }
+  for (uint32_t i = 0; i < hook->target_count; ++i) {
+    ow_matcher_free(hook->targets[i].matcher);
+    free(hook->targets[i].matcher);
+  }
+  free(hook);
+}
+
+struct ow_hook* ow_start_hook(struct ow_matcher* matcher, void* overlay_window_id, struct ow_hook_options* options, void* context) {
+  struct ow_hook* hook = create_hook(matcher, overlay_window_id, options, context);
+  bool is_connected = connect_hook(hook);
+  // belongs to the caller, the trace is already created
+  hook->options.trace_path = NULL;
+  hook->options.loop = NULL;
+  if (!is_connected) {
+    // stays idle until stopped, as if the X server never reported anything
+    return hook;
+  }
+  if (options->loop != NULL) {
+    start_on_loop(hook, options->loop);
+    return hook;
+  }
+  hook->has_thread = uv_thread_create(&hook->thread, hook_thread, hook) == 0;
+  return hook;
+}
+
+static void on_handle_closed(uv_handle_t* handle) {
+  struct ow_hook* hook = handle->data;
+  hook->open_handles -= 1;
+  if (hook->open_handles == 0) {
+    free_hook(hook);
+  }
+}
+
+void ow_stop_hook(struct ow_hook* hook) {
+  ow_damage_stream_stop(&hook->damage_stream);
+  ow_capture_release_window(&hook->capture);
+
+  if (hook->is_on_loop) {
+    // poll handle stops watching the fd right away, the connection
+    // can be closed before the handles are
+    uv_close((uv_handle_t*)&hook->x_poll, on_handle_closed);
+    uv_close((uv_handle_t*)&hook->timer, on_handle_closed);
+    uv_close((uv_handle_t*)&hook->wakeup, on_handle_closed);
+    return;
+  }
+  if (hook->has_thread) {
+    // wakes the thread blocked on the connection, it exits on the error
+    shutdown(xcb_get_file_descriptor(hook->x_conn), SHUT_RDWR);
+    uv_thread_join(&hook->thread);
+  }
+  free_hook(hook);
+}
+
+enum ow_replay_result ow_replay_trace(const char* path, bool is_real_time, void* context) {
+  struct ow_trace trace;
+  struct ow_trace_header header;
+  ow_trace_init(&trace);
+  if (!ow_trace_open(&trace, path, &header)) {
+    return OW_REPLAY_UNREADABLE;
+  }
+  struct ow_hook_target extra_targets[OW_MAX_TARGETS - 1];
+  for (uint32_t i = 1; i < header.matcher_count; ++i) {
+    extra_targets[i - 1].matcher = header.matchers[i];
+    extra_targets[i - 1].overlay_window_id = NULL;
+  }
+  header.options.extra_targets = extra_targets;
+  header.options.extra_target_count = header.matcher_count - 1;
+  struct ow_hook* hook = create_hook(header.matchers[0], NULL, &header.options, context);
+  // there are no overlays, but `follow_target` needs them to read the same replies
+  for (uint32_t i = 0; i < hook->target_count && hook->options.follow_target; ++i) {
+    hook->targets[i].overlay_id = 1;
+  }
+  hook->trace = trace;
+  hook->root = header.root;
+  hook->time_ns = header.start_ns;
+  hook->is_replaying = true;
+  // libxcb drops requests sent over a failed connection,
+  // replies come from the trace instead
+  hook->x_conn = xcb_connect_to_fd(-1, NULL);
+
+  uint64_t trace_start_ns = hook->time_ns;
+  uint64_t replay_start_ns = uv_hrtime();
+  hook_startup(hook);
+
+  struct ow_trace_record record;
+  while (!hook->is_trace_diverged && ow_trace_peek(&hook->trace, &record)) {
+    ow_trace_skip(&hook->trace);
+    if (record.type != OW_TRACE_BURST && record.type != OW_TRACE_TIMEOUT) {
+      hook->is_trace_diverged = true;
+      break;
+    }
+    hook->time_ns = ow_trace_record_time(&record);
+    if (is_real_time) {
+      uint64_t due_ns = replay_start_ns + (hook->time_ns - trace_start_ns);
+      uint64_t now = uv_hrtime();
+      if (due_ns > now) {
+        uv_sleep((unsigned int)((due_ns - now) / 1000000));
+      }
+    }
+    if (record.type == OW_TRACE_TIMEOUT) {
+      handle_timeout(hook);
+      continue;
+    }
+    hook->burst_receive_ns = uv_hrtime();
+    while (!hook->is_trace_diverged && ow_trace_peek(&hook->trace, &record) && record.type == OW_TRACE_EVENT) {
+      if (record.length != OW_TRACE_EVENT_LENGTH) {
+        hook->is_trace_diverged = true;
+        break;
+      }
+      // record data is reused when the handler reads replies
+      xcb_generic_event_t event = { 0 };
+      memcpy(&event, record.data, OW_TRACE_EVENT_LENGTH);
+      ow_trace_skip(&hook->trace);
+      handle_event(hook, &event);
+    }
+    end_burst(hook);
+  }
+
+  enum ow_replay_result result = hook->is_trace_diverged ? OW_REPLAY_DIVERGED : OW_REPLAY_DONE;
+  ow_trace_close(&hook->trace);
+  free_hook(hook);
+  return result;
+}
+
+// Called on the JS thread, which may not run the hook.
+static void set_input_focus(struct ow_hook* hook, xcb_window_t window) {
+  xcb_connection_t* conn = ow_capture_lock_connection(&hook->capture);
+  if (conn != NULL) {
+    xcb_set_input_focus(conn, XCB_INPUT_FOCUS_PARENT, window, XCB_CURRENT_TIME);
+  }
+  ow_capture_unlock_connection(&hook->capture);
+}
+
+void ow_activate_overlay(struct ow_hook* hook) {
+  set_input_focus(hook, hook->targets[0].overlay_id);
+}
+
+void ow_focus_target(struct ow_hook* hook) {
+  set_input_focus(hook, hook->targets[0].window_id);
+}
+
+void ow_screenshot(struct ow_hook* hook, uint8_t* out, uint32_t width, uint32_t height) {
+  struct ow_window_bounds area = { 0, 0, width, height };
+  ow_screenshot_area(hook, out, width, height, &area);
+}
+
+void ow_screenshot_area(struct ow_hook* hook, uint8_t* out, uint32_t width, uint32_t height, const struct ow_window_bounds* area) {
+  if (hook == NULL) {
+    // nothing to capture before the hook is started
+    memset(out, 0, (size_t)area->width * area->height * 4);
+    return;
+  }
+  if (
+    hook->options.capture_composite &&
+    ow_capture_read_window_area(&hook->capture, hook->targets[0].window_id, width, height, area, out)
+  ) {
+    return;
+  }
+  // same area as on Windows, content of the target as seen on screen
+  if (!ow_capture_read(&hook->capture, hook->targets[0].window_id, area->x, area->y, area->width, area->height, out)) {
+    memset(out, 0, (size_t)area->width * area->height * 4);
+  }
+}
+
+bool ow_stream_start(struct ow_hook* hook, struct ow_stream_options* options) {
+  return ow_damage_stream_start(&hook->damage_stream, options);
+}
+
+void ow_stream_stop(struct ow_hook* hook) {
+  ow_damage_stream_stop(&hook->damage_stream);
+}
+
+enum ow_stream_read_result ow_stream_read(struct ow_hook* hook, uint8_t* out, size_t capacity, const struct ow_pixel_transform* transform, struct ow_frame_info* info) {
+  return ow_damage_stream_read(&hook->damage_stream, out, capacity, transform, info);
+}
+
+uint32_t ow_list_windows(struct ow_hook* hook, struct ow_window_info** windows) {
+  *windows = NULL;
+  if (hook == NULL) {
+    return 0;
+  }
+
+  struct ow_client_info* clients;
+  uint32_t count = ow_client_list_snapshot(&hook->client_list, &clients);
+
+  // titles change often and are not tracked, all are fetched in one round trip
+  xcb_connection_t* conn = ow_capture_lock_connection(&hook->capture);
+  xcb_get_property_cookie_t* cookies = malloc((count ? count : 1) * sizeof(xcb_get_property_cookie_t));
+  for (uint32_t i = 0; conn != NULL && i < count; ++i) {
+    cookies[i] = xcb_get_property(conn, 0, clients[i].window_id, hook->atoms.net_wm_name, hook->atoms.utf8_string, 0, 1024);
+  }
+
+  *windows = malloc((count ? count : 1) * sizeof(struct ow_window_info));
+  for (uint32_t i = 0; i < count; ++i) {
+    struct ow_window_info* info = &(*windows)[i];
+    info->window_id = clients[i].window_id;
+    info->pid = clients[i].pid;
+    info->wm_class = clients[i].wm_class;
+    clients[i].wm_class = NULL;
+    info->title = NULL;
+
+    xcb_get_property_reply_t* reply = (conn != NULL) ? xcb_get_property_reply(conn, cookies[i], NULL) : NULL;
+    if (reply != NULL) {
+      info->title = strndup((const char*)xcb_get_property_value(reply), xcb_get_property_value_length(reply));
+      free(reply);
+    }
+  }
+  ow_capture_unlock_connection(&hook->capture);
+  free(cookies);
+  ow_client_list_free(clients, count);
+  return count;
+}
+
+void ow_free_window_list(struct ow_window_info* windows, uint32_t count) {
+  for (uint32_t i = 0; i < count; ++i) {
+    free(windows[i].title);
+    free(windows[i].wm_class);
+  }
+  free(windows);
 }
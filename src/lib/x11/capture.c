@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef OW_HAVE_XCB_SHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+#include "capture.h"
+
+void ow_capture_init(struct ow_capture* capture) {
+  memset(capture, 0, sizeof(struct ow_capture));
+  uv_mutex_init(&capture->lock);
+}
+
+void ow_capture_connect(struct ow_capture* capture) {
+  uv_mutex_lock(&capture->lock);
+  capture->is_enabled = true;
+  uv_mutex_unlock(&capture->lock);
+}
+
+// Must be called with lock held. Returns `false` if not connected,
+// a connection that failed is not opened again.
+static bool ensure_connected(struct ow_capture* capture) {
+  if (capture->conn != NULL) {
+    return !xcb_connection_has_error(capture->conn);
+  }
+  if (!capture->is_enabled) {
+    return false;
+  }
+  xcb_connection_t* conn = xcb_connect(NULL, NULL);
+  capture->conn = conn;
+  if (xcb_connection_has_error(conn)) {
+    return false;
+  }
+
+  xcb_format_iterator_t it = xcb_setup_pixmap_formats_iterator(xcb_get_setup(conn));
+  for (; it.rem; xcb_format_next(&it)) {
+    if (it.data->depth == 24) capture->bpp_depth24 = it.data->bits_per_pixel;
+    if (it.data->depth == 32) capture->bpp_depth32 = it.data->bits_per_pixel;
+  }
+#ifdef OW_HAVE_XCB_SHM
+  xcb_prefetch_extension_data(conn, &xcb_shm_id);
+#endif
+#ifdef OW_HAVE_XCB_COMPOSITE
+  xcb_prefetch_extension_data(conn, &xcb_composite_id);
+#endif
+  return true;
+}
+
+// Must be called with lock held. Nothing selects events on this
+// connection, only errors of requests without a reply arrive.
+static void discard_events(struct ow_capture* capture) {
+  if (capture->conn == NULL) {
+    return;
+  }
+  xcb_generic_event_t* event;
+  while ((event = xcb_poll_for_event(capture->conn))) {
+    free(event);
+  }
+}
+
+xcb_connection_t* ow_capture_lock_connection(struct ow_capture* capture) {
+  uv_mutex_lock(&capture->lock);
+  return ensure_connected(capture) ? capture->conn : NULL;
+}
+
+void ow_capture_unlock_connection(struct ow_capture* capture) {
+  if (capture->conn != NULL) {
+    xcb_flush(capture->conn);
+  }
+  discard_events(capture);
+  uv_mutex_unlock(&capture->lock);
+}
+
+static bool is_supported_depth(struct ow_capture* capture, uint8_t depth) {
+  return (
+    (depth == 24 && capture->bpp_depth24 == 32) ||
+    (depth == 32 && capture->bpp_depth32 == 32)
+  );
+}
+
+static void copy_pixels(uint8_t* out, const uint8_t* in, size_t pixels, uint8_t depth) {
+  if (depth == 32) {
+    memcpy(out, in, pixels * 4);
+    return;
+  }
+  // padding byte of depth 24 is undefined
+  for (size_t i = 0; i < pixels * 4; i += 4) {
+    out[i + 0] = in[i + 0];
+    out[i + 1] = in[i + 1];
+    out[i + 2] = in[i + 2];
+    out[i + 3] = 0xFF;
+  }
+}
+
+#ifdef OW_HAVE_XCB_SHM
+static bool shm_check(struct ow_capture* capture) {
+  if (!capture->has_shm_checked) {
+    capture->has_shm_checked = true;
+    const xcb_query_extension_reply_t* ext = xcb_get_extension_data(capture->conn, &xcb_shm_id);
+    if (ext != NULL && ext->present) {
+      xcb_shm_query_version_reply_t* reply = xcb_shm_query_version_reply(capture->conn, xcb_shm_query_version(capture->conn), NULL);
+      capture->has_shm = (reply != NULL);
+      free(reply);
+    }
+  }
+  return capture->has_shm;
+}
+
+static void shm_release(struct ow_capture* capture) {
+  if (capture->shm_data == NULL) {
+    return;
+  }
+  xcb_shm_detach(capture->conn, capture->shm_seg);
+  shmdt(capture->shm_data);
+  capture->shm_data = NULL;
+  capture->shm_size = 0;
+}
+
+// Segment is reused between captures and grows when needed.
+static bool shm_reserve(struct ow_capture* capture, size_t size) {
+  if (capture->shm_size >= size) {
+    return true;
+  }
+  shm_release(capture);
+
+  int shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+  if (shmid == -1) {
+    return false;
+  }
+  void* data = shmat(shmid, NULL, 0);
+  if (data == (void*)-1) {
+    shmctl(shmid, IPC_RMID, NULL);
+    return false;
+  }
+
+  xcb_shm_seg_t seg = xcb_generate_id(capture->conn);
+  xcb_generic_error_t* error = xcb_request_check(capture->conn, xcb_shm_attach_checked(capture->conn, seg, shmid, 0));
+  // segment is destroyed once both sides detach
+  shmctl(shmid, IPC_RMID, NULL);
+  if (error != NULL) {
+    // server can't access our memory, e.g. it runs on another machine
+    free(error);
+    shmdt(data);
+    capture->has_shm = false;
+    return false;
+  }
+
+  capture->shm_seg = seg;
+  capture->shm_data = data;
+  capture->shm_size = size;
+  return true;
+}
+
+static bool shm_read(struct ow_capture* capture, xcb_drawable_t drawable, int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t* out) {
+  xcb_shm_get_image_reply_t* reply = xcb_shm_get_image_reply(
+    capture->conn,
+    xcb_shm_get_image(capture->conn, drawable, x, y, width, height, ~0, XCB_IMAGE_FORMAT_Z_PIXMAP, capture->shm_seg, 0),
+    NULL);
+  if (reply == NULL) {
+    return false;
+  }
+  bool is_supported = is_supported_depth(capture, reply->depth);
+  if (is_supported) {
+    copy_pixels(out, capture->shm_data, (size_t)width * height, reply->depth);
+  }
+  free(reply);
+  return is_supported;
+}
+#endif
+
+static bool get_image_read(struct ow_capture* capture, xcb_drawable_t drawable, int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t* out) {
+  xcb_get_image_reply_t* reply = xcb_get_image_reply(
+    capture->conn,
+    xcb_get_image(capture->conn, XCB_IMAGE_FORMAT_Z_PIXMAP, drawable, x, y, width, height, ~0),
+    NULL);
+  if (reply == NULL) {
+    return false;
+  }
+  size_t pixels = (size_t)width * height;
+  bool is_supported = (
+    is_supported_depth(capture, reply->depth) &&
+    (size_t)xcb_get_image_data_length(reply) >= pixels * 4
+  );
+  if (is_supported) {
+    copy_pixels(out, xcb_get_image_data(reply), pixels, reply->depth);
+  }
+  free(reply);
+  return is_supported;
+}
+
+static bool read_drawable(struct ow_capture* capture, xcb_drawable_t drawable, int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t* out) {
+#ifdef OW_HAVE_XCB_SHM
+  if (shm_check(capture) && shm_reserve(capture, (size_t)width * height * 4)) {
+    return shm_read(capture, drawable, x, y, width, height, out);
+  }
+#endif
+  return get_image_read(capture, drawable, x, y, width, height, out);
+}
+
+bool ow_capture_read(struct ow_capture* capture, xcb_drawable_t drawable, int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t* out) {
+  if (width == 0 || height == 0) {
+    return false;
+  }
+
+  uv_mutex_lock(&capture->lock);
+  bool is_read = false;
+  if (ensure_connected(capture)) {
+    is_read = read_drawable(capture, drawable, x, y, width, height, out);
+  }
+  discard_events(capture);
+  uv_mutex_unlock(&capture->lock);
+  return is_read;
+}
+
+#ifdef OW_HAVE_XCB_COMPOSITE
+static bool composite_check(struct ow_capture* capture) {
+  if (!capture->has_composite_checked) {
+    capture->has_composite_checked = true;
+    const xcb_query_extension_reply_t* ext = xcb_get_extension_data(capture->conn, &xcb_composite_id);
+    if (ext != NULL && ext->present) {
+      // NameWindowPixmap requires 0.2
+      xcb_composite_query_version_reply_t* reply = xcb_composite_query_version_reply(capture->conn, xcb_composite_query_version(capture->conn, 0, 4), NULL);
+      capture->has_composite = (reply != NULL && (reply->major_version > 0 || reply->minor_version >= 2));
+      free(reply);
+    }
+  }
+  return capture->has_composite;
+}
+
+static void release_window_pixmap(struct ow_capture* capture) {
+  if (capture->is_pixmap_valid) {
+    xcb_free_pixmap(capture->conn, capture->window_pixmap);
+    capture->is_pixmap_valid = false;
+  }
+}
+
+static bool renew_window_pixmap(struct ow_capture* capture, xcb_window_t window) {
+  release_window_pixmap(capture);
+  if (capture->redirected_window != window) {
+    if (capture->redirected_window != XCB_WINDOW_NONE) {
+      xcb_composite_unredirect_window(capture->conn, capture->redirected_window, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+    }
+    // no-op if a compositing manager already redirected it,
+    // otherwise the server keeps painting the window on screen itself
+    xcb_composite_redirect_window(capture->conn, window, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+    capture->redirected_window = window;
+  }
+
+  xcb_pixmap_t pixmap = xcb_generate_id(capture->conn);
+  xcb_void_cookie_t name_cookie = xcb_composite_name_window_pixmap_checked(capture->conn, window, pixmap);
+  xcb_get_geometry_cookie_t geometry_cookie = xcb_get_geometry(capture->conn, window);
+
+  xcb_generic_error_t* error = xcb_request_check(capture->conn, name_cookie);
+  xcb_get_geometry_reply_t* geometry = xcb_get_geometry_reply(capture->conn, geometry_cookie, NULL);
+  if (error != NULL || geometry == NULL) {
+    // window is not viewable
+    if (error == NULL) {
+      xcb_free_pixmap(capture->conn, pixmap);
+    }
+    free(error);
+    free(geometry);
+    return false;
+  }
+
+  capture->window_pixmap = pixmap;
+  capture->is_pixmap_valid = true;
+  capture->pixmap_width = geometry->width;
+  capture->pixmap_height = geometry->height;
+  capture->pixmap_border = geometry->border_width;
+  free(geometry);
+  return true;
+}
+#endif
+
+bool ow_capture_read_window(struct ow_capture* capture, xcb_window_t window, uint16_t width, uint16_t height, uint8_t* out) {
+  struct ow_window_bounds area = { 0, 0, width, height };
+  return ow_capture_read_window_area(capture, window, width, height, &area, out);
+}
+
+bool ow_capture_read_window_area(struct ow_capture* capture, xcb_window_t window, uint16_t width, uint16_t height, const struct ow_window_bounds* area, uint8_t* out) {
+#ifdef OW_HAVE_XCB_COMPOSITE
+  if (width == 0 || height == 0 || window == XCB_WINDOW_NONE) {
+    return false;
+  }
+  if (
+    area->x < 0 || area->y < 0 || area->width == 0 || area->height == 0 ||
+    (uint32_t)area->x + area->width > width || (uint32_t)area->y + area->height > height
+  ) {
+    return false;
+  }
+
+  uv_mutex_lock(&capture->lock);
+  bool is_read = false;
+  if (ensure_connected(capture) && composite_check(capture)) {
+    bool is_valid = (capture->is_pixmap_valid && capture->redirected_window == window);
+    if (is_valid || renew_window_pixmap(capture, window)) {
+      // pixmap includes the border
+      if (capture->pixmap_width == width && capture->pixmap_height == height) {
+        is_read = read_drawable(
+          capture, capture->window_pixmap,
+          capture->pixmap_border + area->x, capture->pixmap_border + area->y,
+          area->width, area->height, out);
+      }
+    }
+  }
+  discard_events(capture);
+  uv_mutex_unlock(&capture->lock);
+  return is_read;
+#else
+  return false;
+#endif
+}
+
+void ow_capture_window_configured(struct ow_capture* capture, xcb_window_t window, uint16_t width, uint16_t height) {
+#ifdef OW_HAVE_XCB_COMPOSITE
+  uv_mutex_lock(&capture->lock);
+  if (
+    capture->is_pixmap_valid && capture->redirected_window == window &&
+    (capture->pixmap_width != width || capture->pixmap_height != height)
+  ) {
+    release_window_pixmap(capture);
+    xcb_flush(capture->conn);
+  }
+  uv_mutex_unlock(&capture->lock);
+#endif
+}
+
+void ow_capture_window_mapped(struct ow_capture* capture, xcb_window_t window) {
+#ifdef OW_HAVE_XCB_COMPOSITE
+  uv_mutex_lock(&capture->lock);
+  if (capture->redirected_window == window) {
+    release_window_pixmap(capture);
+    xcb_flush(capture->conn);
+  }
+  uv_mutex_unlock(&capture->lock);
+#endif
+}
+
+void ow_capture_release_window(struct ow_capture* capture) {
+#ifdef OW_HAVE_XCB_COMPOSITE
+  uv_mutex_lock(&capture->lock);
+  if (capture->redirected_window != XCB_WINDOW_NONE) {
+    release_window_pixmap(capture);
+    xcb_composite_unredirect_window(capture->conn, capture->redirected_window, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+    capture->redirected_window = XCB_WINDOW_NONE;
+    xcb_flush(capture->conn);
+  }
+  uv_mutex_unlock(&capture->lock);
+#endif
+}
+
+void ow_capture_free(struct ow_capture* capture) {
+#ifdef OW_HAVE_XCB_SHM
+  shm_release(capture);
+#endif
+  if (capture->conn != NULL) {
+    xcb_disconnect(capture->conn);
+  }
+  uv_mutex_destroy(&capture->lock);
+}
@@ -0,0 +1,99 @@
+#ifndef ADDON_SRC_X11_CAPTURE_H_
+#define ADDON_SRC_X11_CAPTURE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uv.h>
+#include <xcb/xcb.h>
+#ifdef OW_HAVE_XCB_SHM
+#include <xcb/shm.h>
+#endif
+#ifdef OW_HAVE_XCB_COMPOSITE
+#include <xcb/composite.h>
+#endif
+#include "overlay_window.h"
+
+// Reads pixels of a drawable into a BGRA buffer. Uses a persistent MIT-SHM
+// segment when the server supports it, so pixels are not sent through the
+// socket, and falls back to plain GetImage (e.g. on remote displays).
+//
+// With Composite, a window can be read from its own offscreen pixmap
+// instead of the screen, so windows covering it are not captured.
+//
+// Captures are requested from threads other than the hook's, so they use
+// their own connection. Replies they wait for never read events of the
+// hook's connection into its queue, where a hook running on a loop
+// wouldn't see them until the fd becomes readable again.
+struct ow_capture
+{
+  // capture can be requested from any thread
+  uv_mutex_t lock;
+  // opened on first use once `is_enabled`
+  xcb_connection_t* conn;
+  bool is_enabled;
+  // bits per pixel of ZPixmap images for depth 24 and 32
+  uint8_t bpp_depth24;
+  uint8_t bpp_depth32;
+#ifdef OW_HAVE_XCB_SHM
+  // SHM support is checked on first capture
+  bool has_shm_checked;
+  bool has_shm;
+  xcb_shm_seg_t shm_seg;
+  uint8_t* shm_data;
+  size_t shm_size;
+#endif
+#ifdef OW_HAVE_XCB_COMPOSITE
+  bool has_composite_checked;
+  bool has_composite;
+  xcb_window_t redirected_window;
+  // contents of `redirected_window`, server allocates a new
+  // pixmap when the window is resized or mapped again
+  xcb_pixmap_t window_pixmap;
+  bool is_pixmap_valid;
+  uint16_t pixmap_width;
+  uint16_t pixmap_height;
+  uint16_t pixmap_border;
+#endif
+};
+
+void ow_capture_init(struct ow_capture* capture);
+
+// Called once the hook is connected, the connection is opened on first use.
+void ow_capture_connect(struct ow_capture* capture);
+
+// Connection for other requests made off the hook thread, NULL if it
+// can't be opened. Must be released with `ow_capture_unlock_connection`.
+xcb_connection_t* ow_capture_lock_connection(struct ow_capture* capture);
+
+// Flushes requests made with the connection.
+void ow_capture_unlock_connection(struct ow_capture* capture);
+
+// Writes `width * height * 4` bytes into `out`. Returns `false` if the area
+// can't be read (not connected, unsupported depth, outside of drawable).
+bool ow_capture_read(struct ow_capture* capture, xcb_drawable_t drawable, int16_t x, int16_t y, uint16_t width, uint16_t height, uint8_t* out);
+
+// Same as `ow_capture_read`, but reads only the window's own contents using
+// Composite. Returns `false` if Composite is unavailable or the window size
+// doesn't match yet, the caller can capture from screen instead.
+bool ow_capture_read_window(struct ow_capture* capture, xcb_window_t window, uint16_t width, uint16_t height, uint8_t* out);
+
+// Same as `ow_capture_read_window`, but reads only `area` of the window,
+// it must be inside of `width` and `height`.
+bool ow_capture_read_window_area(struct ow_capture* capture, xcb_window_t window, uint16_t width, uint16_t height, const struct ow_window_bounds* area, uint8_t* out);
+
+// Called by the hook thread on ConfigureNotify of the captured window.
+void ow_capture_window_configured(struct ow_capture* capture, xcb_window_t window, uint16_t width, uint16_t height);
+
+// Called by the hook thread on MapNotify of the captured window.
+void ow_capture_window_mapped(struct ow_capture* capture, xcb_window_t window);
+
+// Called by the hook thread when the target is detached or the hook stops.
+// Stops redirecting the captured window, so the server paints it on screen
+// directly again, and frees its pixmap.
+void ow_capture_release_window(struct ow_capture* capture);
+
+// Detaches the SHM segment and closes the connection,
+// called once no other thread can capture.
+void ow_capture_free(struct ow_capture* capture);
+
+#endif // !ADDON_SRC_X11_CAPTURE_H_
@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <string.h>
+#include "client_list.h"
+
+void ow_client_list_init(struct ow_client_list* list) {
+  uv_mutex_init(&list->lock);
+  list->clients = NULL;
+  list->count = 0;
+}
+
+static int compare_window_id(const void* a, const void* b) {
+  xcb_window_t lhs = *((const xcb_window_t*)a);
+  xcb_window_t rhs = *((const xcb_window_t*)b);
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+void ow_client_list_update(struct ow_client_list* list, xcb_window_t* ids, uint32_t count) {
+  qsort(ids, count, sizeof(xcb_window_t), compare_window_id);
+
+  struct ow_client_info* clients = calloc(count ? count : 1, sizeof(struct ow_client_info));
+  struct ow_client_info* prev = list->clients;
+  uint32_t prev_count = list->count;
+
+  // both lists are sorted, merge in a single pass
+  uint32_t j = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    while (j < prev_count && prev[j].window_id < ids[i]) {
+      free(prev[j].wm_class);
+      j += 1;
+    }
+    if (j < prev_count && prev[j].window_id == ids[i]) {
+      clients[i] = prev[j];
+      j += 1;
+    } else {
+      clients[i].window_id = ids[i];
+    }
+  }
+  for (; j < prev_count; ++j) {
+    free(prev[j].wm_class);
+  }
+
+  uv_mutex_lock(&list->lock);
+  list->clients = clients;
+  list->count = count;
+  uv_mutex_unlock(&list->lock);
+  free(prev);
+}
+
+void ow_client_list_set_info(struct ow_client_list* list, uint32_t index, uint32_t pid, char* wm_class) {
+  uv_mutex_lock(&list->lock);
+  struct ow_client_info* client = &list->clients[index];
+  client->has_info = true;
+  client->pid = pid;
+  client->wm_class = wm_class;
+  uv_mutex_unlock(&list->lock);
+}
+
+uint32_t ow_client_list_snapshot(struct ow_client_list* list, struct ow_client_info** clients) {
+  uv_mutex_lock(&list->lock);
+  uint32_t count = list->count;
+  *clients = malloc((count ? count : 1) * sizeof(struct ow_client_info));
+  for (uint32_t i = 0; i < count; ++i) {
+    (*clients)[i] = list->clients[i];
+    if (list->clients[i].wm_class != NULL) {
+      (*clients)[i].wm_class = strdup(list->clients[i].wm_class);
+    }
+  }
+  uv_mutex_unlock(&list->lock);
+  return count;
+}
+
+void ow_client_list_free(struct ow_client_info* clients, uint32_t count) {
+  for (uint32_t i = 0; i < count; ++i) {
+    free(clients[i].wm_class);
+  }
+  free(clients);
+}
+
+void ow_client_list_free_all(struct ow_client_list* list) {
+  ow_client_list_free(list->clients, list->count);
+  list->clients = NULL;
+  list->count = 0;
+  uv_mutex_destroy(&list->lock);
+}
@@ -0,0 +1,46 @@
+#ifndef ADDON_SRC_X11_CLIENT_LIST_H_
+#define ADDON_SRC_X11_CLIENT_LIST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uv.h>
+#include <xcb/xcb.h>
+
+struct ow_client_info
+{
+  xcb_window_t window_id;
+  // pid and class never change for a window, fetched once when it appears
+  bool has_info;
+  // 0 if unknown
+  uint32_t pid;
+  // class part of `WM_CLASS`, NULL if unknown
+  char* wm_class;
+};
+
+// Top-level windows from `_NET_CLIENT_LIST` sorted by window ID.
+// Written only by the hook thread, readable from any thread with a snapshot.
+struct ow_client_list
+{
+  uv_mutex_t lock;
+  struct ow_client_info* clients;
+  uint32_t count;
+};
+
+void ow_client_list_init(struct ow_client_list* list);
+
+// Replaces the set of windows, info of windows that are still
+// present is kept. `ids` are sorted in place.
+void ow_client_list_update(struct ow_client_list* list, xcb_window_t* ids, uint32_t count);
+
+// Takes ownership of `wm_class`.
+void ow_client_list_set_info(struct ow_client_list* list, uint32_t index, uint32_t pid, char* wm_class);
+
+// Copy safe to use without the lock, must be freed with `ow_client_list_free`.
+uint32_t ow_client_list_snapshot(struct ow_client_list* list, struct ow_client_info** clients);
+
+void ow_client_list_free(struct ow_client_info* clients, uint32_t count);
+
+// Frees the list itself, once the hook thread is gone.
+void ow_client_list_free_all(struct ow_client_list* list);
+
+#endif // !ADDON_SRC_X11_CLIENT_LIST_H_
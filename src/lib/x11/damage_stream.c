@@ -0,0 +1,309 @@
+#include <stdlib.h>
+#include <string.h>
+#include "frame_damage.h"
+#include "pixel_ops.h"
+#include "tile_hash.h"
+#include "damage_stream.h"
+
+#define DEFAULT_POLL_INTERVAL_MS 100
+
+void ow_damage_stream_init(struct ow_damage_stream* stream, struct ow_capture* capture, bool use_composite, void* context) {
+  memset(stream, 0, sizeof(struct ow_damage_stream));
+  uv_mutex_init(&stream->lock);
+  uv_cond_init(&stream->wakeup);
+  stream->context = context;
+  stream->capture = capture;
+  stream->use_composite = use_composite;
+  stream->target_window = XCB_WINDOW_NONE;
+  ow_triple_buffer_init(&stream->frames);
+  ow_tile_hash_init(&stream->tiles, OW_TILE_HASH_DEFAULT_SIZE);
+}
+
+void ow_damage_stream_connect(struct ow_damage_stream* stream, xcb_connection_t* conn, uv_async_t* hook_wakeup) {
+  uv_mutex_lock(&stream->lock);
+  stream->conn = conn;
+  stream->hook_wakeup = hook_wakeup;
+#ifdef OW_HAVE_XCB_DAMAGE
+  xcb_prefetch_extension_data(conn, &xcb_damage_id);
+#endif
+  uv_mutex_unlock(&stream->lock);
+}
+
+// Called after requests on the hook's connection, see `hook_wakeup`.
+static void flush_hook_conn(struct ow_damage_stream* stream, xcb_connection_t* conn) {
+  xcb_flush(conn);
+  if (stream->hook_wakeup != NULL) {
+    uv_async_send(stream->hook_wakeup);
+  }
+}
+
+// Must be called with lock held. Keeps a damage object
+// on the current target while the stream is running.
+static void update_damage(struct ow_damage_stream* stream) {
+#ifdef OW_HAVE_XCB_DAMAGE
+  bool is_needed = (
+    stream->is_active &&
+    stream->target_window != XCB_WINDOW_NONE &&
+    stream->has_damage_extension
+  );
+  if (is_needed && !stream->has_damage_checked) {
+    stream->has_damage_checked = true;
+    xcb_damage_query_version_reply_t* reply = xcb_damage_query_version_reply(stream->conn, stream->damage_version, NULL);
+    if (reply == NULL) {
+      stream->has_damage_extension = false;
+      is_needed = false;
+    }
+    free(reply);
+  }
+
+  if (stream->has_damage && (!is_needed || stream->damage_window != stream->target_window)) {
+    xcb_damage_destroy(stream->conn, stream->damage);
+    stream->has_damage = false;
+  }
+  if (is_needed && !stream->has_damage) {
+    stream->damage = xcb_generate_id(stream->conn);
+    xcb_damage_create(stream->conn, stream->damage, stream->target_window, XCB_DAMAGE_REPORT_LEVEL_DELTA_RECTANGLES);
+    stream->damage_window = stream->target_window;
+    stream->has_damage = true;
+  }
+#endif
+}
+
+void ow_damage_stream_query_extension(struct ow_damage_stream* stream) {
+#ifdef OW_HAVE_XCB_DAMAGE
+  const xcb_query_extension_reply_t* ext = xcb_get_extension_data(stream->conn, &xcb_damage_id);
+  if (ext == NULL || !ext->present) {
+    return;
+  }
+  uv_mutex_lock(&stream->lock);
+  stream->damage_event_base = ext->first_event;
+  stream->has_damage_extension = true;
+  // requests are rejected until the version is negotiated, reply is checked on first use
+  stream->damage_version = xcb_damage_query_version(stream->conn, 1, 1);
+  if (stream->is_active) {
+    update_damage(stream);
+    uv_cond_signal(&stream->wakeup);
+  }
+  uv_mutex_unlock(&stream->lock);
+#endif
+}
+
+// Must be called with lock held.
+static void mark_damaged_full(struct ow_damage_stream* stream) {
+  struct ow_window_bounds rect = { 0, 0, stream->width, stream->height };
+  stream->damage_area.count = 0;
+  ow_frame_damage_add(&stream->damage_area, &rect);
+  stream->is_damaged = true;
+}
+
+void ow_damage_stream_set_target(struct ow_damage_stream* stream, xcb_window_t window, uint32_t width, uint32_t height) {
+  uv_mutex_lock(&stream->lock);
+  if (stream->target_window != window || stream->width != width || stream->height != height) {
+    stream->target_window = window;
+    stream->width = width;
+    stream->height = height;
+    mark_damaged_full(stream);
+    update_damage(stream);
+    uv_cond_signal(&stream->wakeup);
+  }
+  uv_mutex_unlock(&stream->lock);
+}
+
+bool ow_damage_stream_handle_event(struct ow_damage_stream* stream, xcb_generic_event_t* event) {
+#ifdef OW_HAVE_XCB_DAMAGE
+  if (
+    stream->damage_event_base == 0 ||
+    (event->response_type & ~0x80) != stream->damage_event_base + XCB_DAMAGE_NOTIFY
+  ) {
+    return false;
+  }
+  xcb_damage_notify_event_t* damage_event = (xcb_damage_notify_event_t*)event;
+  uv_mutex_lock(&stream->lock);
+  if (stream->has_damage && damage_event->damage == stream->damage) {
+    struct ow_window_bounds rect = {
+      damage_event->area.x,
+      damage_event->area.y,
+      damage_event->area.width,
+      damage_event->area.height
+    };
+    ow_frame_damage_add(&stream->damage_area, &rect);
+    if (!stream->is_damaged) {
+      stream->is_damaged = true;
+      uv_cond_signal(&stream->wakeup);
+    }
+  }
+  uv_mutex_unlock(&stream->lock);
+  return true;
+#else
+  return false;
+#endif
+}
+
+static bool capture_frame(struct ow_damage_stream* stream, xcb_window_t window, uint32_t width, uint32_t height, uint8_t* out) {
+  if (stream->use_composite && ow_capture_read_window(stream->capture, window, width, height, out)) {
+    return true;
+  }
+  return ow_capture_read(stream->capture, window, 0, 0, width, height, out);
+}
+
+static void stream_thread(void* arg) {
+  struct ow_damage_stream* stream = (struct ow_damage_stream*)arg;
+  uint64_t last_capture_ns = 0;
+
+  uv_mutex_lock(&stream->lock);
+  while (stream->is_active) {
+    if (stream->target_window == XCB_WINDOW_NONE || stream->width == 0 || stream->height == 0) {
+      uv_cond_wait(&stream->wakeup, &stream->lock);
+      continue;
+    }
+    if (!stream->is_damaged) {
+      if (stream->has_damage) {
+        uv_cond_wait(&stream->wakeup, &stream->lock);
+      } else {
+        uint64_t interval_ms = stream->options.poll_interval_ms ? stream->options.poll_interval_ms : DEFAULT_POLL_INTERVAL_MS;
+        if (uv_cond_timedwait(&stream->wakeup, &stream->lock, interval_ms * 1000000) == UV_ETIMEDOUT) {
+          mark_damaged_full(stream);
+        }
+      }
+      continue;
+    }
+    if (stream->options.max_fps != 0) {
+      // damage keeps accumulating until the next frame is due
+      uint64_t min_interval_ns = 1000000000 / stream->options.max_fps;
+      uint64_t elapsed_ns = uv_hrtime() - last_capture_ns;
+      if (elapsed_ns < min_interval_ns) {
+        uv_cond_timedwait(&stream->wakeup, &stream->lock, min_interval_ns - elapsed_ns);
+        continue;
+      }
+    }
+
+    xcb_window_t window = stream->target_window;
+    uint32_t width = stream->width;
+    uint32_t height = stream->height;
+    struct ow_frame_event event = { .damage = stream->damage_area };
+    bool is_polled = !stream->has_damage;
+    stream->damage_area.count = 0;
+    stream->is_damaged = false;
+#ifdef OW_HAVE_XCB_DAMAGE
+    if (stream->has_damage) {
+      // repair before capturing, so drawing during capture is reported again
+      xcb_damage_subtract(stream->conn, stream->damage, XCB_NONE, XCB_NONE);
+      flush_hook_conn(stream, stream->conn);
+    }
+#endif
+    uv_mutex_unlock(&stream->lock);
+
+    last_capture_ns = uv_hrtime();
+    struct ow_frame* frame = ow_triple_buffer_back(&stream->frames, (size_t)width * height * 4);
+    bool is_captured = frame->data != NULL && capture_frame(stream, window, width, height, frame->data);
+    if (is_captured && is_polled) {
+      // without DAMAGE, publish only frames that changed and report changed tiles
+      is_captured = ow_tile_hash_update(&stream->tiles, frame->data, (size_t)width * 4, width, height, 4) != 0;
+      if (is_captured) {
+        struct ow_window_bounds* rects;
+        uint32_t count = ow_tile_hash_rects(&stream->tiles, &rects);
+        event.damage.count = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+          ow_frame_damage_add(&event.damage, &rects[i]);
+        }
+        free(rects);
+      }
+    } else if (!is_polled) {
+      ow_tile_hash_reset(&stream->tiles);
+    }
+    if (is_captured) {
+      stream->seq += 1;
+      frame->seq = stream->seq;
+      frame->width = width;
+      frame->height = height;
+      ow_triple_buffer_publish(&stream->frames);
+
+      event.frame.seq = frame->seq;
+      event.frame.width = width;
+      event.frame.height = height;
+      ow_emit_frame(stream->context, &event);
+    }
+
+    uv_mutex_lock(&stream->lock);
+  }
+  uv_mutex_unlock(&stream->lock);
+}
+
+bool ow_damage_stream_start(struct ow_damage_stream* stream, struct ow_stream_options* options) {
+  uv_mutex_lock(&stream->lock);
+  if (stream->is_active) {
+    uv_mutex_unlock(&stream->lock);
+    return false;
+  }
+  stream->is_active = true;
+  stream->options = *options;
+  mark_damaged_full(stream);
+  update_damage(stream);
+  uv_thread_create(&stream->thread, stream_thread, stream);
+  xcb_connection_t* conn = stream->conn;
+  uv_mutex_unlock(&stream->lock);
+
+  if (conn != NULL) {
+    flush_hook_conn(stream, conn);
+  }
+  return true;
+}
+
+void ow_damage_stream_stop(struct ow_damage_stream* stream) {
+  uv_mutex_lock(&stream->lock);
+  if (!stream->is_active) {
+    uv_mutex_unlock(&stream->lock);
+    return;
+  }
+  stream->is_active = false;
+  update_damage(stream);
+  uv_cond_signal(&stream->wakeup);
+  xcb_connection_t* conn = stream->conn;
+  uv_mutex_unlock(&stream->lock);
+
+  uv_thread_join(&stream->thread);
+  if (conn != NULL) {
+    flush_hook_conn(stream, conn);
+  }
+  ow_triple_buffer_free(&stream->frames);
+  ow_tile_hash_free(&stream->tiles);
+  stream->seq = 0;
+  stream->read_seq = 0;
+}
+
+void ow_damage_stream_free(struct ow_damage_stream* stream) {
+  ow_triple_buffer_free(&stream->frames);
+  ow_tile_hash_free(&stream->tiles);
+  uv_cond_destroy(&stream->wakeup);
+  uv_mutex_destroy(&stream->lock);
+}
+
+enum ow_stream_read_result ow_damage_stream_read(struct ow_damage_stream* stream, uint8_t* out, size_t capacity, const struct ow_pixel_transform* transform, struct ow_frame_info* info) {
+  struct ow_frame* frame = ow_triple_buffer_acquire(&stream->frames);
+  if (frame == NULL || frame->seq == stream->read_seq) {
+    return OW_STREAM_NO_FRAME;
+  }
+  info->seq = frame->seq;
+  info->width = frame->width;
+  info->height = frame->height;
+
+  struct ow_pixel_transform resolved;
+  struct ow_pixel_transform whole_frame = { .format = OW_PIXEL_BGRA };
+  if (!ow_pixel_transform_resolve(transform ? transform : &whole_frame, frame->width, frame->height, &resolved)) {
+    return OW_STREAM_OUT_OF_BOUNDS;
+  }
+  info->width = resolved.width;
+  info->height = resolved.height;
+
+  size_t size = (size_t)resolved.width * resolved.height * ow_pixel_format_size(resolved.format);
+  if (size > capacity) {
+    return OW_STREAM_TOO_SMALL;
+  }
+  if (ow_pixel_transform_is_identity(&resolved, frame->width, frame->height)) {
+    memcpy(out, frame->data, size);
+  } else {
+    ow_pixel_transform_apply(&resolved, frame->data, (size_t)frame->width * 4, out);
+  }
+  stream->read_seq = frame->seq;
+  return OW_STREAM_READ;
+}
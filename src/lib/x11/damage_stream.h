@@ -0,0 +1,92 @@
+#ifndef ADDON_SRC_X11_DAMAGE_STREAM_H_
+#define ADDON_SRC_X11_DAMAGE_STREAM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uv.h>
+#include <xcb/xcb.h>
+#ifdef OW_HAVE_XCB_DAMAGE
+#include <xcb/damage.h>
+#endif
+#include "overlay_window.h"
+#include "tile_hash.h"
+#include "triple_buffer.h"
+#include "capture.h"
+
+// Captures the target on its own thread when the DAMAGE extension reports
+// that it redrew, and publishes frames into a triple buffer. Without DAMAGE
+// the target is captured every `poll_interval_ms` and frames are published
+// only if tile hashes show a change.
+//
+// Hook thread reports target changes and damage events, JS thread starts,
+// stops and reads the stream.
+struct ow_damage_stream
+{
+  uv_mutex_t lock;
+  uv_cond_t wakeup;
+  uv_thread_t thread;
+  // passed to `ow_emit_frame`
+  void* context;
+  // connection of the hook, damage is reported to its event loop
+  xcb_connection_t* conn;
+  // Set when the hook runs on a loop. Signalled after `conn` is used on
+  // another thread, which may read events into the queue of `conn`
+  // without its fd becoming readable.
+  uv_async_t* hook_wakeup;
+  struct ow_capture* capture;
+  bool use_composite;
+#ifdef OW_HAVE_XCB_DAMAGE
+  // set by hook thread before handling events
+  uint8_t damage_event_base;
+  bool has_damage_extension;
+  bool has_damage_checked;
+  xcb_damage_query_version_cookie_t damage_version;
+  xcb_damage_damage_t damage;
+  xcb_window_t damage_window;
+#endif
+  // target is watched for damage, otherwise it's polled
+  bool has_damage;
+
+  // guarded by lock
+  bool is_active;
+  struct ow_stream_options options;
+  xcb_window_t target_window;
+  uint32_t width;
+  uint32_t height;
+  bool is_damaged;
+  struct ow_frame_damage damage_area;
+
+  // owned by stream thread
+  uint32_t seq;
+  struct ow_tile_hash tiles;
+  // owned by JS thread
+  uint32_t read_seq;
+  struct ow_triple_buffer frames;
+};
+
+void ow_damage_stream_init(struct ow_damage_stream* stream, struct ow_capture* capture, bool use_composite, void* context);
+
+// Called by the hook thread once connected, doesn't wait for replies.
+// `hook_wakeup` is NULL unless the hook runs on a loop.
+void ow_damage_stream_connect(struct ow_damage_stream* stream, xcb_connection_t* conn, uv_async_t* hook_wakeup);
+
+// Called by the hook thread after replies for `ow_damage_stream_connect` arrived.
+void ow_damage_stream_query_extension(struct ow_damage_stream* stream);
+
+// Called by the hook thread when the target or its size changes.
+// `window` is XCB_WINDOW_NONE if detached.
+void ow_damage_stream_set_target(struct ow_damage_stream* stream, xcb_window_t window, uint32_t width, uint32_t height);
+
+// Called by the hook thread for every event, returns `true` if it was DamageNotify.
+bool ow_damage_stream_handle_event(struct ow_damage_stream* stream, xcb_generic_event_t* event);
+
+bool ow_damage_stream_start(struct ow_damage_stream* stream, struct ow_stream_options* options);
+
+void ow_damage_stream_stop(struct ow_damage_stream* stream);
+
+// Called once the stream is stopped and the hook thread is gone.
+void ow_damage_stream_free(struct ow_damage_stream* stream);
+
+enum ow_stream_read_result ow_damage_stream_read(struct ow_damage_stream* stream, uint8_t* out, size_t capacity, const struct ow_pixel_transform* transform, struct ow_frame_info* info);
+
+#endif // !ADDON_SRC_X11_DAMAGE_STREAM_H_
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include "refresh_rate.h"
+
+void ow_refresh_rates_init(struct ow_refresh_rates* rates) {
+  memset(rates, 0, sizeof(struct ow_refresh_rates));
+}
+
+void ow_refresh_rates_connect(struct ow_refresh_rates* rates, xcb_connection_t* conn, xcb_window_t root) {
+  rates->conn = conn;
+  rates->root = root;
+#ifdef OW_HAVE_XCB_RANDR
+  xcb_prefetch_extension_data(conn, &xcb_randr_id);
+#endif
+}
+
+void ow_refresh_rates_query_extension(struct ow_refresh_rates* rates) {
+#ifdef OW_HAVE_XCB_RANDR
+  const xcb_query_extension_reply_t* ext = xcb_get_extension_data(rates->conn, &xcb_randr_id);
+  if (ext == NULL || !ext->present) {
+    return;
+  }
+  rates->randr_event_base = ext->first_event;
+  rates->has_randr = true;
+  rates->is_stale = true;
+  // `GetScreenResourcesCurrent` requires 1.3, reply is checked on first use
+  rates->randr_version = xcb_randr_query_version(rates->conn, 1, 3);
+  xcb_randr_select_input(rates->conn, rates->root, XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE | XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE);
+#endif
+}
+
+bool ow_refresh_rates_handle_event(struct ow_refresh_rates* rates, xcb_generic_event_t* event) {
+#ifdef OW_HAVE_XCB_RANDR
+  if (!rates->has_randr) {
+    return false;
+  }
+  uint8_t response_type = event->response_type & ~0x80;
+  if (
+    response_type != rates->randr_event_base + XCB_RANDR_SCREEN_CHANGE_NOTIFY &&
+    response_type != rates->randr_event_base + XCB_RANDR_NOTIFY
+  ) {
+    return false;
+  }
+  rates->is_stale = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef OW_HAVE_XCB_RANDR
+static uint64_t mode_interval(const xcb_randr_mode_info_t* mode) {
+  uint64_t dots = (uint64_t)mode->htotal * mode->vtotal;
+  if (mode->mode_flags & XCB_RANDR_MODE_FLAG_DOUBLE_SCAN) dots *= 2;
+  if (mode->mode_flags & XCB_RANDR_MODE_FLAG_INTERLACE) dots /= 2;
+  if (dots == 0 || mode->dot_clock == 0) return 0;
+  return dots * 1000000000 / mode->dot_clock;
+}
+
+static void fetch_rates(struct ow_refresh_rates* rates) {
+  free(rates->crtcs);
+  rates->crtcs = NULL;
+  rates->count = 0;
+
+  xcb_randr_get_screen_resources_current_reply_t* resources = xcb_randr_get_screen_resources_current_reply(
+    rates->conn, xcb_randr_get_screen_resources_current(rates->conn, rates->root), NULL);
+  if (resources == NULL) {
+    return;
+  }
+  xcb_randr_crtc_t* crtcs = xcb_randr_get_screen_resources_current_crtcs(resources);
+  int crtcs_count = xcb_randr_get_screen_resources_current_crtcs_length(resources);
+  xcb_randr_mode_info_t* modes = xcb_randr_get_screen_resources_current_modes(resources);
+  int modes_count = xcb_randr_get_screen_resources_current_modes_length(resources);
+
+  xcb_randr_get_crtc_info_cookie_t* cookies = malloc(sizeof(xcb_randr_get_crtc_info_cookie_t) * (crtcs_count ? crtcs_count : 1));
+  for (int i = 0; i < crtcs_count; ++i) {
+    cookies[i] = xcb_randr_get_crtc_info(rates->conn, crtcs[i], resources->config_timestamp);
+  }
+  rates->crtcs = calloc(crtcs_count ? crtcs_count : 1, sizeof(struct ow_crtc_rate));
+  for (int i = 0; i < crtcs_count; ++i) {
+    xcb_randr_get_crtc_info_reply_t* info = xcb_randr_get_crtc_info_reply(rates->conn, cookies[i], NULL);
+    if (info == NULL) {
+      continue;
+    }
+    if (info->mode != XCB_NONE && info->width != 0 && info->height != 0) {
+      struct ow_crtc_rate* crtc = &rates->crtcs[rates->count];
+      crtc->bounds.x = info->x;
+      crtc->bounds.y = info->y;
+      crtc->bounds.width = info->width;
+      crtc->bounds.height = info->height;
+      for (int j = 0; j < modes_count; ++j) {
+        if (modes[j].id == info->mode) {
+          crtc->interval_ns = mode_interval(&modes[j]);
+          break;
+        }
+      }
+      rates->count += 1;
+    }
+    free(info);
+  }
+  free(cookies);
+  free(resources);
+}
+#endif
+
+uint64_t ow_refresh_rates_interval(struct ow_refresh_rates* rates, const struct ow_window_bounds* bounds) {
+#ifdef OW_HAVE_XCB_RANDR
+  if (!rates->has_randr) {
+    return 0;
+  }
+  if (rates->is_stale) {
+    rates->is_stale = false;
+    if (!rates->has_randr_checked) {
+      rates->has_randr_checked = true;
+      xcb_randr_query_version_reply_t* reply = xcb_randr_query_version_reply(rates->conn, rates->randr_version, NULL);
+      if (reply == NULL || (reply->major_version == 1 && reply->minor_version < 3)) {
+        rates->has_randr = false;
+        free(reply);
+        return 0;
+      }
+      free(reply);
+    }
+    fetch_rates(rates);
+  }
+
+  int64_t center_x = (int64_t)bounds->x + bounds->width / 2;
+  int64_t center_y = (int64_t)bounds->y + bounds->height / 2;
+  for (uint32_t i = 0; i < rates->count; ++i) {
+    const struct ow_window_bounds* crtc = &rates->crtcs[i].bounds;
+    if (
+      center_x >= crtc->x && center_x < (int64_t)crtc->x + crtc->width &&
+      center_y >= crtc->y && center_y < (int64_t)crtc->y + crtc->height
+    ) {
+      return rates->crtcs[i].interval_ns;
+    }
+  }
+#endif
+  return 0;
+}
+
+void ow_refresh_rates_free(struct ow_refresh_rates* rates) {
+  free(rates->crtcs);
+  rates->crtcs = NULL;
+  rates->count = 0;
+}
@@ -0,0 +1,54 @@
+#ifndef ADDON_SRC_X11_REFRESH_RATE_H_
+#define ADDON_SRC_X11_REFRESH_RATE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <xcb/xcb.h>
+#ifdef OW_HAVE_XCB_RANDR
+#include <xcb/randr.h>
+#endif
+#include "overlay_window.h"
+
+struct ow_crtc_rate
+{
+  struct ow_window_bounds bounds;
+  // frame duration, 0 if unknown
+  uint64_t interval_ns;
+};
+
+// Refresh rates of active CRTCs from RandR, refetched after the server
+// reports a change. Used only by the hook thread.
+struct ow_refresh_rates
+{
+  xcb_connection_t* conn;
+  xcb_window_t root;
+#ifdef OW_HAVE_XCB_RANDR
+  uint8_t randr_event_base;
+  bool has_randr;
+  bool has_randr_checked;
+  xcb_randr_query_version_cookie_t randr_version;
+#endif
+  bool is_stale;
+  struct ow_crtc_rate* crtcs;
+  uint32_t count;
+};
+
+void ow_refresh_rates_init(struct ow_refresh_rates* rates);
+
+// Called by the hook thread once connected, doesn't wait for replies.
+void ow_refresh_rates_connect(struct ow_refresh_rates* rates, xcb_connection_t* conn, xcb_window_t root);
+
+// Called after `ow_refresh_rates_connect` when other
+// work was done, so the extension reply is already there.
+void ow_refresh_rates_query_extension(struct ow_refresh_rates* rates);
+
+// Returns `true` if the event was a RandR event.
+bool ow_refresh_rates_handle_event(struct ow_refresh_rates* rates, xcb_generic_event_t* event);
+
+// Frame duration of the CRTC that shows the center of `bounds`,
+// 0 if unknown (e.g. no RandR 1.3 or the window is offscreen).
+uint64_t ow_refresh_rates_interval(struct ow_refresh_rates* rates, const struct ow_window_bounds* bounds);
+
+void ow_refresh_rates_free(struct ow_refresh_rates* rates);
+
+#endif // !ADDON_SRC_X11_REFRESH_RATE_H_
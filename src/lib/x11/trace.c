@@ -0,0 +1,253 @@
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+static const char MAGIC[8] = "OWTRACE";
+
+// largest reply the hook asks for is a property of 100000 longs
+#define MAX_RECORD_LENGTH (1 << 24)
+
+struct record_header {
+  uint8_t type;
+  uint8_t reserved[3];
+  uint32_t length;
+};
+
+void ow_trace_init(struct ow_trace* trace) {
+  trace->file = NULL;
+  trace->has_next = false;
+  trace->data = NULL;
+  trace->data_capacity = 0;
+}
+
+static bool write_u32(FILE* file, uint32_t value) {
+  return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+static bool write_string(FILE* file, const char* string) {
+  if (string == NULL) {
+    return write_u32(file, UINT32_MAX);
+  }
+  uint32_t length = (uint32_t)strlen(string);
+  return write_u32(file, length) && (length == 0 || fwrite(string, length, 1, file) == 1);
+}
+
+static bool write_options(FILE* file, const struct ow_hook_options* options) {
+  uint8_t flags[4] = {
+    options->track_configure_notify,
+    options->capture_composite,
+    options->follow_target,
+    0
+  };
+  return fwrite(flags, sizeof(flags), 1, file) == 1 &&
+    write_u32(file, options->moveresize_pacing) &&
+    write_u32(file, options->moveresize_fps);
+}
+
+static bool write_matcher(FILE* file, const struct ow_matcher* matcher) {
+  return write_u32(file, matcher->title_mode) &&
+    write_u32(file, matcher->pid) &&
+    write_string(file, matcher->title) &&
+    write_string(file, matcher->wm_class) &&
+    write_string(file, matcher->exe_name);
+}
+
+bool ow_trace_create(struct ow_trace* trace, const char* path, const struct ow_trace_header* header) {
+  trace->file = fopen(path, "wb");
+  if (trace->file == NULL) {
+    return false;
+  }
+  bool is_written = fwrite(MAGIC, sizeof(MAGIC), 1, trace->file) == 1 &&
+    write_u32(trace->file, OW_TRACE_VERSION) &&
+    write_u32(trace->file, header->root) &&
+    fwrite(&header->start_ns, sizeof(header->start_ns), 1, trace->file) == 1 &&
+    write_options(trace->file, &header->options) &&
+    write_u32(trace->file, header->matcher_count);
+  for (uint32_t i = 0; is_written && i < header->matcher_count; ++i) {
+    is_written = write_matcher(trace->file, header->matchers[i]);
+  }
+  if (!is_written) {
+    ow_trace_close(trace);
+    return false;
+  }
+  return true;
+}
+
+void ow_trace_write(struct ow_trace* trace, enum ow_trace_record_type type, const void* data, uint32_t length) {
+  if (trace->file == NULL) {
+    return;
+  }
+  struct record_header header = { .type = type, .length = length };
+  if (
+    fwrite(&header, sizeof(header), 1, trace->file) != 1 ||
+    (length != 0 && fwrite(data, length, 1, trace->file) != 1)
+  ) {
+    ow_trace_close(trace);
+  }
+}
+
+void ow_trace_write_time(struct ow_trace* trace, enum ow_trace_record_type type, uint64_t time_ns) {
+  ow_trace_write(trace, type, &time_ns, sizeof(time_ns));
+}
+
+void ow_trace_flush(struct ow_trace* trace) {
+  if (trace->file != NULL && fflush(trace->file) != 0) {
+    ow_trace_close(trace);
+  }
+}
+
+static bool read_u32(FILE* file, uint32_t* value) {
+  return fread(value, sizeof(*value), 1, file) == 1;
+}
+
+// `string` is NULL or allocated with `malloc`, also when it fails.
+static bool read_string(FILE* file, char** string) {
+  *string = NULL;
+  uint32_t length;
+  if (!read_u32(file, &length)) {
+    return false;
+  }
+  if (length == UINT32_MAX) {
+    return true;
+  }
+  if (length > MAX_RECORD_LENGTH) {
+    return false;
+  }
+  *string = malloc(length + 1);
+  if (*string == NULL || (length != 0 && fread(*string, length, 1, file) != 1)) {
+    return false;
+  }
+  (*string)[length] = '\0';
+  return true;
+}
+
+static bool read_options(FILE* file, struct ow_hook_options* options) {
+  uint8_t flags[4];
+  uint32_t pacing;
+  if (
+    fread(flags, sizeof(flags), 1, file) != 1 ||
+    !read_u32(file, &pacing) ||
+    pacing > OW_PACING_FIXED ||
+    !read_u32(file, &options->moveresize_fps)
+  ) {
+    return false;
+  }
+  options->track_configure_notify = flags[0] != 0;
+  options->capture_composite = flags[1] != 0;
+  options->follow_target = flags[2] != 0;
+  options->moveresize_pacing = pacing;
+  return true;
+}
+
+// Returns NULL if the matcher is truncated or can't be compiled.
+static struct ow_matcher* read_matcher(FILE* file) {
+  struct ow_matcher* matcher = calloc(1, sizeof(struct ow_matcher));
+  uint32_t title_mode;
+  bool is_read = read_u32(file, &title_mode) &&
+    title_mode <= OW_TITLE_REGEX &&
+    read_u32(file, &matcher->pid) &&
+    read_string(file, &matcher->title) &&
+    read_string(file, &matcher->wm_class) &&
+    read_string(file, &matcher->exe_name);
+  matcher->title_mode = title_mode;
+  if (!is_read || (title_mode != OW_TITLE_ANY && matcher->title == NULL) || ow_matcher_compile(matcher) != NULL) {
+    ow_matcher_free(matcher);
+    free(matcher);
+    return NULL;
+  }
+  return matcher;
+}
+
+bool ow_trace_open(struct ow_trace* trace, const char* path, struct ow_trace_header* header) {
+  memset(header, 0, sizeof(struct ow_trace_header));
+  trace->file = fopen(path, "rb");
+  if (trace->file == NULL) {
+    return false;
+  }
+  char magic[sizeof(MAGIC)];
+  uint32_t version;
+  uint32_t root_id;
+  uint32_t matcher_count;
+  bool is_read = fread(magic, sizeof(magic), 1, trace->file) == 1 &&
+    memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 &&
+    read_u32(trace->file, &version) &&
+    version == OW_TRACE_VERSION &&
+    read_u32(trace->file, &root_id) &&
+    fread(&header->start_ns, sizeof(header->start_ns), 1, trace->file) == 1 &&
+    read_options(trace->file, &header->options) &&
+    read_u32(trace->file, &matcher_count) &&
+    matcher_count != 0 && matcher_count <= OW_MAX_TARGETS;
+  while (is_read && header->matcher_count < matcher_count) {
+    struct ow_matcher* matcher = read_matcher(trace->file);
+    if (matcher == NULL) {
+      is_read = false;
+    } else {
+      header->matchers[header->matcher_count++] = matcher;
+    }
+  }
+  if (!is_read) {
+    for (uint32_t i = 0; i < header->matcher_count; ++i) {
+      ow_matcher_free(header->matchers[i]);
+      free(header->matchers[i]);
+    }
+    header->matcher_count = 0;
+    ow_trace_close(trace);
+    return false;
+  }
+  header->root = root_id;
+  return true;
+}
+
+bool ow_trace_peek(struct ow_trace* trace, struct ow_trace_record* record) {
+  if (trace->has_next) {
+    *record = trace->next;
+    return true;
+  }
+  if (trace->file == NULL) {
+    return false;
+  }
+  struct record_header header;
+  if (fread(&header, sizeof(header), 1, trace->file) != 1 || header.length > MAX_RECORD_LENGTH) {
+    return false;
+  }
+  if (header.length > trace->data_capacity) {
+    uint8_t* data = realloc(trace->data, header.length);
+    if (data == NULL) {
+      return false;
+    }
+    trace->data = data;
+    trace->data_capacity = header.length;
+  }
+  if (header.length != 0 && fread(trace->data, header.length, 1, trace->file) != 1) {
+    return false;
+  }
+  trace->next.type = header.type;
+  trace->next.length = header.length;
+  trace->next.data = trace->data;
+  trace->has_next = true;
+  *record = trace->next;
+  return true;
+}
+
+void ow_trace_skip(struct ow_trace* trace) {
+  trace->has_next = false;
+}
+
+uint64_t ow_trace_record_time(const struct ow_trace_record* record) {
+  uint64_t time_ns = 0;
+  if (record->length == sizeof(time_ns)) {
+    memcpy(&time_ns, record->data, sizeof(time_ns));
+  }
+  return time_ns;
+}
+
+void ow_trace_close(struct ow_trace* trace) {
+  if (trace->file != NULL) {
+    fclose(trace->file);
+    trace->file = NULL;
+  }
+  free(trace->data);
+  trace->data = NULL;
+  trace->data_capacity = 0;
+  trace->has_next = false;
+}
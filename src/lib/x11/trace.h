@@ -0,0 +1,100 @@
+#ifndef ADDON_SRC_X11_TRACE_H_
+#define ADDON_SRC_X11_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/xcb.h>
+#include "overlay_window.h"
+#include "matcher.h"
+
+// Binary trace of everything the hook thread reads from the X server, so
+// its state machine can be replayed later without one. Integers are in
+// native byte order, traces are meant to be replayed on the same machine
+// architecture they were recorded on.
+//
+//   header:  "OWTRACE\0", u32 version, u32 root window, u64 start time,
+//            options, u32 target count, matcher of every target
+//   options: u8 track_configure_notify, u8 capture_composite,
+//            u8 follow_target, u8 zero, u32 pacing, u32 fps
+//   matcher: u32 title mode, u32 pid, title, wm_class, exe_name
+//   string:  u32 length (UINT32_MAX if NULL), bytes
+//   record:  u8 type, u8[3] zero, u32 data length, data
+#define OW_TRACE_VERSION 2
+
+// X events are always 32 bytes on the wire (no Generic Events are selected)
+#define OW_TRACE_EVENT_LENGTH 32
+
+enum ow_trace_record_type {
+  // events that follow were read at once, data is u64 `uv_hrtime()`
+  OW_TRACE_BURST = 1,
+  // X event without `full_sequence`
+  OW_TRACE_EVENT,
+  // reply the hook waited for, empty if there was none (request failed)
+  OW_TRACE_REPLY,
+  // 1 byte, whether `/proc/<pid>` of a window matched the executable name
+  OW_TRACE_EXE_MATCH,
+  // held back move/resize became due, data is u64 `uv_hrtime()`
+  OW_TRACE_TIMEOUT
+};
+
+struct ow_trace_record
+{
+  enum ow_trace_record_type type;
+  uint32_t length;
+  // owned by the trace, valid until the next `ow_trace_peek`
+  const uint8_t* data;
+};
+
+// What the hook was started with, a trace is replayed the same way.
+struct ow_trace_header
+{
+  xcb_window_t root;
+  uint64_t start_ns;
+  // only the fields listed above, others are zero when read
+  struct ow_hook_options options;
+  struct ow_matcher* matchers[OW_MAX_TARGETS];
+  uint32_t matcher_count;
+};
+
+struct ow_trace
+{
+  FILE* file;
+  // replay only, record read by `ow_trace_peek` but not skipped yet
+  bool has_next;
+  struct ow_trace_record next;
+  uint8_t* data;
+  uint32_t data_capacity;
+};
+
+void ow_trace_init(struct ow_trace* trace);
+
+// Creates the file and writes the header. Returns `false` if it can't be written.
+bool ow_trace_create(struct ow_trace* trace, const char* path, const struct ow_trace_header* header);
+
+// Stops writing the trace on failure (e.g. disk is full).
+void ow_trace_write(struct ow_trace* trace, enum ow_trace_record_type type, const void* data, uint32_t length);
+
+void ow_trace_write_time(struct ow_trace* trace, enum ow_trace_record_type type, uint64_t time_ns);
+
+// Called after every burst of events, so the trace survives a crash.
+void ow_trace_flush(struct ow_trace* trace);
+
+// Returns `false` if the file is not a trace or has an unsupported version.
+// Otherwise matchers of `header` are allocated and compiled, and owned by
+// the caller the same way as matchers passed to `ow_start_hook`.
+bool ow_trace_open(struct ow_trace* trace, const char* path, struct ow_trace_header* header);
+
+// Reads the next record without consuming it. Returns `false`
+// at the end of the trace or if the record is truncated.
+bool ow_trace_peek(struct ow_trace* trace, struct ow_trace_record* record);
+
+// Consumes the record returned by `ow_trace_peek`.
+void ow_trace_skip(struct ow_trace* trace);
+
+// Time of OW_TRACE_BURST and OW_TRACE_TIMEOUT records.
+uint64_t ow_trace_record_time(const struct ow_trace_record* record);
+
+void ow_trace_close(struct ow_trace* trace);
+
+#endif // !ADDON_SRC_X11_TRACE_H_
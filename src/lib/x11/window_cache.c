@@ -0,0 +1,118 @@
+#include <string.h>
+#include "window_cache.h"
+
+#define NIL -1
+
+static uint32_t bucket_of(xcb_window_t wid) {
+  // window IDs are allocated sequentially in per-client ranges
+  return (wid ^ (wid >> 7) ^ (wid >> 13)) & (OW_WINDOW_CACHE_BUCKETS - 1);
+}
+
+static void lru_unlink(struct ow_window_cache* cache, int16_t idx) {
+  struct ow_window_cache_entry* entry = &cache->entries[idx];
+  if (entry->lru_prev != NIL) {
+    cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+  } else {
+    cache->lru_head = entry->lru_next;
+  }
+  if (entry->lru_next != NIL) {
+    cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+  } else {
+    cache->lru_tail = entry->lru_prev;
+  }
+}
+
+static void lru_push_front(struct ow_window_cache* cache, int16_t idx) {
+  struct ow_window_cache_entry* entry = &cache->entries[idx];
+  entry->lru_prev = NIL;
+  entry->lru_next = cache->lru_head;
+  if (cache->lru_head != NIL) {
+    cache->entries[cache->lru_head].lru_prev = idx;
+  } else {
+    cache->lru_tail = idx;
+  }
+  cache->lru_head = idx;
+}
+
+static void bucket_unlink(struct ow_window_cache* cache, int16_t idx) {
+  int16_t* link = &cache->buckets[bucket_of(cache->entries[idx].window_id)];
+  while (*link != idx) {
+    link = &cache->entries[*link].bucket_next;
+  }
+  *link = cache->entries[idx].bucket_next;
+}
+
+static int16_t find(struct ow_window_cache* cache, xcb_window_t wid) {
+  int16_t idx = cache->buckets[bucket_of(wid)];
+  while (idx != NIL && cache->entries[idx].window_id != wid) {
+    idx = cache->entries[idx].bucket_next;
+  }
+  return idx;
+}
+
+static void release(struct ow_window_cache* cache, int16_t idx) {
+  struct ow_window_cache_entry* entry = &cache->entries[idx];
+  bucket_unlink(cache, idx);
+  lru_unlink(cache, idx);
+  entry->window_id = XCB_WINDOW_NONE;
+  entry->bucket_next = cache->free_head;
+  cache->free_head = idx;
+}
+
+void ow_window_cache_init(struct ow_window_cache* cache) {
+  memset(cache, 0, sizeof(struct ow_window_cache));
+  for (int i = 0; i < OW_WINDOW_CACHE_BUCKETS; ++i) {
+    cache->buckets[i] = NIL;
+  }
+  for (int i = 0; i < OW_WINDOW_CACHE_CAPACITY; ++i) {
+    cache->entries[i].bucket_next = (i + 1 < OW_WINDOW_CACHE_CAPACITY) ? i + 1 : NIL;
+  }
+  cache->free_head = 0;
+  cache->lru_head = NIL;
+  cache->lru_tail = NIL;
+}
+
+struct ow_window_cache_entry* ow_window_cache_get(struct ow_window_cache* cache, xcb_window_t wid) {
+  int16_t idx = find(cache, wid);
+  if (idx == NIL) {
+    return NULL;
+  }
+  if (cache->lru_head != idx) {
+    lru_unlink(cache, idx);
+    lru_push_front(cache, idx);
+  }
+  return &cache->entries[idx];
+}
+
+struct ow_window_cache_entry* ow_window_cache_peek(struct ow_window_cache* cache, xcb_window_t wid) {
+  int16_t idx = find(cache, wid);
+  return (idx != NIL) ? &cache->entries[idx] : NULL;
+}
+
+struct ow_window_cache_entry* ow_window_cache_insert(struct ow_window_cache* cache, xcb_window_t wid, xcb_window_t* evicted) {
+  *evicted = XCB_WINDOW_NONE;
+
+  if (cache->free_head == NIL) {
+    *evicted = cache->entries[cache->lru_tail].window_id;
+    release(cache, cache->lru_tail);
+  }
+
+  int16_t idx = cache->free_head;
+  struct ow_window_cache_entry* entry = &cache->entries[idx];
+  cache->free_head = entry->bucket_next;
+
+  memset(entry, 0, sizeof(struct ow_window_cache_entry));
+  entry->window_id = wid;
+  uint32_t bucket = bucket_of(wid);
+  entry->bucket_next = cache->buckets[bucket];
+  cache->buckets[bucket] = idx;
+  lru_push_front(cache, idx);
+  return entry;
+}
+
+void ow_window_cache_remove(struct ow_window_cache* cache, xcb_window_t wid) {
+  int16_t idx = find(cache, wid);
+  if (idx != NIL) {
+    release(cache, idx);
+  }
+}
@@ -0,0 +1,74 @@
+#ifndef ADDON_SRC_X11_WINDOW_CACHE_H_
+#define ADDON_SRC_X11_WINDOW_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <xcb/xcb.h>
+#include "overlay_window.h"
+
+// must be a power of two
+#define OW_WINDOW_CACHE_BUCKETS 64
+#define OW_WINDOW_CACHE_CAPACITY 32
+
+struct ow_frame_offset
+{
+  // position of the content area inside parent (usually WM frame)
+  int32_t rel_x;
+  int32_t rel_y;
+  // position of the parent in root coordinates
+  int32_t parent_x;
+  int32_t parent_y;
+};
+
+// Everything about a window that is needed to decide if it's the target and
+// to attach to it. Each field is invalidated by the X event that changes it.
+struct ow_window_cache_entry
+{
+  xcb_window_t window_id;
+
+  // bit per target, invalidated by PropertyNotify(_NET_WM_NAME, WM_CLASS, _NET_WM_PID)
+  uint32_t match_known;
+  uint32_t match_mask;
+
+  // invalidated by PropertyNotify(_NET_WM_STATE)
+  bool has_wm_state;
+  bool is_fullscreen;
+
+  // invalidated by ConfigureNotify, ReparentNotify
+  bool has_geometry;
+  struct ow_window_bounds bounds;
+  struct ow_frame_offset frame;
+
+  // internal
+  int16_t bucket_next;
+  int16_t lru_prev;
+  int16_t lru_next;
+};
+
+// Fixed-size hash table keyed by window ID with LRU eviction.
+struct ow_window_cache
+{
+  struct ow_window_cache_entry entries[OW_WINDOW_CACHE_CAPACITY];
+  int16_t buckets[OW_WINDOW_CACHE_BUCKETS];
+  // most recently used
+  int16_t lru_head;
+  // least recently used
+  int16_t lru_tail;
+  int16_t free_head;
+};
+
+void ow_window_cache_init(struct ow_window_cache* cache);
+
+// Returns NULL if window is not cached. Marks entry as most recently used.
+struct ow_window_cache_entry* ow_window_cache_get(struct ow_window_cache* cache, xcb_window_t wid);
+
+// Same as `ow_window_cache_get`, but doesn't affect eviction order.
+struct ow_window_cache_entry* ow_window_cache_peek(struct ow_window_cache* cache, xcb_window_t wid);
+
+// Returns an empty entry for the window. If the cache was full, the least
+// recently used window is stored into `evicted`, otherwise XCB_WINDOW_NONE.
+struct ow_window_cache_entry* ow_window_cache_insert(struct ow_window_cache* cache, xcb_window_t wid, xcb_window_t* evicted);
+
+void ow_window_cache_remove(struct ow_window_cache* cache, xcb_window_t wid);
+
+#endif // !ADDON_SRC_X11_WINDOW_CACHE_H_
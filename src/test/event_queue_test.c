@@ -0,0 +1,121 @@
+// Checks ordering guarantees of the event queue (see event_queue.h),
+// pushing and popping on one thread as if JS was stalled in between:
+//
+//   node-gyp configure -- -Dbuild_tests=1 && node-gyp build
+//   build/Release/event_queue_test
+
+#include <stdio.h>
+#include "event_queue.h"
+
+static struct ow_event_queue queue;
+static int failures = 0;
+
+static void push(enum ow_event_type type, uint32_t target_id, int32_t x) {
+  struct ow_event event = { .type = type, .target_id = target_id };
+  if (type == OW_MOVERESIZE) {
+    event.data.moveresize.bounds.x = x;
+  }
+  ow_event_queue_push(&queue, &event);
+}
+
+static void drain(void) {
+  struct ow_event event;
+  ow_event_queue_begin_drain(&queue);
+  while (ow_event_queue_pop(&queue, &event)) {}
+}
+
+// `expected` is terminated by a negative type, `x` is checked for move/resize.
+static void expect(const char* name, const int expected[][2]) {
+  struct ow_event event;
+  uint32_t i = 0;
+  ow_event_queue_begin_drain(&queue);
+  while (ow_event_queue_pop(&queue, &event)) {
+    if (
+      expected[i][0] < 0 ||
+      (int)event.type != expected[i][0] ||
+      (event.type == OW_MOVERESIZE && event.data.moveresize.bounds.x != expected[i][1])
+    ) {
+      printf("FAIL %s: unexpected event %d at %u\n", name, event.type, i);
+      failures += 1;
+      drain();
+      return;
+    }
+    i += 1;
+  }
+  if (expected[i][0] >= 0) {
+    printf("FAIL %s: missing event %d at %u\n", name, expected[i][0], i);
+    failures += 1;
+    return;
+  }
+  printf("ok %s\n", name);
+}
+
+static void focus_before_reattach(void) {
+  ow_event_queue_init(&queue);
+  push(OW_ATTACH, 0, 0);
+  push(OW_FOCUS, 0, 0);
+  drain();
+  push(OW_BLUR, 0, 0);
+  push(OW_DETACH, 0, 0);
+  push(OW_ATTACH, 0, 0);
+  push(OW_FOCUS, 0, 0);
+  const int expected[][2] = { { OW_BLUR }, { OW_DETACH }, { OW_ATTACH }, { OW_FOCUS }, { -1 } };
+  expect("focus state stays on its side of detach and attach", expected);
+}
+
+static void same_focus_after_attach(void) {
+  ow_event_queue_init(&queue);
+  push(OW_FOCUS, 0, 0);
+  drain();
+  push(OW_DETACH, 0, 0);
+  push(OW_ATTACH, 0, 0);
+  push(OW_FOCUS, 0, 0);
+  const int expected[][2] = { { OW_DETACH }, { OW_ATTACH }, { OW_FOCUS }, { -1 } };
+  expect("unchanged focus state is delivered after attach", expected);
+}
+
+static void bounds_before_detach(void) {
+  ow_event_queue_init(&queue);
+  push(OW_MOVERESIZE, 0, 1);
+  push(OW_MOVERESIZE, 0, 2);
+  push(OW_DETACH, 0, 0);
+  push(OW_ATTACH, 0, 0);
+  push(OW_MOVERESIZE, 0, 3);
+  push(OW_MOVERESIZE, 0, 4);
+  const int expected[][2] = { { OW_MOVERESIZE, 2 }, { OW_DETACH }, { OW_ATTACH }, { OW_MOVERESIZE, 4 }, { -1 } };
+  expect("bounds are coalesced only between lifecycle events", expected);
+}
+
+static void other_target_keeps_marker(void) {
+  ow_event_queue_init(&queue);
+  push(OW_MOVERESIZE, 1, 1);
+  push(OW_ATTACH, 0, 0);
+  push(OW_MOVERESIZE, 1, 2);
+  const int expected[][2] = { { OW_MOVERESIZE, 2 }, { OW_ATTACH }, { -1 } };
+  expect("events of other targets don't split coalescing", expected);
+}
+
+static void full_ring(void) {
+  ow_event_queue_init(&queue);
+  for (uint32_t i = 0; i < OW_EVENT_QUEUE_CAPACITY; ++i) {
+    push(OW_FULLSCREEN, 0, 0);
+  }
+  push(OW_MOVERESIZE, 0, 5);
+  int expected[OW_EVENT_QUEUE_CAPACITY + 2][2];
+  for (uint32_t i = 0; i < OW_EVENT_QUEUE_CAPACITY; ++i) {
+    expected[i][0] = OW_FULLSCREEN;
+  }
+  expected[OW_EVENT_QUEUE_CAPACITY][0] = OW_MOVERESIZE;
+  expected[OW_EVENT_QUEUE_CAPACITY][1] = 5;
+  expected[OW_EVENT_QUEUE_CAPACITY + 1][0] = -1;
+  expect("bounds without a marker are delivered after a full ring", (const int (*)[2])expected);
+}
+
+int main(void) {
+  focus_before_reattach();
+  same_focus_after_attach();
+  bounds_before_detach();
+  other_target_keeps_marker();
+  full_ring();
+  return failures == 0 ? 0 : 1;
+}